@@ -1,4 +1,5 @@
 #include "addressbook.h"
+#include "journaledstore.h"
 #include "ui_addressbook.h"
 #include "ui_mainwindow.h"
 #include "settings.h"
@@ -260,18 +261,42 @@ AddressBook::AddressBook() {
 }
 
 void AddressBook::readFromStorage() {
-    QFile file(AddressBook::writeableFile());
+    auto store = JournaledStore::forFile(AddressBook::writeableFile());
 
-    if (file.exists()) {
-        allLabels.clear();
+    allLabels.clear();
+    if (store->needsMigration()) {
+        // Address book from an older version. Read it and convert it to the journaled store.
+        QFile file(AddressBook::writeableFile());
         file.open(QIODevice::ReadOnly);
         QDataStream in(&file);    // read the data serialized from the file
         QString version;
         in >> version >> allLabels; 
 
         file.close();
+
+        // Labels are the keys in the store, so only keep the first entry for each label
+        QSet<QString> seen;
+        QList<QPair<QString, QByteArray>> entries;
+        for (int i = 0; i < allLabels.size(); ) {
+            if (seen.contains(allLabels[i].first)) {
+                allLabels.removeAt(i);
+                continue;
+            }
+
+            seen.insert(allLabels[i].first);
+            entries.push_back(QPair<QString, QByteArray>(allLabels[i].first, allLabels[i].second.toUtf8()));
+            i++;
+        }
+        store->replaceAll(entries);
+    }
+    else {
+        for (const auto& i : store->getAll()) {
+            allLabels.push_back(QPair<QString, QString>(i.first, QString::fromUtf8(i.second)));
+        }
     }
 
+    rebuildIndex();
+
     // Special. 
     // Add the default ZeroWallet donation address if it isn't already present
     // QList<QString> allAddresses;
@@ -282,14 +307,6 @@ void AddressBook::readFromStorage() {
     // }
 }
 
-void AddressBook::writeToStorage() {
-    QFile file(AddressBook::writeableFile());
-    file.open(QIODevice::ReadWrite | QIODevice::Truncate);
-    QDataStream out(&file);   // we will serialize the data into the file
-    out << QString("v1") << allLabels;
-    file.close();
-}
-
 QString AddressBook::writeableFile() {
     auto filename = QStringLiteral("addresslabels.dat");
 
@@ -305,40 +322,111 @@ QString AddressBook::writeableFile() {
 }
 
 
+QString AddressBook::indexKey(const QString& label, const QString& address) {
+    return (label % "/" % address).toCaseFolded();
+}
+
+void AddressBook::rebuildIndex() {
+    addressToLabel.clear();
+    labelToAddress.clear();
+    prefixIndex.clear();
+
+    for (const auto& i : allLabels) {
+        indexLabel(i.first, i.second);
+    }
+}
+
+void AddressBook::indexLabel(const QString& label, const QString& address) {
+    // Lookups return the first entry in allLabels, so don't overwrite an existing one
+    if (!addressToLabel.contains(address))
+        addressToLabel.insert(address, label);
+    if (!labelToAddress.contains(label))
+        labelToAddress.insert(label, address);
+
+    prefixIndex.insert(indexKey(label, address), QPair<QString, QString>(label, address));
+}
+
+// Call after the entry has been removed from allLabels
+void AddressBook::unindexLabel(const QString& label, const QString& address) {
+    prefixIndex.remove(indexKey(label, address), QPair<QString, QString>(label, address));
+
+    bool addressIndexed = addressToLabel.value(address) == label;
+    bool labelIndexed   = labelToAddress.value(label) == address;
+    if (addressIndexed)
+        addressToLabel.remove(address);
+    if (labelIndexed)
+        labelToAddress.remove(label);
+
+    if (!addressIndexed && !labelIndexed)
+        return;
+
+    // An address can have several labels, so look for the next one
+    for (const auto& i : allLabels) {
+        if (addressIndexed && i.second == address && !addressToLabel.contains(address))
+            addressToLabel.insert(address, i.first);
+        if (labelIndexed && i.first == label && !labelToAddress.contains(label))
+            labelToAddress.insert(label, i.second);
+    }
+}
+
 // Add a new address/label to the database
 void AddressBook::addAddressLabel(QString label, QString address) {
     Q_ASSERT(Settings::isValidAddress(address));
 
+    auto store = JournaledStore::forFile(writeableFile());
+
     // First, remove any existing label
-    // Iterate over the list and remove the label/address
-    for (int i=0; i < allLabels.size(); i++) {
-        if (allLabels[i].first == label) {
-            removeAddressLabel(allLabels[i].first, allLabels[i].second);
+    if (labelToAddress.contains(label)) {
+        for (int i = allLabels.size() - 1; i >= 0; i--) {
+            if (allLabels[i].first == label) {
+                auto old = allLabels.takeAt(i);
+                unindexLabel(old.first, old.second);
+            }
         }
+        store->remove(label);
     }
 
     allLabels.push_back(QPair<QString, QString>(label, address));
-    writeToStorage();
+    indexLabel(label, address);
+    store->put(label, address.toUtf8());
 }
 
 // Remove a new address/label from the database
 void AddressBook::removeAddressLabel(QString label, QString address) {
+    if (!prefixIndex.contains(indexKey(label, address), QPair<QString, QString>(label, address)))
+        return;
+
     // Iterate over the list and remove the label/address
     for (int i=0; i < allLabels.size(); i++) {
         if (allLabels[i].first == label && allLabels[i].second == address) {
             allLabels.removeAt(i);
-            writeToStorage();
+            unindexLabel(label, address);
+            JournaledStore::forFile(writeableFile())->remove(label);
             return;
         }
     }
 }
 
 void AddressBook::updateLabel(QString oldlabel, QString address, QString newlabel) {
+    if (!prefixIndex.contains(indexKey(oldlabel, address), QPair<QString, QString>(oldlabel, address)))
+        return;
+
+    // Labels are unique, so the renamed entry replaces any other entry with the new label
+    if (newlabel != oldlabel) {
+        for (int i = allLabels.size() - 1; i >= 0; i--) {
+            if (allLabels[i].first == newlabel)
+                allLabels.removeAt(i);
+        }
+    }
+
     // Iterate over the list and update the label/address
     for (int i = 0; i < allLabels.size(); i++) {
         if (allLabels[i].first == oldlabel && allLabels[i].second == address) {
             allLabels[i].first = newlabel;
-            writeToStorage();
+
+            // The entry keeps its position, so it might now be the first label for the address
+            rebuildIndex();
+            JournaledStore::forFile(writeableFile())->rename(oldlabel, newlabel, address.toUtf8());
             return;
         }
     }
@@ -354,22 +442,34 @@ const QList<QPair<QString, QString>>& AddressBook::getAllAddressLabels() {
 
 // Get the label for an address
 QString AddressBook::getLabelForAddress(QString addr) {
-    for (auto i : allLabels) {
-        if (i.second == addr)
-            return i.first;
-    }
-
-    return "";
+    return addressToLabel.value(addr, "");
 }
 
 // Get the address for a label
 QString AddressBook::getAddressForLabel(QString label) {
-    for (auto i: allLabels) {
-        if (i.first == label)
-            return i.second;
+    return labelToAddress.value(label, "");
+}
+
+QList<QPair<QString, QString>> AddressBook::getLabelsWithPrefix(const QString& prefix) {
+    QList<QPair<QString, QString>> matches;
+
+    auto key = prefix.toCaseFolded();
+    for (auto it = prefixIndex.lowerBound(key); it != prefixIndex.end() && it.key().startsWith(key); ++it) {
+        matches.push_back(it.value());
+    }
+
+    return matches;
+}
+
+QStringList AddressBook::getCompletions() {
+    QStringList completions;
+    completions.reserve(prefixIndex.size());
+
+    for (const auto& i : prefixIndex) {
+        completions.push_back(i.first % "/" % i.second);
     }
 
-    return "";
+    return completions;
 }
 
 QString AddressBook::addLabelToAddress(QString addr) {
@@ -54,15 +54,29 @@ public:
     QString getLabelForAddress(QString address);
     // Get a Label's address
     QString getAddressForLabel(QString label);
+
+    // All the label/address pairs whose label starts with the prefix (case insensitive), sorted by label
+    QList<QPair<QString, QString>> getLabelsWithPrefix(const QString& prefix);
+    // "label/address" for every entry, sorted case insensitively, for the QCompleters
+    QStringList getCompletions();
 private:
     AddressBook();
 
     void readFromStorage();
-    void writeToStorage();
+
+    static QString indexKey(const QString& label, const QString& address);
+    void rebuildIndex();
+    void indexLabel(const QString& label, const QString& address);
+    void unindexLabel(const QString& label, const QString& address);
 
     QString writeableFile();
     QList<QPair<QString, QString>> allLabels;
 
+    // Lookup indexes over allLabels
+    QHash<QString, QString>                         addressToLabel;     // address -> first label
+    QHash<QString, QString>                         labelToAddress;     // label -> first address
+    QMultiMap<QString, QPair<QString, QString>>     prefixIndex;        // case folded "label/address" -> every (label, address) with that key
+
     static AddressBook* instance;
 };
 
@@ -6,17 +6,58 @@ AddressCombo::AddressCombo(QWidget* parent) :
     QComboBox(parent) {
 }
 
+void AddressCombo::setAddressFilter(AddressFilterProxyModel::Filter filter) {
+    if (proxy != nullptr) {
+        proxy->setFilter(filter);
+        return;
+    }
+
+    proxy = new AddressFilterProxyModel(filter, this);
+    setModel(proxy);
+
+    // Type-to-search over the whole list
+    setEditable(true);
+    setInsertPolicy(QComboBox::NoInsert);
+
+    auto completer = new QCompleter(proxy, this);
+    completer->setCompletionMode(QCompleter::PopupCompletion);
+    completer->setFilterMode(Qt::MatchContains);
+    completer->setCaseSensitivity(Qt::CaseInsensitive);
+    setCompleter(completer);
+
+    if (auto view = qobject_cast<QListView*>(this->view()))
+        view->setUniformItemSizes(true);
+}
+
 QString AddressCombo::itemText(int i) {
+    auto addr = itemData(i, AddressListModel::AddressRole).toString();
+    if (!addr.isEmpty())
+        return addr;
+
     QString txt = QComboBox::itemText(i);
     return AddressBook::addressFromAddressLabel(txt.split("(")[0].trimmed());
 }
 
 QString AddressCombo::currentText() {
+    // If the user has typed something that isn't one of the items, use what was typed
     QString txt = QComboBox::currentText();
+    if (currentIndex() >= 0 && txt == QComboBox::itemText(currentIndex())) {
+        auto addr = currentData(AddressListModel::AddressRole).toString();
+        if (!addr.isEmpty())
+            return addr;
+    }
+
     return AddressBook::addressFromAddressLabel(txt.split("(")[0].trimmed());
 }
 
 void AddressCombo::setCurrentText(const QString& text) {
+    if (proxy != nullptr) {
+        int i = findData(text, AddressListModel::AddressRole, Qt::MatchExactly);
+        if (i >= 0)
+            QComboBox::setCurrentIndex(i);
+        return;
+    }
+
     for (int i=0; i < count(); i++) {
         if (itemText(i) == text) {
             QComboBox::setCurrentIndex(i);
@@ -24,16 +65,16 @@ void AddressCombo::setCurrentText(const QString& text) {
     }
 } 
 
-void AddressCombo::addItem(const QString& text, double bal) {
+void AddressCombo::addItem(const QString& text, Amount bal) {
     QString txt = AddressBook::addLabelToAddress(text);
-    if (bal > 0)
-        txt = txt % "(" % Settings::getZECDisplayFormat(bal) % ")";
+    if (bal > Amount())
+        txt = txt % "(" % bal.toDecimalZECString() % ")";
         
     QComboBox::addItem(txt);
 }
 
-void AddressCombo::insertItem(int index, const QString& text, double bal) {
+void AddressCombo::insertItem(int index, const QString& text, Amount bal) {
     QString txt = AddressBook::addLabelToAddress(text) % 
-                    "(" % Settings::getZECDisplayFormat(bal) % ")";
+                    "(" % bal.toDecimalZECString() % ")";
     QComboBox::insertItem(index, txt);
 }
\ No newline at end of file
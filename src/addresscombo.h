@@ -2,6 +2,8 @@
 #define ADDRESSCOMBO_H
 
 #include "precompiled.h"
+#include "amount.h"
+#include "addresslistmodel.h"
 
 class AddressCombo : public QComboBox 
 {
@@ -12,13 +14,18 @@ public:
     QString     itemText(int i);
     QString     currentText();
 
-    void        addItem(const QString& itemText, double bal);
-    void        insertItem(int index, const QString& text, double bal = 0.0);
+    void        addItem(const QString& itemText, Amount bal);
+    void        insertItem(int index, const QString& text, Amount bal = Amount());
+
+    // Show the shared AddressListModel through the given filter, instead of items added one by one.
+    // The list becomes searchable by typing any part of an address or label.
+    void        setAddressFilter(AddressFilterProxyModel::Filter filter);
 
 public slots:
     void setCurrentText(const QString& itemText);
 
 private:
+    AddressFilterProxyModel*    proxy = nullptr;
 };
 
 #endif // ADDRESSCOMBO_H
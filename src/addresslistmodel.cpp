@@ -0,0 +1,187 @@
+#include "addresslistmodel.h"
+#include "addressbook.h"
+#include "settings.h"
+
+AddressListModel* AddressListModel::instance = nullptr;
+
+AddressListModel* AddressListModel::getInstance() {
+    if (instance == nullptr)
+        instance = new AddressListModel();
+
+    return instance;
+}
+
+// Append any addresses we don't already know about
+void AddressListModel::addAddresses(const QList<QString>& addrs) {
+    QList<QString> newAddrs;
+    QSet<QString>  seen;
+    for (const auto& addr : addrs) {
+        if (rows.contains(addr) || seen.contains(addr))
+            continue;
+
+        seen.insert(addr);
+        newAddrs.push_back(addr);
+    }
+
+    if (newAddrs.isEmpty())
+        return;
+
+    beginInsertRows(QModelIndex(), entries.size(), entries.size() + newAddrs.size() - 1);
+    for (const auto& addr : newAddrs) {
+        rows.insert(addr, entries.size());
+        entries.push_back(Entry{ addr, Amount() });
+    }
+    endInsertRows();
+}
+
+// A freshly created address goes to the top, so it shows up first in the receive list
+void AddressListModel::addNewAddress(const QString& addr) {
+    if (rows.contains(addr))
+        return;
+
+    beginInsertRows(QModelIndex(), 0, 0);
+    entries.insert(0, Entry{ addr, Amount() });
+    for (auto& row : rows) {
+        row++;
+    }
+    rows.insert(addr, 0);
+    endInsertRows();
+}
+
+// Apply a new balance map. Only the rows whose balance changed are signalled.
+void AddressListModel::setBalances(const QMap<QString, Amount>* balances) {
+    if (balances == nullptr)
+        return;
+
+    // Addresses can have a balance before they show up in the address lists (eg. watch-only)
+    addAddresses(balances->keys());
+
+    QList<int> changedRows;
+    for (int row = 0; row < entries.size(); row++) {
+        auto bal = balances->value(entries[row].address);
+        if (bal != entries[row].balance) {
+            entries[row].balance = bal;
+            changedRows.push_back(row);
+        }
+    }
+
+    emitChangedRuns(changedRows);
+}
+
+// The display text includes the label, so repaint everything
+void AddressListModel::labelsChanged() {
+    if (entries.isEmpty())
+        return;
+
+    dataChanged(index(0), index(entries.size() - 1), { Qt::DisplayRole });
+}
+
+void AddressListModel::clear() {
+    beginResetModel();
+    entries.clear();
+    rows.clear();
+    endResetModel();
+}
+
+Amount AddressListModel::getBalance(const QString& addr) const {
+    auto it = rows.constFind(addr);
+    if (it == rows.constEnd())
+        return Amount();
+
+    return entries.at(it.value()).balance;
+}
+
+void AddressListModel::emitChangedRuns(const QList<int>& sortedRows) {
+    for (int i = 0; i < sortedRows.size(); ) {
+        int first = sortedRows[i];
+        int last  = first;
+        while (++i < sortedRows.size() && sortedRows[i] == last + 1) {
+            last++;
+        }
+
+        dataChanged(index(first), index(last));
+    }
+}
+
+int AddressListModel::rowCount(const QModelIndex& parent) const {
+    if (parent.isValid())
+        return 0;
+
+    return entries.size();
+}
+
+QVariant AddressListModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || index.row() >= entries.size())
+        return QVariant();
+
+    const auto& e = entries.at(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+    case Qt::EditRole: {
+            // Same format as AddressCombo::addItem
+            QString txt = AddressBook::addLabelToAddress(e.address);
+            if (e.balance > Amount())
+                txt = txt % "(" % e.balance.toDecimalZECString() % ")";
+            return txt;
+        }
+    case Qt::ToolTipRole: return e.address;
+    case AddressRole:     return e.address;
+    case BalanceRole:     return e.balance.toZats();
+    }
+
+    return QVariant();
+}
+
+
+AddressFilterProxyModel::AddressFilterProxyModel(Filter filter, QObject* parent)
+    : QSortFilterProxyModel(parent), filter(filter) {
+    setSourceModel(AddressListModel::getInstance());
+    setDynamicSortFilter(true);
+    sort(0);
+}
+
+void AddressFilterProxyModel::setFilter(Filter newFilter) {
+    if (filter == newFilter)
+        return;
+
+    filter = newFilter;
+    invalidate();
+}
+
+bool AddressFilterProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const {
+    auto idx  = sourceModel()->index(sourceRow, 0, sourceParent);
+    auto addr = idx.data(AddressListModel::AddressRole).toString();
+
+    switch (filter) {
+    case FundedAddresses: return idx.data(AddressListModel::BalanceRole).toLongLong() > 0;
+    case ZAddresses:      return Settings::isZAddress(addr);
+    case TAddresses:      return Settings::isTAddress(addr);
+    }
+
+    return false;
+}
+
+bool AddressFilterProxyModel::lessThan(const QModelIndex& left, const QModelIndex& right) const {
+    switch (filter) {
+    case FundedAddresses:
+        return left.data(AddressListModel::AddressRole).toString() < right.data(AddressListModel::AddressRole).toString();
+    case TAddresses: {
+            auto lbal = left.data(AddressListModel::BalanceRole).toLongLong();
+            auto rbal = right.data(AddressListModel::BalanceRole).toLongLong();
+            if ((lbal > 0) != (rbal > 0))
+                return lbal > 0;
+
+            auto book = AddressBook::getInstance();
+            bool llabel = !book->getLabelForAddress(left.data(AddressListModel::AddressRole).toString()).isEmpty();
+            bool rlabel = !book->getLabelForAddress(right.data(AddressListModel::AddressRole).toString()).isEmpty();
+            if (llabel != rlabel)
+                return llabel;
+
+            return left.row() < right.row();
+        }
+    case ZAddresses:
+        return left.row() < right.row();
+    }
+
+    return false;
+}
@@ -0,0 +1,74 @@
+#ifndef ADDRESSLISTMODEL_H
+#define ADDRESSLISTMODEL_H
+
+#include "precompiled.h"
+#include "amount.h"
+
+/**
+ * A single list of all the wallet's addresses and their balances, shared by all the AddressCombos.
+ * The RPC pushes new address lists and balance maps into it, and it updates the rows in place, so the
+ * combos keep their selection and only the rows that actually changed get repainted.
+ */
+class AddressListModel : public QAbstractListModel
+{
+public:
+    enum Roles {
+        AddressRole = Qt::UserRole + 1,     // The bare address, without label or balance
+        BalanceRole                         // The balance, in zatoshis
+    };
+
+    static AddressListModel* getInstance();
+
+    void    addAddresses(const QList<QString>& addrs);
+    void    addNewAddress(const QString& addr);
+    void    setBalances(const QMap<QString, Amount>* balances);
+    void    labelsChanged();
+    void    clear();
+
+    Amount  getBalance(const QString& addr) const;
+
+    int      rowCount(const QModelIndex &parent) const;
+    QVariant data(const QModelIndex &index, int role) const;
+
+private:
+    AddressListModel() = default;
+
+    struct Entry {
+        QString address;
+        Amount  balance;
+    };
+
+    void emitChangedRuns(const QList<int>& sortedRows);
+
+    QList<Entry>            entries;
+    QHash<QString, int>     rows;       // address -> row in entries
+
+    static AddressListModel* instance;
+};
+
+/**
+ * The view of the shared AddressListModel that a particular AddressCombo shows.
+ */
+class AddressFilterProxyModel : public QSortFilterProxyModel
+{
+public:
+    enum Filter {
+        FundedAddresses = 1,    // Every address with a balance, sorted by address (Send tab "From")
+        ZAddresses,             // All z-addresses, in wallet order
+        TAddresses              // All t-addresses. Funded first, then labelled, then the rest
+    };
+
+    AddressFilterProxyModel(Filter filter, QObject* parent);
+
+    void    setFilter(Filter filter);
+    Filter  getFilter() const { return filter; }
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const;
+    bool lessThan(const QModelIndex& left, const QModelIndex& right) const;
+
+private:
+    Filter filter;
+};
+
+#endif // ADDRESSLISTMODEL_H
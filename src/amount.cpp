@@ -0,0 +1,106 @@
+#include "amount.h"
+#include "settings.h"
+
+Amount Amount::fromDouble(double amt) {
+    return fromZats(std::llround(amt * COIN));
+}
+
+// Parse a decimal string like "-12.3456" directly into zatoshis, without going through a double.
+// More than 8 decimal places, or any stray characters, is an error.
+Amount Amount::fromDecimalString(const QString& amt, bool* ok) {
+    if (ok) *ok = false;
+
+    auto s   = amt.trimmed();
+    int  i   = 0;
+    bool neg = false;
+    if (i < s.length() && (s[i] == '-' || s[i] == '+')) {
+        neg = s[i] == '-';
+        i++;
+    }
+
+    qint64 whole = 0;
+    qint64 frac  = 0;
+    int    wholeDigits = 0;
+    int    fracDigits  = 0;
+
+    for (; i < s.length() && s[i].isDigit(); i++, wholeDigits++) {
+        whole = whole * 10 + s[i].digitValue();
+        if (whole > std::numeric_limits<qint64>::max() / COIN)
+            return Amount();
+    }
+
+    if (i < s.length() && s[i] == '.') {
+        for (i++; i < s.length() && s[i].isDigit(); i++, fracDigits++) {
+            if (fracDigits == 8)
+                return Amount();
+            frac = frac * 10 + s[i].digitValue();
+        }
+    }
+
+    if (i != s.length() || (wholeDigits == 0 && fracDigits == 0))
+        return Amount();
+
+    for (int d = fracDigits; d < 8; d++) {
+        frac *= 10;
+    }
+
+    // whole * COIN fits on its own, but adding frac can still push it over
+    if (whole > (std::numeric_limits<qint64>::max() - frac) / COIN)
+        return Amount();
+
+    if (ok) *ok = true;
+
+    qint64 total = whole * COIN + frac;
+    return fromZats(neg ? -total : total);
+}
+
+// Equivalent to QString::number(amt, 'f', 8), optionally with the trailing zeros (and ".") trimmed,
+// but built straight from the integer parts.
+QString Amount::format(bool trimZeros) const {
+    quint64 abs   = zats < 0 ? (quint64)0 - (quint64)zats : (quint64)zats;
+    quint64 whole = abs / COIN;
+    quint64 frac  = abs % COIN;
+
+    char  buf[32];
+    char* end = buf + sizeof(buf);
+    char* p   = end;
+
+    int digits = 8;
+    while (trimZeros && digits > 0 && frac % 10 == 0) {
+        frac /= 10;
+        digits--;
+    }
+    if (digits > 0) {
+        for (int i = 0; i < digits; i++) {
+            *--p = '0' + (frac % 10);
+            frac /= 10;
+        }
+        *--p = '.';
+    }
+
+    do {
+        *--p = '0' + (whole % 10);
+        whole /= 10;
+    } while (whole > 0);
+
+    if (zats < 0)
+        *--p = '-';
+
+    return QString::fromLatin1(p, end - p);
+}
+
+QString Amount::toDecimalZECString() const {
+    return toDecimalString() % " " % Settings::getTokenName();
+}
+
+QString Amount::toDecimalUSDString() const {
+    return Settings::getUSDFormat(toDecimalDouble() * Settings::getInstance()->getZECPrice());
+}
+
+QString Amount::toDecimalZECUSDString() const {
+    auto usdFormat = toDecimalUSDString();
+    if (!usdFormat.isEmpty())
+        return toDecimalZECString() % " (" % usdFormat % ")";
+    else
+        return toDecimalZECString();
+}
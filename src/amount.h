@@ -0,0 +1,52 @@
+#ifndef AMOUNT_H
+#define AMOUNT_H
+
+#include "precompiled.h"
+
+/**
+ * A fixed-point ZER amount, stored as a signed 64-bit count of zatoshis. Balances, UTXOs and Tx
+ * amounts are kept in this type so that summing many notes doesn't accumulate floating point
+ * drift, and formatting doesn't have to round-trip through double -> QString -> double.
+ */
+class Amount {
+public:
+    static const qint64 COIN = 100000000;
+
+    Amount() = default;
+
+    static Amount fromZats(qint64 zats)     { Amount a; a.zats = zats; return a; }
+    static Amount fromDouble(double amt);
+    static Amount fromDecimalString(const QString& amt, bool* ok = nullptr);
+
+    qint64  toZats() const                  { return zats; }
+    double  toDecimalDouble() const         { return (double)zats / COIN; }
+
+    QString toDecimalString() const         { return format(true); }
+    QString toFixedDecimalString() const    { return format(false); }
+    QString toDecimalZECString() const;
+    QString toDecimalUSDString() const;
+    QString toDecimalZECUSDString() const;
+
+    bool    isZero() const                  { return zats == 0; }
+
+    Amount  operator+ (const Amount& o) const   { return fromZats(zats + o.zats); }
+    Amount  operator- (const Amount& o) const   { return fromZats(zats - o.zats); }
+    Amount  operator- () const                  { return fromZats(-zats); }
+    Amount  operator* (qint64 n) const          { return fromZats(zats * n); }
+    Amount& operator+=(const Amount& o)         { zats += o.zats; return *this; }
+    Amount& operator-=(const Amount& o)         { zats -= o.zats; return *this; }
+
+    bool    operator< (const Amount& o) const   { return zats <  o.zats; }
+    bool    operator> (const Amount& o) const   { return zats >  o.zats; }
+    bool    operator<=(const Amount& o) const   { return zats <= o.zats; }
+    bool    operator>=(const Amount& o) const   { return zats >= o.zats; }
+    bool    operator==(const Amount& o) const   { return zats == o.zats; }
+    bool    operator!=(const Amount& o) const   { return zats != o.zats; }
+
+private:
+    QString format(bool trimZeros) const;
+
+    qint64  zats = 0;
+};
+
+#endif // AMOUNT_H
@@ -7,23 +7,20 @@ BalancesOverviewTableModel::BalancesOverviewTableModel(QObject *parent)
     : QAbstractTableModel(parent) {
 }
 
-void BalancesOverviewTableModel::setNewData(const QMap<QString, double>* balances,
-    const QList<UnspentOutput>* outputs)
+void BalancesOverviewTableModel::setNewData(const QMap<QString, Amount>* balances,
+    std::shared_ptr<const UTXOIndex> outputs)
 {
     loading = false;
 
     int currentRows = rowCount(QModelIndex());
-    // Copy over the utxos for our use
-    delete utxos;
-    utxos = new QList<UnspentOutput>();
-    // This is a QList deep copy.
-    *utxos = *outputs;
+    // Share the utxo index with the RPC, it is never modified after it is built
+    utxos = outputs;
 
     // Process the address balances into a list
     delete modeldata;
-    modeldata = new QList<std::tuple<QString, double>>();
+    modeldata = new QList<std::tuple<QString, Amount>>();
     std::for_each(balances->keyBegin(), balances->keyEnd(), [=] (auto keyIt) {
-        if (balances->value(keyIt) > 0)
+        if (balances->value(keyIt) > Amount())
             modeldata->push_back(std::make_tuple(keyIt, balances->value(keyIt)));
     });
 
@@ -37,7 +34,6 @@ void BalancesOverviewTableModel::setNewData(const QMap<QString, double>* balance
 
 BalancesOverviewTableModel::~BalancesOverviewTableModel() {
     delete modeldata;
-    delete utxos;
 }
 
 int BalancesOverviewTableModel::rowCount(const QModelIndex&) const
@@ -70,12 +66,10 @@ QVariant BalancesOverviewTableModel::data(const QModelIndex &index, int role) co
     if (role == Qt::ForegroundRole) {
         // If any of the UTXOs for this address has zero confirmations, paint it in red
         const auto& addr = std::get<0>(modeldata->at(index.row()));
-        for (auto utxo : *utxos) {
-            if (utxo.address == addr && utxo.confirmations == 0) {
-                QBrush b;
-                b.setColor(Qt::red);
-                return b;
-            }
+        if (utxos && utxos->hasUnconfirmed(addr)) {
+            QBrush b;
+            b.setColor(Qt::red);
+            return b;
         }
 
         // Else, just return the default brush
@@ -87,14 +81,14 @@ QVariant BalancesOverviewTableModel::data(const QModelIndex &index, int role) co
     if (role == Qt::DisplayRole) {
         switch (index.column()) {
         case 0: return AddressBook::addLabelToAddress(std::get<0>(modeldata->at(index.row())));
-        case 1: return Settings::getZECDisplayFormat(std::get<1>(modeldata->at(index.row())));
+        case 1: return std::get<1>(modeldata->at(index.row())).toDecimalZECString();
         }
     }
 
     if(role == Qt::ToolTipRole) {
         switch (index.column()) {
         case 0: return AddressBook::addLabelToAddress(std::get<0>(modeldata->at(index.row())));
-        case 1: return Settings::getUSDFromZecAmount(std::get<1>(modeldata->at(index.row())));
+        case 1: return std::get<1>(modeldata->at(index.row())).toDecimalUSDString();
         }
     }
 
@@ -201,10 +195,10 @@ QVariant BalancesTableModel::data(const QModelIndex &index, int role) const
         switch (index.column()) {
             case 0: return AddressBook::addLabelToAddress((modeldata->at(index.row()).address));
             case 1: return modeldata->at(index.row()).watch == 0 ? "True" : "False";
-            case 2: return QString::number(modeldata->at(index.row()).confirmed.toDouble(),'f', 8);
-            case 3: return QString::number(modeldata->at(index.row()).unconfirmed.toDouble(),'f', 8);
-            case 4: return QString::number(modeldata->at(index.row()).immature.toDouble(),'f', 8);
-            case 5: return QString::number(modeldata->at(index.row()).locked.toDouble(),'f', 8);
+            case 2: return modeldata->at(index.row()).confirmed.toFixedDecimalString();
+            case 3: return modeldata->at(index.row()).unconfirmed.toFixedDecimalString();
+            case 4: return modeldata->at(index.row()).immature.toFixedDecimalString();
+            case 5: return modeldata->at(index.row()).locked.toFixedDecimalString();
         }
     }
 
@@ -212,10 +206,10 @@ QVariant BalancesTableModel::data(const QModelIndex &index, int role) const
         switch (index.column()) {
             case 0: return AddressBook::addLabelToAddress((modeldata->at(index.row()).address));
             case 1: return modeldata->at(index.row()).watch == 0 ? "True" : "False";
-            case 2: return QString::number(modeldata->at(index.row()).confirmed.toDouble(),'f', 8);
-            case 3: return QString::number(modeldata->at(index.row()).unconfirmed.toDouble(),'f', 8);
-            case 4: return QString::number(modeldata->at(index.row()).immature.toDouble(),'f', 8);
-            case 5: return QString::number(modeldata->at(index.row()).locked.toDouble(),'f', 8);
+            case 2: return modeldata->at(index.row()).confirmed.toFixedDecimalString();
+            case 3: return modeldata->at(index.row()).unconfirmed.toFixedDecimalString();
+            case 4: return modeldata->at(index.row()).immature.toFixedDecimalString();
+            case 5: return modeldata->at(index.row()).locked.toFixedDecimalString();
 
         }
     }
@@ -2,14 +2,7 @@
 #define BALANCESTABLEMODEL_H
 
 #include "precompiled.h"
-
-struct UnspentOutput {
-    QString address;
-    QString txid;
-    QString amount;
-    int     confirmations;
-    bool    spendable;
-};
+#include "utxoindex.h"
 
 class BalancesOverviewTableModel : public QAbstractTableModel
 {
@@ -17,7 +10,7 @@ public:
     BalancesOverviewTableModel(QObject* parent);
     ~BalancesOverviewTableModel();
 
-    void setNewData(const QMap<QString, double>* balances, const QList<UnspentOutput>* outputs);
+    void setNewData(const QMap<QString, Amount>* balances, std::shared_ptr<const UTXOIndex> outputs);
 
     int rowCount(const QModelIndex &parent) const;
     int columnCount(const QModelIndex &parent) const;
@@ -25,8 +18,8 @@ public:
     QVariant headerData(int section, Qt::Orientation orientation, int role) const;
 
 private:
-    QList<std::tuple<QString, double>>*    modeldata   = nullptr;
-    QList<UnspentOutput>*                  utxos       = nullptr;
+    QList<std::tuple<QString, Amount>>*    modeldata   = nullptr;
+    std::shared_ptr<const UTXOIndex>       utxos;
 
     bool loading = true;
 };
@@ -36,10 +29,10 @@ private:
 
 struct allBalances {
     QString address;
-    QString confirmed;
-    QString unconfirmed;
-    QString immature;
-    QString locked;
+    Amount  confirmed;
+    Amount  unconfirmed;
+    Amount  immature;
+    Amount  locked;
     QString watch;
 };
 
@@ -0,0 +1,551 @@
+#include "bulkpayout.h"
+#include "journaledstore.h"
+#include "mainwindow.h"
+#include "rpc.h"
+#include "settings.h"
+#include "ui_bulkpayout.h"
+#include "ui_mainwindow.h"
+
+BulkPayout* BulkPayout::current = nullptr;
+
+BulkPayout::BulkPayout(MainWindow* main, QString csvFile) {
+    this->main    = main;
+    this->csvFile = csvFile;
+}
+
+bool BulkPayout::load(QString& err) {
+    if (!parseCSV(err))
+        return false;
+
+    makeChunks();
+    readProgress();
+
+    return true;
+}
+
+// Read and validate all the lines of the CSV. Invalid rows are kept, with the error, so they can be shown.
+bool BulkPayout::parseCSV(QString& err) {
+    QFile file(csvFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        err = file.errorString();
+        return false;
+    }
+
+    auto data = file.readAll();
+    file.close();
+
+    // The progress file is only valid for exactly this CSV
+    csvHash = QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex();
+
+    QTextStream in(data);
+    QString line;
+    int lineNumber = 0;
+    bool firstLine = true;
+    while (in.readLineInto(&line)) {
+        lineNumber++;
+        line = line.trimmed();
+        if (line.isEmpty())
+            continue;
+
+        bool maybeHeader = firstLine;
+        firstLine = false;
+
+        // address,amount[,memo]. The memo is everything after the second comma, so it can contain commas.
+        BulkPayoutRow row { lineNumber, "", Amount(), "", "", -1 };
+
+        int addrEnd   = line.indexOf(',');
+        int amountEnd = addrEnd < 0 ? -1 : line.indexOf(',', addrEnd + 1);
+
+        row.addr  = line.left(addrEnd).trimmed();
+        auto amt  = addrEnd < 0 ? QString() : line.mid(addrEnd + 1, amountEnd < 0 ? -1 : amountEnd - addrEnd - 1).trimmed();
+        row.memo  = amountEnd < 0 ? QString() : line.mid(amountEnd + 1).trimmed();
+        if (row.memo.length() >= 2 && row.memo.startsWith('"') && row.memo.endsWith('"'))
+            row.memo = row.memo.mid(1, row.memo.length() - 2).replace("\"\"", "\"");
+
+        bool amountOk = false;
+        row.amount = Amount::fromDecimalString(amt, &amountOk);
+
+        // Skip a header line. Only the first line can be one, any other bad line is reported.
+        if (maybeHeader && !amountOk && !Settings::isValidAddress(row.addr))
+            continue;
+
+        if (addrEnd < 0)
+            row.error = QObject::tr("Expected address,amount[,memo]");
+        else if (!Settings::isValidAddress(row.addr))
+            row.error = QObject::tr("Invalid address");
+        else if (!amountOk)
+            row.error = QObject::tr("Invalid amount");
+        else if (row.amount <= Amount())
+            row.error = QObject::tr("Amount must be more than 0");
+        else if (!row.memo.isEmpty() && !Settings::isZAddress(row.addr))
+            row.error = QObject::tr("Memos can only be sent to z-addresses");
+        else if (row.memo.toUtf8().size() > 512)
+            row.error = QObject::tr("Memo is longer than 512 bytes");
+
+        rows.push_back(row);
+    }
+
+    if (rows.isEmpty()) {
+        err = QObject::tr("No payments were found in the file");
+        return false;
+    }
+
+    return true;
+}
+
+// Group the valid rows into Txs. z_sendmany doesn't allow the same address twice in a Tx, so a repeated
+// address goes into a later chunk.
+void BulkPayout::makeChunks() {
+    chunks.clear();
+
+    QList<int> remaining;
+    for (int i = 0; i < rows.size(); i++) {
+        if (rows[i].error.isEmpty())
+            remaining.push_back(i);
+    }
+
+    while (!remaining.isEmpty()) {
+        BulkPayoutChunk chunk { {}, ChunkNotStarted, "", "", "" };
+        QSet<QString>   addrs;
+        QList<int>      deferred;
+
+        for (int i : remaining) {
+            if (chunk.rows.size() >= Settings::getMaxTxRecipients() || addrs.contains(rows[i].addr)) {
+                deferred.push_back(i);
+                continue;
+            }
+
+            addrs.insert(rows[i].addr);
+            chunk.rows.push_back(i);
+            rows[i].chunk = chunks.size();
+        }
+
+        chunks.push_back(chunk);
+        remaining = deferred;
+    }
+}
+
+// Pick up where a previous run of the same CSV left off
+void BulkPayout::readProgress() {
+    auto store = JournaledStore::forFile(progressFile());
+
+    auto numChunks = QByteArray::number(chunks.size());
+    auto maxRecipients = QByteArray::number(Settings::getMaxTxRecipients());
+    if (store->get("csvhash") != csvHash || store->get("chunks") != numChunks || store->get("maxrecipients") != maxRecipients) {
+        if (store->size() > 0)
+            qDebug() << "Ignoring" << progressFile() << "because it is for a different CSV";
+
+        store->replaceAll({
+            { "csvhash",       csvHash },
+            { "chunks",        numChunks },
+            { "maxrecipients", maxRecipients }
+        });
+        return;
+    }
+
+    fromAddr = QString::fromUtf8(store->get("from"));
+
+    for (int i = 0; i < chunks.size(); i++) {
+        auto j = QJsonDocument::fromJson(store->get("chunk/" % QString::number(i))).object();
+        if (j.isEmpty())
+            continue;
+
+        chunks[i].status = j["status"].toInt();
+        chunks[i].opid   = j["opid"].toString();
+        chunks[i].txid   = j["txid"].toString();
+        chunks[i].err    = j["err"].toString();
+
+        // We don't know if zerod finished sending these, so they need to be checked by hand
+        if (chunks[i].status == ChunkSubmitted) {
+            chunks[i].status = ChunkUnknown;
+            chunks[i].err    = QObject::tr("Was being sent when the wallet was closed. Check the transactions before paying these again.");
+        }
+    }
+}
+
+void BulkPayout::writeProgress(int chunk) {
+    auto& c = chunks[chunk];
+    auto j = QJsonObject{
+        {"status", c.status},
+        {"opid",   c.opid},
+        {"txid",   c.txid},
+        {"err",    c.err}
+    };
+
+    JournaledStore::forFile(progressFile())->put("chunk/" % QString::number(chunk), QJsonDocument(j).toJson(QJsonDocument::Compact));
+}
+
+int BulkPayout::numInvalidRows() const {
+    return std::count_if(rows.begin(), rows.end(), [=] (auto& row) { return !row.error.isEmpty(); });
+}
+
+int BulkPayout::countChunks(int status) const {
+    return std::count_if(chunks.begin(), chunks.end(), [=] (auto& chunk) { return chunk.status == status; });
+}
+
+// Total of the rows in the chunks with this status
+Amount BulkPayout::getTotal(int status) const {
+    Amount total;
+    for (const auto& chunk : chunks) {
+        if (chunk.status != status)
+            continue;
+
+        for (int i : chunk.rows) {
+            total += rows[i].amount;
+        }
+    }
+
+    return total;
+}
+
+void BulkPayout::start(QString fromAddr) {
+    this->fromAddr = fromAddr;
+    JournaledStore::forFile(progressFile())->put("from", fromAddr.toUtf8());
+
+    for (int i = 0; i < chunks.size(); i++) {
+        if (chunks[i].status == ChunkNotStarted && !queue.contains(i))
+            queue.enqueue(i);
+    }
+
+    sendNext();
+}
+
+// Failed chunks were never sent, so they can just be sent again
+void BulkPayout::retryFailed() {
+    for (int i = 0; i < chunks.size(); i++) {
+        if (chunks[i].status != ChunkFailed)
+            continue;
+
+        chunks[i].status = ChunkNotStarted;
+        chunks[i].opid   = "";
+        chunks[i].err    = "";
+        writeProgress(i);
+
+        queue.enqueue(i);
+    }
+
+    if (onChanged)
+        onChanged();
+
+    sendNext();
+}
+
+void BulkPayout::resolveUnknown(bool paid) {
+    for (int i = 0; i < chunks.size(); i++) {
+        if (chunks[i].status != ChunkUnknown)
+            continue;
+
+        chunks[i].status = paid ? ChunkCompleted : ChunkNotStarted;
+        chunks[i].opid   = "";
+        chunks[i].err    = "";
+        writeProgress(i);
+
+        if (!paid)
+            queue.enqueue(i);
+    }
+
+    if (onChanged)
+        onChanged();
+
+    sendNext();
+}
+
+void BulkPayout::sendNext() {
+    while (inFlight < maxInFlight && !queue.isEmpty()) {
+        int i = queue.dequeue();
+        if (chunks[i].status != ChunkNotStarted)
+            continue;
+
+        Tx tx;
+        tx.fromAddr = fromAddr;
+        tx.fee      = Settings::getMinerFee();
+        for (int r : chunks[i].rows) {
+            const auto& row = rows[r];
+            tx.toAddrs.append(ToFields { row.addr, row.amount, row.memo, row.memo.toUtf8().toHex() });
+        }
+
+        // Record that it's being sent before sending it. If the wallet is closed before we hear back,
+        // it will show up as unknown instead of being sent again.
+        chunks[i].status = ChunkSubmitted;
+        writeProgress(i);
+        inFlight++;
+
+        main->getRPC()->executeTransaction(tx,
+            [=] (QString opid) {
+                chunks[i].opid = opid;
+                writeProgress(i);
+
+                main->ui->statusBar->showMessage(QObject::tr("Computing bulk payout Tx %1 of %2: %3")
+                                                    .arg(i + 1).arg(chunks.size()).arg(opid));
+            },
+            [=] (QString /*opid*/, QString txid) {
+                chunkDone(i, ChunkCompleted, txid, "");
+            },
+            [=] (QString /*opid*/, QString errStr) {
+                chunkDone(i, ChunkFailed, "", errStr);
+            },
+            BackgroundTxPriority,
+            // zerod forgot about it, so it might have been paid. It has to be checked by hand, not retried.
+            [=] (QString /*opid*/, QString errStr) {
+                chunkDone(i, ChunkUnknown, "", errStr);
+            });
+    }
+
+    if (onChanged)
+        onChanged();
+}
+
+void BulkPayout::chunkDone(int chunk, int status, QString txid, QString err) {
+    chunks[chunk].status = status;
+    chunks[chunk].txid   = txid;
+    chunks[chunk].err    = err;
+    writeProgress(chunk);
+
+    inFlight--;
+    sendNext();
+
+    if (!isRunning()) {
+        main->ui->statusBar->showMessage(QObject::tr("Bulk payout finished. %1 of %2 transactions sent")
+                                            .arg(countChunks(ChunkCompleted)).arg(chunks.size()), 15 * 1000);
+    }
+}
+
+void BulkPayout::showDialog(MainWindow* parent) {
+    QDialog d(parent);
+    Ui_BulkPayoutDialog ui;
+    ui.setupUi(&d);
+    Settings::saveRestore(&d);
+    Settings::saveRestoreTableHeader(ui.tblRows, &d, "bulkpayouttable");
+
+    ui.cmbFrom->setAddressFilter(AddressFilterProxyModel::FundedAddresses);
+
+    auto model = new BulkPayoutTableModel(ui.tblRows, current);
+    ui.tblRows->setModel(model);
+
+    auto fnUpdate = [&] () {
+        model->refresh();
+
+        if (current == nullptr) {
+            ui.lblFile->setText(QObject::tr("No file loaded"));
+            ui.lblSummary->clear();
+            ui.progressBar->setValue(0);
+            ui.btnStart->setEnabled(false);
+            ui.btnRetry->setEnabled(false);
+            ui.btnResolve->setEnabled(false);
+            return;
+        }
+
+        auto numChunks = current->getChunks().size();
+        auto done      = current->countChunks(ChunkCompleted);
+        auto failed    = current->countChunks(ChunkFailed);
+        auto unknown   = current->countChunks(ChunkUnknown);
+
+        ui.lblFile->setText(current->csvFile);
+
+        QString summary = QObject::tr("%1 payments in %2 transactions. %3 sent, %4 failed.")
+                            .arg(current->getRows().size()).arg(numChunks).arg(done).arg(failed);
+        if (current->numInvalidRows() > 0)
+            summary = summary % " " % QObject::tr("%1 invalid rows need to be fixed.").arg(current->numInvalidRows());
+        if (unknown > 0)
+            summary = summary % " " % QObject::tr("%1 transactions were interrupted.").arg(unknown);
+        ui.lblSummary->setText(summary);
+
+        ui.progressBar->setMaximum(std::max(1, numChunks));
+        ui.progressBar->setValue(done);
+
+        ui.btnStart->setEnabled(!current->isRunning() && current->numInvalidRows() == 0 &&
+                                current->countChunks(ChunkNotStarted) > 0);
+        ui.btnRetry->setEnabled(failed > 0);
+        ui.btnResolve->setEnabled(unknown > 0);
+    };
+
+    if (current != nullptr) {
+        if (!current->fromAddr.isEmpty())
+            ui.cmbFrom->setCurrentText(current->fromAddr);
+        current->setOnChanged(fnUpdate);
+    }
+    fnUpdate();
+
+    // Open a CSV
+    QObject::connect(ui.btnOpen, &QPushButton::clicked, [&] () {
+        if (current != nullptr && current->isRunning()) {
+            QMessageBox::information(&d, QObject::tr("Bulk payout in progress"),
+                QObject::tr("Please wait for the current payout to finish before opening another file."));
+            return;
+        }
+
+        auto fileName = QFileDialog::getOpenFileUrl(&d, QObject::tr("Open Payout CSV"), QUrl(),
+            "CSV file (*.csv)");
+        if (fileName.isEmpty())
+            return;
+
+        auto payout = new BulkPayout(parent, fileName.toLocalFile());
+        QString err;
+        if (!payout->load(err)) {
+            QMessageBox::critical(&d, QObject::tr("Unable to load payouts"), err);
+            delete payout;
+            return;
+        }
+
+        delete current;
+        current = payout;
+        current->setOnChanged(fnUpdate);
+        model->setPayout(current);
+
+        if (!current->fromAddr.isEmpty())
+            ui.cmbFrom->setCurrentText(current->fromAddr);
+        fnUpdate();
+    });
+
+    // Start sending
+    QObject::connect(ui.btnStart, &QPushButton::clicked, [&] () {
+        if (current == nullptr)
+            return;
+
+        auto from = ui.cmbFrom->currentText();
+        if (!Settings::isValidAddress(from)) {
+            QMessageBox::critical(&d, QObject::tr("Bulk payout"), QObject::tr("Please pick an address to pay from."));
+            return;
+        }
+
+        // Check that there's enough to pay the chunks that will be sent, including the fee for each Tx
+        auto numTxns = current->countChunks(ChunkNotStarted);
+        auto total   = current->getTotal(ChunkNotStarted) + Settings::getMinerFee() * numTxns;
+        auto balance = parent->getRPC()->getAllBalances() ? parent->getRPC()->getAllBalances()->value(from) : Amount();
+        if (balance < total) {
+            QMessageBox::critical(&d, QObject::tr("Not enough balance"),
+                QObject::tr("The payout needs %1 (including fees), but %2 only has %3.")
+                    .arg(total.toDecimalZECString(), from, balance.toDecimalZECString()));
+            return;
+        }
+
+        if (QMessageBox::question(&d, QObject::tr("Start bulk payout"),
+                QObject::tr("Send %1 in %2 transactions from %3?")
+                    .arg(total.toDecimalZECString()).arg(numTxns).arg(from)) != QMessageBox::Yes)
+            return;
+
+        current->start(from);
+    });
+
+    // Retry the failed chunks
+    QObject::connect(ui.btnRetry, &QPushButton::clicked, [&] () {
+        if (current != nullptr)
+            current->retryFailed();
+    });
+
+    // The user has checked the transactions that were interrupted, and tells us whether they went through
+    QObject::connect(ui.btnResolve, &QPushButton::clicked, [&] () {
+        if (current == nullptr)
+            return;
+
+        auto unknown = current->countChunks(ChunkUnknown);
+        QMessageBox msg(QMessageBox::Question, QObject::tr("Resolve interrupted transactions"),
+            QObject::tr("%1 transactions were being sent when the wallet was closed, or zerod lost track of them. "
+                        "Please check the transactions tab to see if they were sent.\n\n"
+                        "If they were, mark them as paid. If they weren't, they can be sent again.").arg(unknown),
+            QMessageBox::Cancel, &d);
+        auto btnPaid  = msg.addButton(QObject::tr("Mark as Paid"), QMessageBox::AcceptRole);
+        auto btnSend  = msg.addButton(QObject::tr("Send Again"), QMessageBox::DestructiveRole);
+        msg.exec();
+
+        if (msg.clickedButton() == btnPaid) {
+            current->resolveUnknown(true);
+        } else if (msg.clickedButton() == btnSend) {
+            if (QMessageBox::warning(&d, QObject::tr("Send again"),
+                    QObject::tr("If these transactions were already sent, the recipients will be paid twice. Send them again?"),
+                    QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes)
+                current->resolveUnknown(false);
+        }
+    });
+
+    d.exec();
+
+    // Keep sending after the dialog is closed, but there's nothing to update anymore
+    if (current != nullptr)
+        current->setOnChanged(nullptr);
+}
+
+
+BulkPayoutTableModel::BulkPayoutTableModel(QTableView* parent, BulkPayout* payout)
+    : QAbstractTableModel(parent) {
+    headers << tr("Line") << tr("Address") << tr("Amount") << tr("Memo") << tr("Status");
+    this->payout = payout;
+}
+
+void BulkPayoutTableModel::setPayout(BulkPayout* payout) {
+    beginResetModel();
+    this->payout = payout;
+    endResetModel();
+}
+
+// Only the status column changes once a CSV is loaded
+void BulkPayoutTableModel::refresh() {
+    if (rowCount(QModelIndex()) > 0)
+        dataChanged(index(0, 4), index(rowCount(QModelIndex()) - 1, 4));
+}
+
+int BulkPayoutTableModel::rowCount(const QModelIndex&) const {
+    if (payout == nullptr) return 0;
+    return payout->getRows().size();
+}
+
+int BulkPayoutTableModel::columnCount(const QModelIndex&) const {
+    return headers.size();
+}
+
+QVariant BulkPayoutTableModel::data(const QModelIndex &index, int role) const {
+    if (payout == nullptr)
+        return QVariant();
+
+    const auto& row = payout->getRows().at(index.row());
+
+    if (role == Qt::TextAlignmentRole && index.column() == 2) return QVariant(Qt::AlignRight | Qt::AlignVCenter);
+
+    if (role == Qt::ForegroundRole && index.column() == 4) {
+        if (!row.error.isEmpty())
+            return QVariant(QColor(Qt::red));
+
+        auto status = payout->getChunks().at(row.chunk).status;
+        if (status == ChunkFailed || status == ChunkUnknown)
+            return QVariant(QColor(Qt::red));
+        if (status == ChunkCompleted)
+            return QVariant(QColor(Qt::darkGreen));
+    }
+
+    if (role == Qt::DisplayRole || role == Qt::ToolTipRole) {
+        switch (index.column()) {
+        case 0: return row.line;
+        case 1: return row.addr;
+        case 2: return row.amount.toDecimalString();
+        case 3: return row.memo;
+        case 4: {
+                if (!row.error.isEmpty())
+                    return row.error;
+
+                const auto& chunk = payout->getChunks().at(row.chunk);
+                auto tx = tr("Tx %1").arg(row.chunk + 1) % ": ";
+                switch (chunk.status) {
+                case ChunkNotStarted: return tx % tr("Not sent");
+                case ChunkSubmitted:  return tx % tr("Computing");
+                case ChunkCompleted:  return tx % (chunk.txid.isEmpty() ? tr("Marked as paid") : QString(tr("Sent") % " " % chunk.txid));
+                case ChunkFailed:     return tx % tr("Failed") % " " % chunk.err;
+                case ChunkUnknown:    return tx % tr("Unknown") % " " % chunk.err;
+                }
+            }
+        }
+    }
+
+    return QVariant();
+}
+
+QVariant BulkPayoutTableModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (role == Qt::TextAlignmentRole && section == 2) {
+        return QVariant(Qt::AlignRight | Qt::AlignVCenter);
+    }
+
+    if (role == Qt::DisplayRole && orientation == Qt::Horizontal) {
+        return headers.at(section);
+    }
+
+    return QVariant();
+}
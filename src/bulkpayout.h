@@ -0,0 +1,122 @@
+#ifndef BULKPAYOUT_H
+#define BULKPAYOUT_H
+
+#include "precompiled.h"
+#include "amount.h"
+
+class MainWindow;
+class BulkPayoutTableModel;
+
+// A line of the imported CSV
+struct BulkPayoutRow {
+    int         line;
+    QString     addr;
+    Amount      amount;
+    QString     memo;
+    QString     error;      // Why the row is invalid, empty if it is valid
+    int         chunk;      // Which chunk (Tx) the row is paid in, -1 if invalid
+};
+
+enum BulkPayoutChunkStatus {
+    ChunkNotStarted = 0,
+    ChunkSubmitted,         // Handed to zerod, waiting for the operation to finish
+    ChunkCompleted,
+    ChunkFailed,            // The operation failed, so nothing was sent. Safe to retry.
+    ChunkUnknown            // Was submitted when the wallet closed, or zerod lost track of it, so it may or may not
+                            // have been sent
+};
+
+// A group of rows that are paid with a single multi-recipient Tx
+struct BulkPayoutChunk {
+    QList<int>  rows;
+    int         status;
+    QString     opid;
+    QString     txid;
+    QString     err;
+};
+
+/**
+ * Pays a CSV of address,amount[,memo] lines. The rows are validated locally, split into chunks of at most
+ * Settings::getMaxTxRecipients() recipients, and each chunk is sent as one Tx, with a bounded number of
+ * chunks being computed by zerod at any time.
+ *
+ * The status of every chunk is saved to "<csv>.progress" (a JournaledStore) as it changes, so a payout that was
+ * interrupted can be resumed by opening the same CSV again. Chunks that completed are never sent again, and chunks
+ * that were in flight when the wallet closed (or that zerod lost track of) are not retried automatically, so no one
+ * gets paid twice.
+ */
+class BulkPayout
+{
+public:
+    static void showDialog(MainWindow* parent);
+
+    BulkPayout(MainWindow* main, QString csvFile);
+
+    bool        load(QString& err);
+
+    void        start(QString fromAddr);
+    void        retryFailed();
+    // Interrupted chunks were checked by hand. Either they were paid, or they can be sent again.
+    void        resolveUnknown(bool paid);
+    bool        isRunning() const { return inFlight > 0 || !queue.isEmpty(); }
+
+    const QList<BulkPayoutRow>&     getRows()   const { return rows; }
+    const QList<BulkPayoutChunk>&   getChunks() const { return chunks; }
+
+    int         numInvalidRows() const;
+    int         countChunks(int status) const;
+    Amount      getTotal(int status) const;
+
+    // Called whenever the status of a chunk changes
+    void        setOnChanged(std::function<void(void)> cb) { onChanged = cb; }
+
+private:
+    bool        parseCSV(QString& err);
+    void        makeChunks();
+    void        readProgress();
+    void        writeProgress(int chunk);
+    QString     progressFile() const { return csvFile % ".progress"; }
+
+    void        sendNext();
+    void        chunkDone(int chunk, int status, QString txid, QString err);
+
+    static const int maxInFlight = 2;   // Chunks being computed by zerod at the same time
+
+    MainWindow*             main;
+    QString                 csvFile;
+    QByteArray              csvHash;
+    QString                 fromAddr;
+
+    QList<BulkPayoutRow>    rows;
+    QList<BulkPayoutChunk>  chunks;
+
+    QQueue<int>             queue;          // Chunks waiting to be sent
+    int                     inFlight = 0;
+
+    std::function<void(void)> onChanged;
+
+    // The payout that is currently loaded. It stays around after the dialog is closed, so that
+    // chunks still being sent can finish.
+    static BulkPayout*      current;
+};
+
+class BulkPayoutTableModel : public QAbstractTableModel {
+
+public:
+    BulkPayoutTableModel(QTableView* parent, BulkPayout* payout);
+    ~BulkPayoutTableModel() = default;
+
+    void     setPayout(BulkPayout* payout);
+    void     refresh();
+
+    int      rowCount(const QModelIndex &parent) const;
+    int      columnCount(const QModelIndex &parent) const;
+    QVariant data(const QModelIndex &index, int role) const;
+    QVariant headerData(int section, Qt::Orientation orientation, int role) const;
+
+private:
+    BulkPayout* payout;
+    QStringList headers;
+};
+
+#endif // BULKPAYOUT_H
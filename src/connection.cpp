@@ -4,6 +4,7 @@
 #include "ui_connection.h"
 #include "ui_createzcashconfdialog.h"
 #include "rpc.h"
+#include "trace.h"
 
 #include "precompiled.h"
 
@@ -26,6 +27,7 @@ ConnectionLoader::~ConnectionLoader() {
 }
 
 void ConnectionLoader::loadConnection() {
+    traceStart = Trace::now();
     QTimer::singleShot(1, [=]() { this->doAutoConnect(); });
     if (!Settings::getInstance()->isHeadless())
         d->exec();
@@ -33,13 +35,22 @@ void ConnectionLoader::loadConnection() {
 
 void ConnectionLoader::doAutoConnect(bool tryEzcashdStart) {
     // Priority 1: Ensure all params are present.
-    if (!verifyParams()) {
+    bool haveParams;
+    {
+        TraceSpan span("Verify params");
+        haveParams = verifyParams();
+    }
+    if (!haveParams) {
         downloadParams([=]() { this->doAutoConnect(); });
         return;
     }
 
     // Priority 2: Try to connect to detect zero.conf and connect to it.
-    auto config = autoDetectZcashConf();
+    std::shared_ptr<ConnectionConfig> config;
+    {
+        TraceSpan span("Detect zero.conf");
+        config = autoDetectZcashConf();
+    }
     main->logger->write(QObject::tr("Attempting autoconnect"));
 
     if (config.get() != nullptr) {
@@ -337,6 +348,8 @@ bool ConnectionLoader::startEmbeddedZcashd() {
     if (!Settings::getInstance()->useEmbedded())
         return false;
 
+    TraceSpan span("Start embedded zerod");
+
     main->logger->write("Trying to start embedded zerod");
 
     // Static because it needs to survive even after this method returns.
@@ -435,6 +448,8 @@ void ConnectionLoader::doManualConnect() {
 }
 
 void ConnectionLoader::doRPCSetConnection(Connection* conn) {
+    Trace::since("Connect to zerod", traceStart);
+
     rpc->setEZcashd(ezcashd);
     rpc->setConnection(conn);
 
@@ -751,10 +766,18 @@ void Connection::doRPC(const json& payload, const std::function<void(json)>& cb,
     qDebug() << "RPC: " << QString::fromStdString(payload["method"]);
     qDebug() << "< payload " << QString::fromStdString(payload.dump());
 
+    QString traceName;
+    qint64  traceStart = 0;
+    if (Trace::isEnabled()) {
+        traceName  = "RPC " % QString::fromStdString(payload["method"]);
+        traceStart = Trace::now();
+    }
+
     QNetworkReply *reply = restclient->post(*request, QByteArray::fromStdString(payload.dump()));
 
     QObject::connect(reply, &QNetworkReply::finished, [=] {
         reply->deleteLater();
+        Trace::since(traceName, traceStart);
         if (shutdownInProgress) {
             // Ignoring callback because shutdown in progress
             return;
@@ -78,6 +78,8 @@ private:
     QDialog*                d;
     Ui_ConnectionDialog*    connD;
 
+    qint64                  traceStart = 0;     // When loadConnection() was called, for the trace
+
     MainWindow*             main;
     RPC*                    rpc;
 
@@ -11,15 +11,150 @@ GlobalZNTableModel::GlobalZNTableModel(QObject *parent)
 
 GlobalZNTableModel::~GlobalZNTableModel() {
     delete modeldata;
-    delete znData;
 }
 
+// Local nodes first, then by rank. The txid breaks ties so the order is stable across refreshes.
+bool GlobalZNTableModel::lessThan(const GlobalZeroNodes& a, const GlobalZeroNodes& b) {
+    if (a.local != b.local)
+        return a.local > b.local;
+
+    if (a.rank != b.rank)
+        return a.rank < b.rank;
+
+    return a.txid < b.txid;
+}
+
+bool GlobalZNTableModel::sameData(const GlobalZeroNodes& a, const GlobalZeroNodes& b) {
+    return a.rank      == b.rank      && a.address  == b.address  && a.version  == b.version  &&
+           a.status    == b.status    && a.active   == b.active   && a.lastSeen == b.lastSeen &&
+           a.lastPaid  == b.lastPaid  && a.ipAddress == b.ipAddress && a.local  == b.local;
+}
+
+QString GlobalZNTableModel::formatTime(qint64 secs) {
+    return QDateTime::fromSecsSinceEpoch(secs).toString("MM/dd/yyyy hh:mm");
+}
+
+/**
+ * Diff the new zeronode list against the one we're showing, keyed by txhash. Nodes that dropped off
+ * are removed, changed nodes are updated in place and new nodes are inserted at their sorted position,
+ * each with row-level signals, so a refresh where little changed costs little.
+ */
 void GlobalZNTableModel::addGlobalZNData(const QList<GlobalZeroNodes>& data) {
-    delete znData;
-    znData = new QList<GlobalZeroNodes>();
-    std::copy(data.begin(), data.end(), std::back_inserter(*znData));
+    // When the number of rows to move or insert is above this, it's cheaper to append them
+    // and re-sort the whole list once.
+    const int maxIncrementalRows = 64;
+
+    if (modeldata == nullptr || modeldata->isEmpty()) {
+        beginResetModel();
+        delete modeldata;
+        modeldata = new QList<GlobalZeroNodes>(data);
+        std::sort(modeldata->begin(), modeldata->end(), lessThan);
+        endResetModel();
+        return;
+    }
+
+    QHash<QString, int> incoming;
+    incoming.reserve(data.size());
+    for (int i = 0; i < data.size(); i++) {
+        incoming.insert(data[i].txid, i);
+    }
+
+    // 1. Remove nodes that are no longer in the list
+    removeRowRuns([&] (const GlobalZeroNodes& n) { return !incoming.contains(n.txid); });
 
-    updateAllZNData();
+    // 2. Update the remaining nodes in place, and remember the ones whose sort key changed
+    QSet<QString>   seen;
+    QSet<QString>   rekeyed;
+    QList<int>      changedRows;
+    for (int row = 0; row < modeldata->size(); row++) {
+        auto& current = (*modeldata)[row];
+        const auto& updated = data[incoming.value(current.txid)];
+        seen.insert(current.txid);
+
+        if (sameData(current, updated))
+            continue;
+
+        if (current.local != updated.local || current.rank != updated.rank)
+            rekeyed.insert(current.txid);
+
+        current = updated;
+        changedRows.push_back(row);
+    }
+    emitChangedRuns(changedRows);
+
+    // 3. Gather the new nodes
+    QList<GlobalZeroNodes> toInsert;
+    for (const auto& n : data) {
+        if (!seen.contains(n.txid))
+            toInsert.push_back(n);
+    }
+
+    // 4. Put everything back in sorted order. Rows whose key didn't change are still in order
+    //    relative to each other, so only the re-keyed and new rows need to be placed.
+    bool sorted = rekeyed.isEmpty() || std::is_sorted(modeldata->begin(), modeldata->end(), lessThan);
+    if (!sorted && rekeyed.size() + toInsert.size() > maxIncrementalRows) {
+        if (!toInsert.isEmpty()) {
+            beginInsertRows(QModelIndex(), modeldata->size(), modeldata->size() + toInsert.size() - 1);
+            modeldata->append(toInsert);
+            endInsertRows();
+            toInsert.clear();
+        }
+        sortAllZNData();
+    } else {
+        if (!sorted) {
+            for (const auto& n : *modeldata) {
+                if (rekeyed.contains(n.txid))
+                    toInsert.push_back(n);
+            }
+            removeRowRuns([&] (const GlobalZeroNodes& n) { return rekeyed.contains(n.txid); });
+        }
+
+        if (toInsert.size() > maxIncrementalRows) {
+            beginInsertRows(QModelIndex(), modeldata->size(), modeldata->size() + toInsert.size() - 1);
+            modeldata->append(toInsert);
+            endInsertRows();
+            sortAllZNData();
+        } else {
+            for (const auto& n : toInsert) {
+                int row = std::lower_bound(modeldata->begin(), modeldata->end(), n, lessThan) - modeldata->begin();
+                beginInsertRows(QModelIndex(), row, row);
+                modeldata->insert(row, n);
+                endInsertRows();
+            }
+        }
+    }
+}
+
+// Remove all the rows matching shouldRemove, one beginRemoveRows() per contiguous run, bottom up.
+void GlobalZNTableModel::removeRowRuns(const std::function<bool(const GlobalZeroNodes&)>& shouldRemove) {
+    for (int row = modeldata->size() - 1; row >= 0; ) {
+        if (!shouldRemove(modeldata->at(row))) {
+            row--;
+            continue;
+        }
+
+        int last = row;
+        while (row >= 0 && shouldRemove(modeldata->at(row))) {
+            row--;
+        }
+
+        beginRemoveRows(QModelIndex(), row + 1, last);
+        modeldata->erase(modeldata->begin() + row + 1, modeldata->begin() + last + 1);
+        endRemoveRows();
+    }
+}
+
+// Emit one dataChanged() per contiguous run of changed rows
+void GlobalZNTableModel::emitChangedRuns(const QList<int>& sortedRows) {
+    for (int i = 0; i < sortedRows.size(); ) {
+        int first = sortedRows[i];
+        int last  = first;
+        while (++i < sortedRows.size() && sortedRows[i] == last + 1) {
+            last++;
+        }
+
+        dataChanged(index(first, 0), index(last, columnCount(QModelIndex()) - 1));
+    }
 }
 
 // bool TxTableModel::exportToCsv(QString fileName) const {
@@ -53,24 +188,28 @@ void GlobalZNTableModel::addGlobalZNData(const QList<GlobalZeroNodes>& data) {
 //     return true;
 // }
 
-void GlobalZNTableModel::updateAllZNData() {
-    auto newmodeldata = new QList<GlobalZeroNodes>();
-
-    if (znData != nullptr) std::copy(znData->begin(), znData->end(), std::back_inserter(*newmodeldata));
+// Re-sort the whole list, keeping the persistent indexes (selection, current row) on the same nodes
+void GlobalZNTableModel::sortAllZNData() {
+    layoutAboutToBeChanged();
 
-    // Sort by reverse time
-    std::sort(newmodeldata->begin(), newmodeldata->end(), [=] (auto a, auto b) {
-        if (a.local != b.local)
-          return a.local > b.local;
+    auto persistent = persistentIndexList();
+    QList<QString> persistentTxids;
+    for (const auto& idx : persistent) {
+        persistentTxids.push_back(modeldata->at(idx.row()).txid);
+    }
 
-        return a.rank < b.rank; // reverse sort
-    });
+    std::sort(modeldata->begin(), modeldata->end(), lessThan);
 
-    // And then swap out the modeldata with the new one.
-    delete modeldata;
-    modeldata = newmodeldata;
+    if (!persistent.isEmpty()) {
+        QHash<QString, int> rows;
+        for (int row = 0; row < modeldata->size(); row++) {
+            rows.insert(modeldata->at(row).txid, row);
+        }
+        for (int i = 0; i < persistent.size(); i++) {
+            changePersistentIndex(persistent[i], index(rows.value(persistentTxids[i]), persistent[i].column()));
+        }
+    }
 
-    dataChanged(index(0, 0), index(modeldata->size()-1, columnCount(index(0,0))-1));
     layoutChanged();
 }
 
@@ -92,7 +231,7 @@ void GlobalZNTableModel::updateAllZNData() {
     if (role == Qt::TextAlignmentRole)
         return QVariant(Qt::AlignVCenter);
 
-    auto dat = modeldata->at(index.row());
+    const auto& dat = modeldata->at(index.row());
     if (role == Qt::ForegroundRole) {
         // if (dat.confirmations <= 0) {
         //     QBrush b;
@@ -107,18 +246,14 @@ void GlobalZNTableModel::updateAllZNData() {
     }
 
     if (role == Qt::DisplayRole) {
-
-        QDateTime myDateTime;
-
-
         switch (index.column()) {
         case 0: return dat.rank;
         case 1: return dat.address;
         case 2: return dat.version;
         case 3: return dat.status;
         case 4: return convertSecondsToDays(dat.active);
-        case 5: return dat.lastSeen;
-        case 6: return dat.lastPaid;
+        case 5: return formatTime(dat.lastSeen);
+        case 6: return formatTime(dat.lastPaid);
         case 7: return dat.txid;
         case 8: return dat.ipAddress;
         }
@@ -209,11 +344,11 @@ qint64 GlobalZNTableModel::getGZNActive(int row) const {
 }
 
 QString GlobalZNTableModel::getGZNLastSeen(int row) const {
-    return modeldata->at(row).lastSeen;
+    return formatTime(modeldata->at(row).lastSeen);
 }
 
 QString GlobalZNTableModel::getGZNLastPaid(int row) const {
-    return modeldata->at(row).lastPaid;
+    return formatTime(modeldata->at(row).lastPaid);
 }
 
 QString GlobalZNTableModel::getGZNTxid(int row) const {
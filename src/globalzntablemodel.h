@@ -29,10 +29,15 @@ public:
     QVariant headerData(int section, Qt::Orientation orientation, int role) const;
 
 private:
-    void updateAllZNData();
+    static bool    lessThan(const GlobalZeroNodes& a, const GlobalZeroNodes& b);
+    static bool    sameData(const GlobalZeroNodes& a, const GlobalZeroNodes& b);
+    static QString formatTime(qint64 secs);
 
-    QList<GlobalZeroNodes>*   znData        = nullptr;
+    void removeRowRuns(const std::function<bool(const GlobalZeroNodes&)>& shouldRemove);
+    void emitChangedRuns(const QList<int>& sortedRows);
+    void sortAllZNData();
 
+    // Sorted by (local, rank). Updated incrementally from each new snapshot, keyed by txhash.
     QList<GlobalZeroNodes>*   modeldata     = nullptr;
 
     QList<QString>            headers;
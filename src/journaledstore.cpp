@@ -0,0 +1,261 @@
+#include "journaledstore.h"
+
+// Every snapshot starts with this. Anything else is a file from before the journaled store.
+static const QByteArray storeMagic("ZWSTORE1");
+
+QHash<QString, JournaledStore*> JournaledStore::stores;
+
+JournaledStore* JournaledStore::forFile(const QString& fileName) {
+    auto it = stores.constFind(fileName);
+    if (it != stores.constEnd())
+        return it.value();
+
+    auto store = new JournaledStore(fileName);
+    store->load();
+    stores.insert(fileName, store);
+
+    return store;
+}
+
+JournaledStore::JournaledStore(const QString& fileName) {
+    this->fileName = fileName;
+    journal.setFileName(fileName % ".journal");
+}
+
+// Standard CRC-32 (the one zip uses)
+quint32 JournaledStore::crc32(const QByteArray& data) {
+    static quint32 table[256];
+    static bool    tableReady = false;
+    if (!tableReady) {
+        for (quint32 i = 0; i < 256; i++) {
+            quint32 c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        tableReady = true;
+    }
+
+    quint32 crc = 0xFFFFFFFFu;
+    for (auto b : data) {
+        crc = table[(crc ^ (quint8)b) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// A record is [length][crc32 of payload][payload], and the payload is the op and its arguments
+QByteArray JournaledStore::encodeRecord(Op op, const QString& key, const QByteArray& value, const QString& newKey) {
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << (quint8)op << key << value << newKey;
+
+    QByteArray record;
+    QDataStream header(&record, QIODevice::WriteOnly);
+    header << (quint32)payload.size() << crc32(payload);
+
+    return record + payload;
+}
+
+void JournaledStore::load() {
+    QFile file(fileName);
+    if (file.open(QIODevice::ReadOnly)) {
+        auto data = file.readAll();
+        file.close();
+
+        if (!data.isEmpty()) {
+            if (!data.startsWith(storeMagic)) {
+                legacy = true;
+                return;
+            }
+
+            replay(data, storeMagic.size());
+            snapshotSize = data.size();
+        }
+    }
+
+    if (journal.open(QIODevice::ReadOnly)) {
+        auto data = journal.readAll();
+        journal.close();
+
+        // If the last write was cut short, write out what we have, which also gets rid of the bad record
+        if (!replay(data, 0)) {
+            qDebug() << "Dropping the incomplete end of" << journal.fileName();
+            compact();
+        }
+    }
+}
+
+// Apply all the records in data, starting at offset. Returns false if a record was truncated or corrupt,
+// in which case everything after it is ignored.
+bool JournaledStore::replay(const QByteArray& data, int offset) {
+    while (offset < data.size()) {
+        if (data.size() - offset < 8)
+            return false;
+
+        quint32 len, crc;
+        QDataStream header(data.mid(offset, 8));
+        header >> len >> crc;
+
+        if (len > (quint32)(data.size() - offset - 8))
+            return false;
+
+        auto payload = data.mid(offset + 8, len);
+        if (crc32(payload) != crc)
+            return false;
+
+        quint8      op;
+        QString     key, newKey;
+        QByteArray  value;
+        QDataStream in(payload);
+        in.setVersion(QDataStream::Qt_5_0);
+        in >> op >> key >> value >> newKey;
+        if (in.status() != QDataStream::Ok)
+            return false;
+
+        apply((Op)op, key, value, newKey);
+        offset += 8 + len;
+    }
+
+    return true;
+}
+
+void JournaledStore::apply(Op op, const QString& key, const QByteArray& value, const QString& newKey) {
+    switch (op) {
+    case Op::Put: {
+            auto it = entries.find(key);
+            if (it != entries.end()) {
+                it->value = value;
+            } else {
+                entries.insert(key, Entry{ nextSeq, value });
+                order.insert(nextSeq, key);
+                nextSeq++;
+            }
+        }
+        break;
+    case Op::Remove: {
+            auto it = entries.find(key);
+            if (it != entries.end()) {
+                order.remove(it->seq);
+                entries.erase(it);
+            }
+        }
+        break;
+    case Op::Rename: {
+            if (key == newKey || !entries.contains(key)) {
+                apply(Op::Put, newKey, value, QString());
+                break;
+            }
+
+            apply(Op::Remove, newKey, QByteArray(), QString());
+
+            auto seq = entries.value(key).seq;
+            entries.remove(key);
+            entries.insert(newKey, Entry{ seq, value });
+            order.insert(seq, newKey);
+        }
+        break;
+    }
+}
+
+QList<QPair<QString, QByteArray>> JournaledStore::getAll() const {
+    QList<QPair<QString, QByteArray>> all;
+    all.reserve(order.size());
+
+    for (const auto& key : order) {
+        all.push_back(QPair<QString, QByteArray>(key, entries.value(key).value));
+    }
+
+    return all;
+}
+
+void JournaledStore::put(const QString& key, const QByteArray& value) {
+    auto it = entries.constFind(key);
+    if (it != entries.constEnd() && it->value == value)
+        return;
+
+    apply(Op::Put, key, value, QString());
+    append(encodeRecord(Op::Put, key, value));
+}
+
+void JournaledStore::remove(const QString& key) {
+    if (!entries.contains(key))
+        return;
+
+    apply(Op::Remove, key, QByteArray(), QString());
+    append(encodeRecord(Op::Remove, key, QByteArray()));
+}
+
+void JournaledStore::rename(const QString& oldKey, const QString& newKey, const QByteArray& value) {
+    apply(Op::Rename, oldKey, value, newKey);
+    append(encodeRecord(Op::Rename, oldKey, value, newKey));
+}
+
+void JournaledStore::replaceAll(const QList<QPair<QString, QByteArray>>& all) {
+    entries.clear();
+    order.clear();
+
+    for (const auto& i : all) {
+        apply(Op::Put, i.first, i.second, QString());
+    }
+
+    compact();
+}
+
+void JournaledStore::removeFiles() {
+    entries.clear();
+    order.clear();
+
+    journal.remove();
+    QFile(fileName).remove();
+
+    snapshotSize = 0;
+    legacy       = false;
+}
+
+void JournaledStore::append(const QByteArray& record) {
+    if (!journal.isOpen() && !journal.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qDebug() << "Couldn't open" << journal.fileName() << "for writing";
+        return;
+    }
+
+    journal.write(record);
+    journal.flush();
+
+    // Compact once the journal has grown past the snapshot. Done from the event loop, so that
+    // a batch of changes made together only gets compacted once.
+    if (!compactionScheduled && journal.size() > std::max((qint64)64 * 1024, snapshotSize)) {
+        compactionScheduled = true;
+        QTimer::singleShot(0, [=] () { compact(); });
+    }
+}
+
+// Write everything to a new snapshot, atomically replace the old one, and start a new journal
+void JournaledStore::compact() {
+    compactionScheduled = false;
+
+    QByteArray data(storeMagic);
+    for (const auto& key : order) {
+        data.append(encodeRecord(Op::Put, key, entries.value(key).value));
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Couldn't open" << fileName << "for writing";
+        return;
+    }
+
+    file.write(data);
+    if (!file.commit()) {
+        qDebug() << "Couldn't write" << fileName;
+        return;
+    }
+
+    snapshotSize = data.size();
+    legacy       = false;
+
+    // Everything in the journal is in the snapshot now
+    journal.remove();
+}
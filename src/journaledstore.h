@@ -0,0 +1,80 @@
+#ifndef JOURNALEDSTORE_H
+#define JOURNALEDSTORE_H
+
+#include "precompiled.h"
+
+/**
+ * A small persistent key/value store for the wallet's own data files (address book, recurring payments,
+ * turnstile plan). All the data is kept in memory, so reads never touch the disk.
+ *
+ * Each change is appended to "<file>.journal" as a checksummed record, so a change costs O(size of the change)
+ * instead of rewriting the whole file. When the journal gets bigger than the snapshot, the snapshot is rewritten
+ * from memory (from the event loop, so a batch of changes is compacted once) into a QSaveFile, which atomically
+ * replaces the old one, and the journal is emptied. A torn record at the end of the journal, from a crash in the
+ * middle of a write, fails its checksum and is dropped on the next load.
+ *
+ * Entries are returned in the order they were first added.
+ */
+class JournaledStore
+{
+public:
+    // The store for the given file, loaded from disk the first time it is asked for
+    static JournaledStore* forFile(const QString& fileName);
+
+    // The file exists, but was written by an older version in its own format. The owner should read it
+    // itself and then call replaceAll(), which replaces it with a snapshot.
+    bool        needsMigration() const { return legacy; }
+
+    bool        contains(const QString& key) const { return entries.contains(key); }
+    QByteArray  get(const QString& key) const { return entries.value(key).value; }
+    int         size() const { return entries.size(); }
+    QList<QPair<QString, QByteArray>> getAll() const;
+
+    void        put(const QString& key, const QByteArray& value);
+    void        remove(const QString& key);
+    // Change an entry's key, keeping its position. An existing entry with the new key is replaced.
+    void        rename(const QString& oldKey, const QString& newKey, const QByteArray& value);
+
+    // Replace the contents of the store, and write them straight to a new snapshot
+    void        replaceAll(const QList<QPair<QString, QByteArray>>& all);
+    // Empty the store and delete its files
+    void        removeFiles();
+
+    void        compact();
+
+private:
+    JournaledStore(const QString& fileName);
+
+    enum Op {
+        Put = 1,
+        Remove,
+        Rename
+    };
+
+    struct Entry {
+        quint64     seq;
+        QByteArray  value;
+    };
+
+    static QByteArray   encodeRecord(Op op, const QString& key, const QByteArray& value, const QString& newKey = QString());
+    static quint32      crc32(const QByteArray& data);
+
+    void    load();
+    bool    replay(const QByteArray& data, int offset);
+    void    apply(Op op, const QString& key, const QByteArray& value, const QString& newKey);
+    void    append(const QByteArray& record);
+
+    QString                 fileName;
+    QFile                   journal;
+    qint64                  snapshotSize        = 0;
+    bool                    legacy              = false;
+    bool                    compactionScheduled = false;
+
+    QHash<QString, Entry>   entries;
+    QMap<quint64, QString>  order;          // seq -> key, for returning the entries in insertion order
+    quint64                 nextSeq             = 0;
+
+    static QHash<QString, JournaledStore*> stores;
+};
+
+#endif // JOURNALEDSTORE_H
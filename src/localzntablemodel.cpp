@@ -8,6 +8,35 @@
 
 QList<LocalZeroNodes> zeroNodeSettings;
 
+static QHash<QString, int>               zeroNodeTxids;      // txid -> number of local nodes using it
+static QSet<QPair<QString, qint64>>      zeroNodeOutputs;
+
+static void indexZeroNodeSetting(const LocalZeroNodes& node) {
+    zeroNodeTxids[node.txid]++;
+    zeroNodeOutputs.insert(qMakePair(node.txid, node.index));
+}
+
+void addZeroNodeSetting(const LocalZeroNodes& node) {
+    zeroNodeSettings.push_back(node);
+    indexZeroNodeSetting(node);
+}
+
+void reindexZeroNodeSettings() {
+    zeroNodeTxids.clear();
+    zeroNodeOutputs.clear();
+    for (const auto& it : zeroNodeSettings) {
+        indexZeroNodeSetting(it);
+    }
+}
+
+bool isZeroNodeTxid(const QString& txid) {
+    return zeroNodeTxids.contains(txid);
+}
+
+bool isZeroNodeOutput(const QString& txid, qint64 index) {
+    return zeroNodeOutputs.contains(qMakePair(txid, index));
+}
+
 LocalZNTableModel::LocalZNTableModel(QObject *parent)
      : QAbstractTableModel(parent) {
     headers << QObject::tr("Status") << QObject::tr("Alias") << QObject::tr("IP Address")
@@ -51,10 +80,7 @@ void LocalZNTableModel::setupZeroNode(MainWindow* main, Ui_znsetup* zn, QDialog*
         if (outputs == nullptr)
             outputs = new QList<ZNOutputs>;
 
-        if (znData == nullptr)
-            znData = new QList<LocalZeroNodes>;
-
-        main->getRPC()->getZNOutputs(zn, outputs, znData);
+        main->getRPC()->getZNOutputs(zn, outputs);
 
     });
 
@@ -79,7 +105,7 @@ void LocalZNTableModel::setupZeroNode(MainWindow* main, Ui_znsetup* zn, QDialog*
             };
 
             if (lineNode.alias.length() == 0) {
-                zeroNodeSettings.push_back(newNode);
+                addZeroNodeSetting(newNode);
                 addLocalZNData();
                 writeZeroNodeSetup();
             } else {
@@ -111,6 +137,7 @@ void LocalZNTableModel::deleteZeroNodeFromSetup(const LocalZeroNodes &delNode) {
           zeroNodeSettings.push_back(it);
       }
   }
+  reindexZeroNodeSettings();
 
   //Update Ui
   addLocalZNData();
@@ -147,6 +174,7 @@ void LocalZNTableModel::updateZeroNodeSetup(const LocalZeroNodes &lineNode, Loca
             zeroNodeSettings.push_back(updatedNode);
         }
     }
+    reindexZeroNodeSettings();
 
     //Update Ui
     addLocalZNData();
@@ -170,14 +198,7 @@ void LocalZNTableModel::updateZNOutput(Ui_znsetup* zn) {
 }
 
 bool LocalZNTableModel::isLocal(QString txid) {
-
-  for (auto it : zeroNodeSettings) {
-      if (txid == it.txid)
-          return true;
-  }
-
-  return false;
-
+    return isZeroNodeTxid(txid);
 }
 
 // bool TxTableModel::exportToCsv(QString fileName) const {
@@ -24,6 +24,14 @@ struct ZNOutputs {
 
 extern QList<LocalZeroNodes> zeroNodeSettings;
 
+// Hash indexes over zeroNodeSettings, so checking whether a txid or an output (txid, index) belongs
+// to one of our zeronodes doesn't have to scan the list. Call addZeroNodeSetting() to append to the
+// list, or reindexZeroNodeSettings() after changing it in any other way.
+void addZeroNodeSetting(const LocalZeroNodes& node);
+void reindexZeroNodeSettings();
+bool isZeroNodeTxid(const QString& txid);
+bool isZeroNodeOutput(const QString& txid, qint64 index);
+
 class LocalZNTableModel: public QAbstractTableModel
 {
 public:
@@ -5,6 +5,7 @@
 #include "rpc.h"
 #include "settings.h"
 #include "turnstile.h"
+#include "trace.h"
 
 #include "version.h"
 
@@ -164,11 +165,20 @@ public:
                                           "confFile");
         parser.addOption(confOption);
 
+        // Write a Chrome trace of the startup and the refreshes
+        QCommandLineOption traceOption(QStringList() << "trace", "Write a Chrome trace (chrome://tracing) of the startup and refreshes to the file specified.",
+                                       "traceFile");
+        parser.addOption(traceOption);
+
         // Positional argument will specify a zero payment URI
         parser.addPositionalArgument("zcashURI", "An optional zero URI to pay");
 
         parser.process(a);
 
+        if (parser.isSet(traceOption) && !a.isSecondary()) {
+            Trace::start(parser.value(traceOption));
+        }
+
         // Check for a positional argument indicating a zero payment URI
         if (a.isSecondary()) {
             if (parser.positionalArguments().length() > 0) {
@@ -206,7 +216,10 @@ public:
     #endif
         std::srand(seed);
 
-        Settings::init();
+        {
+            TraceSpan span("Settings::init");
+            Settings::init();
+        }
 
         // Set up libsodium
         if (sodium_init() < 0) {
@@ -227,7 +240,10 @@ public:
             Settings::getInstance()->setUsingZcashConf(parser.value(confOption));
         }
 
-        w = new MainWindow();
+        {
+            TraceSpan span("MainWindow");
+            w = new MainWindow();
+        }
         w->setWindowTitle("ZeroWallet v" + QString(APP_VERSION));
 
         // If there was a payment URI on the command line, pay it
@@ -255,7 +271,10 @@ public:
             w->show();
         }
 
-        return QApplication::exec();
+        auto ret = QApplication::exec();
+        Trace::flush();
+
+        return ret;
     }
 
     void DispatchToMainThread(std::function<void()> callback)
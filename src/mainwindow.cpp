@@ -1,5 +1,6 @@
 #include "mainwindow.h"
 #include "addressbook.h"
+#include "addresslistmodel.h"
 #include "viewalladdresses.h"
 #include "validateaddress.h"
 #include "ui_mainwindow.h"
@@ -21,7 +22,9 @@
 #include "turnstile.h"
 #include "connection.h"
 #include "requestdialog.h"
+#include "bulkpayout.h"
 #include "websockets.h"
+#include "trace.h"
 
 using json = nlohmann::json;
 
@@ -41,15 +44,20 @@ MainWindow::MainWindow(QWidget *parent) :
         theme_name = "default";
     }
 
-    QFile qFile(":/css/res/css/" + theme_name +".css");
-    if (qFile.open(QFile::ReadOnly))
     {
-      QString styleSheet = QLatin1String(qFile.readAll());
-      this->setStyleSheet(styleSheet);
+        TraceSpan span("Load stylesheet");
+        QFile qFile(":/css/res/css/" + theme_name +".css");
+        if (qFile.open(QFile::ReadOnly))
+        {
+          QString styleSheet = QLatin1String(qFile.readAll());
+          this->setStyleSheet(styleSheet);
+        }
     }
 
-
-    ui->setupUi(this);
+    {
+        TraceSpan span("setupUi");
+        ui->setupUi(this);
+    }
     logger = new Logger(this, QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).filePath("zero-qt-wallet.log"));
 
     // Status Bar
@@ -96,6 +104,11 @@ MainWindow::MainWindow(QWidget *parent) :
         payZcashURI();
     });
 
+    // Bulk payout from a CSV
+    QObject::connect(ui->actionBulk_Payout, &QAction::triggered, [=] () {
+        BulkPayout::showDialog(this);
+    });
+
     // Import Private Key
     QObject::connect(ui->actionImport_Private_Key, &QAction::triggered, this, &MainWindow::importPrivKey);
 
@@ -152,38 +165,63 @@ MainWindow::MainWindow(QWidget *parent) :
     zeronodestab = ui->tabWidget->widget(3);
     // ui->tabWidget->removeTab(3);
 
-    setupSendTab();
-    setupTransactionsTab();
-    setupReceiveTab();
-    setupBalancesTab();
+    {
+        TraceSpan span("setupSendTab");
+        setupSendTab();
+    }
+
+    {
+        TraceSpan span("setupTransactionsTab");
+        setupTransactionsTab();
+    }
+
+    {
+        TraceSpan span("setupReceiveTab");
+        setupReceiveTab();
+    }
+
+    {
+        TraceSpan span("setupBalancesTab");
+        setupBalancesTab();
+    }
+
 //    setupTurnstileDialog();
-    setupZcashdTab();
-    setupZNodesTab();
-//    SafeNodesTab();
 
-    rpc = new RPC(this);
+    {
+        TraceSpan span("setupZcashdTab");
+        setupZcashdTab();
+    }
 
-    restoreSavedStates();
+    {
+        TraceSpan span("setupZNodesTab");
+        setupZNodesTab();
+    }
 
-    if (AppDataServer::getInstance()->isAppConnected()) {
-        auto ads = AppDataServer::getInstance();
+//    SafeNodesTab();
 
-        QString wormholecode = "";
-        if (ads->getAllowInternetConnection())
-            wormholecode = ads->getWormholeCode(ads->getSecretHex());
+    {
+        TraceSpan span("new RPC");
+        rpc = new RPC(this);
+    }
 
-        createWebsocket(wormholecode);
+    {
+        TraceSpan span("restoreSavedStates");
+        restoreSavedStates();
+    }
+
+    if (AppDataServer::getInstance()->isAppConnected()) {
+        createWebsocket(AppDataServer::getInstance()->getInternetDeviceCodes());
     }
 }
 
-void MainWindow::createWebsocket(QString wormholecode) {
+void MainWindow::createWebsocket(QStringList wormholecodes) {
     qDebug() << "Listening for app connections on port 8237";
     // Create the websocket server, for listening to direct connections
     wsserver = new WSServer(8237, false, this);
 
-    if (!wormholecode.isEmpty()) {
-        // Connect to the wormhole service
-        wormhole = new WormholeClient(this, wormholecode);
+    // Connect to the wormhole service
+    for (auto code : wormholecodes) {
+        wormholes.append(new WormholeClient(this, code));
     }
 }
 
@@ -191,8 +229,8 @@ void MainWindow::stopWebsocket() {
     delete wsserver;
     wsserver = nullptr;
 
-    delete wormhole;
-    wormhole = nullptr;
+    qDeleteAll(wormholes);
+    wormholes.clear();
 
     qDebug() << "Websockets for app connections shut down";
 }
@@ -201,9 +239,24 @@ bool MainWindow::isWebsocketListening() {
     return wsserver != nullptr;
 }
 
-void MainWindow::replaceWormholeClient(WormholeClient* newClient) {
-    delete wormhole;
-    wormhole = newClient;
+void MainWindow::addWormholeClient(WormholeClient* newClient) {
+    wormholes.append(newClient);
+}
+
+WormholeClient* MainWindow::getWormholeClient(const QString& code) {
+    for (auto w : wormholes) {
+        if (w->getCode() == code)
+            return w;
+    }
+    return nullptr;
+}
+
+void MainWindow::removeWormholeClient(const QString& code) {
+    for (int i = wormholes.size() - 1; i >= 0; i--) {
+        if (wormholes[i]->getCode() == code) {
+            delete wormholes.takeAt(i);
+        }
+    }
 }
 
 void MainWindow::restoreSavedStates() {
@@ -240,6 +293,10 @@ void MainWindow::closeEvent(QCloseEvent* event) {
 
     s.sync();
 
+    // Write out the mobile app's nonces, once the messages being handled are done
+    AppDataServer::getInstance()->waitForWorkers();
+    AppDataServer::getInstance()->saveSession();
+
     // Let the RPC know to shut down any running service.
     rpc->shutdownZcashd();
 
@@ -348,7 +405,7 @@ void MainWindow::turnstileDoMigration(QString fromAddr) {
     turnstile.msgIcon->setPixmap(icon.pixmap(64, 64));
 
     auto fnGetAllSproutBalance = [=] () {
-        double bal = 0;
+        Amount bal;
         for (auto addr : *rpc->getAllZAddresses()) {
             if (Settings::getInstance()->isSproutAddress(addr) && rpc->getAllBalances()) {
                 bal += rpc->getAllBalances()->value(addr);
@@ -358,7 +415,7 @@ void MainWindow::turnstileDoMigration(QString fromAddr) {
         return bal;
     };
 
-    turnstile.fromBalance->setText(Settings::getZECUSDDisplayFormat(fnGetAllSproutBalance()));
+    turnstile.fromBalance->setText(fnGetAllSproutBalance().toDecimalZECUSDString());
     for (auto addr : *rpc->getAllZAddresses()) {
         auto bal = rpc->getAllBalances()->value(addr);
         if (Settings::getInstance()->isSaplingAddress(addr)) {
@@ -369,7 +426,7 @@ void MainWindow::turnstileDoMigration(QString fromAddr) {
     }
 
     auto fnUpdateSproutBalance = [=] (QString addr) {
-        double bal = 0;
+        Amount bal;
 
         // The currentText contains the balance as well, so strip that.
         if (addr.contains("(")) {
@@ -382,9 +439,9 @@ void MainWindow::turnstileDoMigration(QString fromAddr) {
             bal = rpc->getAllBalances()->value(addr);
         }
 
-        auto balTxt = Settings::getZECUSDDisplayFormat(bal);
+        auto balTxt = bal.toDecimalZECUSDString();
 
-        if (bal < Turnstile::minMigrationAmount) {
+        if (bal.toDecimalDouble() < Turnstile::minMigrationAmount) {
             turnstile.fromBalance->setStyleSheet("color: red;");
             turnstile.fromBalance->setText(balTxt % " [You need at least "
                         % Settings::getZECDisplayFormat(Turnstile::minMigrationAmount)
@@ -415,7 +472,7 @@ void MainWindow::turnstileDoMigration(QString fromAddr) {
     QObject::connect(turnstile.privLevel, QOverload<int>::of(&QComboBox::currentIndexChanged), [=] (auto idx) {
         // Update the fees
         turnstile.minerFee->setText(
-            Settings::getZECUSDDisplayFormat(std::get<0>(privOptions[idx]) * Settings::getMinerFee()));
+            (Settings::getMinerFee() * std::get<0>(privOptions[idx])).toDecimalZECUSDString());
     });
 
     for (auto i : privOptions) {
@@ -474,6 +531,11 @@ void MainWindow::setupStatusBar() {
     ui->statusBar->addPermanentWidget(loadingLabel);
     loadingLabel->setVisible(false);
 
+    // Sends waiting for a free proving slot
+    queueLabel = new QLabel();
+    ui->statusBar->addPermanentWidget(queueLabel);
+    queueLabel->setVisible(false);
+
     // Custom status bar menu
     ui->statusBar->setContextMenuPolicy(Qt::CustomContextMenu);
     QObject::connect(ui->statusBar, &QStatusBar::customContextMenuRequested, [=](QPoint pos) {
@@ -532,6 +594,9 @@ void MainWindow::setupSettingsModal() {
         // Fetch prices
         settings.chkFetchPrices->setChecked(Settings::getInstance()->getAllowFetchPrices());
 
+        // Concurrent proofs
+        settings.spnProvingSlots->setValue(Settings::getInstance()->getProvingSlots());
+
         // Connection Settings
         QIntValidator validator(0, 65535);
         settings.port->setValidator(&validator);
@@ -691,7 +756,7 @@ void MainWindow::setupSettingsModal() {
             Settings::getInstance()->setAllowCustomFees(customFees);
             ui->minerFeeAmt->setReadOnly(!customFees);
             if (!customFees)
-                ui->minerFeeAmt->setText(Settings::getDecimalString(Settings::getMinerFee()));
+                ui->minerFeeAmt->setText(Settings::getMinerFee().toDecimalString());
 
             // Auto shield
             Settings::getInstance()->setAutoShield(settings.chkAutoShield->isChecked());
@@ -702,6 +767,10 @@ void MainWindow::setupSettingsModal() {
             // Allow fetching prices
             Settings::getInstance()->setAllowFetchPrices(settings.chkFetchPrices->isChecked());
 
+            // Concurrent proofs
+            Settings::getInstance()->setProvingSlots(settings.spnProvingSlots->value());
+            rpc->sendQueuedTxs();
+
             // Check to see if state changed and wallet needs to restart
             bool showRestartInfo = false;
             bool forceRestart = false;
@@ -904,7 +973,7 @@ void MainWindow::postToZBoard() {
 
     // Fill the from field with sapling addresses.
     for (auto i = rpc->getAllBalances()->keyBegin(); i != rpc->getAllBalances()->keyEnd(); i++) {
-        if (Settings::getInstance()->isSaplingAddress(*i) && rpc->getAllBalances()->value(*i) > 0) {
+        if (Settings::getInstance()->isSaplingAddress(*i) && rpc->getAllBalances()->value(*i) > Amount()) {
             zb.fromAddr->addItem(*i);
         }
     }
@@ -932,7 +1001,7 @@ void MainWindow::postToZBoard() {
     QRegExpValidator v(QRegExp("^[a-zA-Z0-9_]{3,20}$"), zb.postAs);
     zb.postAs->setValidator(&v);
 
-    zb.feeAmount->setText(Settings::getZECUSDDisplayFormat(Settings::getZboardAmount() + Settings::getMinerFee()));
+    zb.feeAmount->setText((Settings::getZboardAmount() + Settings::getMinerFee()).toDecimalZECUSDString());
 
     auto fnBuildNameMemo = [=]() -> QString {
         auto memo = zb.memoTxt->toPlainText().trimmed();
@@ -1032,6 +1101,10 @@ void MainWindow::balancesReady() {
     uiPaymentsReady = true;
     qDebug() << "Payment UI now ready!";
 
+    // This is the end of the startup, so write out the trace now, in case the wallet doesn't exit cleanly
+    Trace::instant("Balances ready");
+    Trace::flush();
+
     // There is a pending URI payment (from the command line, or from a secondary instance),
     // process it.
     if (!pendingURIPayment.isEmpty()) {
@@ -1660,8 +1733,8 @@ void MainWindow::addNewZaddr() {
 
         // Just double make sure the z-address is still checked
         if (ui->rdioZSAddr->isChecked() ) {
-            ui->listReceiveAddresses->insertItem(0, addr);
-            ui->listReceiveAddresses->setCurrentIndex(0);
+            AddressListModel::getInstance()->addNewAddress(addr);
+            ui->listReceiveAddresses->setCurrentText(addr);
 
             ui->statusBar->showMessage(QString::fromStdString("Created new zAddr") %
                                        ("(Sapling)"),
@@ -1678,19 +1751,9 @@ std::function<void(bool)> MainWindow::addZAddrsToComboList() {
         if (checked && this->rpc->getAllZAddresses() != nullptr) {
             auto addrs = this->rpc->getAllZAddresses();
 
-            // Save the current address, so we can update it later
+            // Save the current address, so we can restore it after switching the filter
             auto zaddr = ui->listReceiveAddresses->currentText();
-            ui->listReceiveAddresses->clear();
-
-            std::for_each(addrs->begin(), addrs->end(), [=] (auto addr) {
-                if ( (Settings::getInstance()->isSaplingAddress(addr)) ||
-                    (!Settings::getInstance()->isSaplingAddress(addr))) {
-                        if (rpc->getAllBalances()) {
-                            auto bal = rpc->getAllBalances()->value(addr);
-                            ui->listReceiveAddresses->addItem(addr, bal);
-                        }
-                }
-            });
+            ui->listReceiveAddresses->setAddressFilter(AddressFilterProxyModel::ZAddresses);
 
             if (!zaddr.isEmpty() && Settings::isZAddress(zaddr)) {
                 ui->listReceiveAddresses->setCurrentText(zaddr);
@@ -1705,6 +1768,9 @@ std::function<void(bool)> MainWindow::addZAddrsToComboList() {
 }
 
 void MainWindow::setupReceiveTab() {
+    // The receive list starts off showing the z-addresses
+    ui->listReceiveAddresses->setAddressFilter(AddressFilterProxyModel::ZAddresses);
+
     auto addNewTAddr = [=] () {
         rpc->newTaddr([=] (json reply) {
             QString addr = QString::fromStdString(reply.get<json::string_t>());
@@ -1713,8 +1779,8 @@ void MainWindow::setupReceiveTab() {
 
             // Just double make sure the t-address is still checked
             if (ui->rdioTAddr->isChecked()) {
-                ui->listReceiveAddresses->insertItem(0, addr);
-                ui->listReceiveAddresses->setCurrentIndex(0);
+                AddressListModel::getInstance()->addNewAddress(addr);
+                ui->listReceiveAddresses->setCurrentText(addr);
 
                 ui->statusBar->showMessage(tr("Created new t-Addr"), 10 * 1000);
             }
@@ -1749,6 +1815,14 @@ void MainWindow::setupReceiveTab() {
         ViewAllAddressesModel model(viewaddrs.tblAddresses, *getRPC()->getAllTAddresses(), getRPC());
         viewaddrs.tblAddresses->setModel(&model);
 
+        // Funded addresses first. Click on the headers to sort by address or last activity instead
+        viewaddrs.tblAddresses->horizontalHeader()->setSortIndicator(ViewAllAddressesModel::Balance, Qt::DescendingOrder);
+        viewaddrs.tblAddresses->setSortingEnabled(true);
+
+        QObject::connect(viewaddrs.txtSearch, &QLineEdit::textChanged, [&] (const QString& text) {
+            model.setSearch(text);
+        });
+
         QObject::connect(viewaddrs.btnExportAll, &QPushButton::clicked,  this, &MainWindow::exportAllKeys);
 
         viewaddrs.tblAddresses->setContextMenuPolicy(Qt::CustomContextMenu);
@@ -1828,7 +1902,7 @@ void MainWindow::setupReceiveTab() {
         }
 
         ui->rcvLabel->setText(label);
-        ui->rcvBal->setText(Settings::getZECUSDDisplayFormat(rpc->getAllBalances()->value(addr)));
+        ui->rcvBal->setText(rpc->getAllBalances()->value(addr).toDecimalZECUSDString());
         ui->txtReceive->setPlainText(addr);
         ui->qrcodeDisplay->setQrcodeString(addr);
         if (rpc->getUsedAddresses()->value(addr, false)) {
@@ -1887,87 +1961,24 @@ void MainWindow::setupReceiveTab() {
 
 void MainWindow::updateTAddrCombo(bool checked) {
     if (checked) {
-        auto utxos = this->rpc->getUTXOs();
-
         // Save the current address so we can restore it later
         auto currentTaddr = ui->listReceiveAddresses->currentText();
 
-        ui->listReceiveAddresses->clear();
-
-        // Maintain a set of addresses so we don't duplicate any, because we'll be adding
-        // t addresses multiple times
-        QSet<QString> addrs;
-
-        // 1. Add all t addresses that have a balance
-        std::for_each(utxos->begin(), utxos->end(), [=, &addrs](auto& utxo) {
-            auto addr = utxo.address;
-            if (Settings::isTAddress(addr) && !addrs.contains(addr)) {
-                auto bal = rpc->getAllBalances()->value(addr);
-                ui->listReceiveAddresses->addItem(addr, bal);
+        // The filter puts the t addresses that have a balance first, then the ones that have
+        // a label, and then all the rest. The list is searchable, so there's no need to cap it.
+        ui->listReceiveAddresses->setAddressFilter(AddressFilterProxyModel::TAddresses);
 
-                addrs.insert(addr);
-            }
-        });
-
-        // 2. Add all t addresses that have a label
-        auto allTaddrs = this->rpc->getAllTAddresses();
-        QSet<QString> labels;
-        for (auto p : AddressBook::getInstance()->getAllAddressLabels()) {
-            labels.insert(p.second);
-        }
-        std::for_each(allTaddrs->begin(), allTaddrs->end(), [=, &addrs] (auto& taddr) {
-            // If the address is in the address book, add it.
-            if (labels.contains(taddr) && !addrs.contains(taddr)) {
-                addrs.insert(taddr);
-                ui->listReceiveAddresses->addItem(taddr, 0);
-            }
-        });
-
-        // 3. Add all t-addresses. We won't add more than 20 total t-addresses,
-        // since it will overwhelm the dropdown
-        for (int i=0; addrs.size() < 20 && i < allTaddrs->size(); i++) {
-            auto addr = allTaddrs->at(i);
-            if (!addrs.contains(addr))  {
-                addrs.insert(addr);
-                // Balance is zero since it has not been previously added
-                ui->listReceiveAddresses->addItem(addr, 0);
-            }
-        }
-
-        // 4. Add the previously selected t-address
         if (!currentTaddr.isEmpty() && Settings::isTAddress(currentTaddr)) {
-            // Make sure the current taddr is in the list
-            if (!addrs.contains(currentTaddr)) {
-                auto bal = rpc->getAllBalances()->value(currentTaddr);
-                ui->listReceiveAddresses->addItem(currentTaddr, bal);
-            }
             ui->listReceiveAddresses->setCurrentText(currentTaddr);
         }
-
-        // 5. Add a last, disabled item if there are remaining items
-        if (allTaddrs->size() > addrs.size()) {
-            auto num = QString::number(allTaddrs->size() - addrs.size());
-            ui->listReceiveAddresses->addItem("-- " + num + " more --", 0);
-
-            QStandardItemModel* model = qobject_cast<QStandardItemModel*>(ui->listReceiveAddresses->model());
-            QStandardItem* item =  model->findItems("--", Qt::MatchStartsWith)[0];
-            item->setFlags(item->flags() & ~Qt::ItemIsEnabled);
-        }
     }
 };
 
 // Updates the labels everywhere on the UI. Call this after the labels have been updated
 void MainWindow::updateLabels() {
-    // Update the Receive tab
-    if (ui->rdioTAddr->isChecked()) {
-        updateTAddrCombo(true);
-    }
-    else {
-        addZAddrsToComboList();
-    }
-
-    // Update the Send Tab
-    updateFromCombo();
+    // Update the Receive and Send tab combos. They all show the same model, and the t-address
+    // list re-sorts itself if a label was added or removed.
+    AddressListModel::getInstance()->labelsChanged();
 
     // Update the autocomplete
     updateLabelsAutoComplete();
@@ -2012,5 +2023,5 @@ MainWindow::~MainWindow()
     delete logger;
 
     delete wsserver;
-    delete wormhole;
+    qDeleteAll(wormholes);
 }
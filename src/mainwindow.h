@@ -3,6 +3,7 @@
 
 #include "precompiled.h"
 
+#include "amount.h"
 #include "logger.h"
 #include "recurring.h"
 
@@ -17,7 +18,7 @@ using json = nlohmann::json;
 // Struct used to hold destination info when sending a Tx.
 struct ToFields {
     QString addr;
-    double  amount;
+    Amount  amount;
     QString txtMemo;
     QString encodedMemo;
 };
@@ -26,7 +27,7 @@ struct ToFields {
 struct Tx {
     QString         fromAddr;
     QList<ToFields> toAddrs;
-    double          fee;
+    Amount          fee;
 };
 
 namespace Ui {
@@ -50,9 +51,11 @@ public:
     QString doSendTxValidations(Tx tx);
     void setDefaultPayFrom();
 
-    void replaceWormholeClient(WormholeClient* newClient);
+    void addWormholeClient(WormholeClient* newClient);
+    void removeWormholeClient(const QString& code);
+    WormholeClient* getWormholeClient(const QString& code);
     bool isWebsocketListening();
-    void createWebsocket(QString wormholecode);
+    void createWebsocket(QStringList wormholecodes);
     void stopWebsocket();
 
     void balancesReady();
@@ -75,6 +78,7 @@ public:
     QLabel*             statusLabel;
     QLabel*             statusIcon;
     QLabel*             loadingLabel;
+    QLabel*             queueLabel;
     QWidget*            zcashdtab;
     QWidget*            zeronodestab;
 
@@ -145,10 +149,11 @@ private:
     bool eventFilter(QObject *object, QEvent *event);
 
     bool            uiPaymentsReady    = false;
+    bool            payFromDefaulted   = false;
     QString         pendingURIPayment;
 
     WSServer*       wsserver = nullptr;
-    WormholeClient* wormhole = nullptr;
+    QList<WormholeClient*> wormholes;      // One for each paired device that can connect over the internet
 
     RPC*                rpc             = nullptr;
     QCompleter*         labelCompleter  = nullptr;
@@ -0,0 +1,226 @@
+#include "mobilecrypto.h"
+
+static void appendHex(QString& out, const unsigned char* bin, int len) {
+    static const char digits[] = "0123456789abcdef";
+
+    int pos = out.size();
+    out.resize(pos + 2 * len);
+
+    auto p = out.data() + pos;
+    for (int i = 0; i < len; i++) {
+        p[2 * i]     = QLatin1Char(digits[bin[i] >> 4]);
+        p[2 * i + 1] = QLatin1Char(digits[bin[i] & 0xF]);
+    }
+}
+
+// Decode hex straight from the QString, without converting it to a std::string first. Returns false if it isn't
+// exactly len bytes of hex.
+static bool hexToBin(const QString& hex, unsigned char* out, int len) {
+    if (hex.length() != len * 2)
+        return false;
+
+    auto digit = [] (QChar c) {
+        auto u = c.unicode();
+        if (u >= '0' && u <= '9') return u - '0';
+        if (u >= 'a' && u <= 'f') return u - 'a' + 10;
+        if (u >= 'A' && u <= 'F') return u - 'A' + 10;
+        return -1;
+    };
+
+    auto p = hex.constData();
+    for (int i = 0; i < len; i++) {
+        int hi = digit(p[2 * i]);
+        int lo = digit(p[2 * i + 1]);
+        if (hi < 0 || lo < 0)
+            return false;
+
+        out[i] = (unsigned char)((hi << 4) | lo);
+    }
+
+    return true;
+}
+
+// The scratch buffer for encrypting and decrypting messages, with room for at least len bytes. Each worker thread has
+// its own, kept between messages, so there is nothing to allocate once it has grown to the size of the largest one.
+unsigned char* MobileCrypto::buffer(int len) {
+    thread_local QByteArray cryptoBuf;
+    if (cryptoBuf.size() < len)
+        cryptoBuf.resize(len);
+
+    return (unsigned char*)cryptoBuf.data();
+}
+
+// Encrypt an outgoing protocol 1 message
+QString MobileCrypto::encryptText(const QString& msg, const unsigned char* nonce, const unsigned char* secret, const QString& to) {
+    auto utf8 = msg.toUtf8();
+
+    // Protocol 1 apps expect the message to be padded with spaces to a multiple of 256
+    int msgSize = utf8.size();
+    if (msgSize % 256 > 0)
+        msgSize += 256 - (msgSize % 256);
+
+    auto buf = buffer(msgSize + crypto_secretbox_MACBYTES);
+    memcpy(buf, utf8.constData(), utf8.size());
+    memset(buf + utf8.size(), ' ', msgSize - utf8.size());
+
+    crypto_secretbox_easy(buf, buf, msgSize, nonce, secret);
+    sodium_memzero(utf8.data(), utf8.size());
+
+    // Build the JSON by hand, since everything in it is hex
+    int encryptedLen = msgSize + crypto_secretbox_MACBYTES;
+
+    QString json;
+    json.reserve(64 + 2 * crypto_secretbox_NONCEBYTES + 2 * encryptedLen + to.length());
+    json.append(QLatin1String("{\"nonce\":\""));
+    appendHex(json, nonce, crypto_secretbox_NONCEBYTES);
+    json.append(QLatin1String("\",\"payload\":\""));
+    appendHex(json, buf, encryptedLen);
+    json.append(QLatin1String("\",\"to\":\""));
+    json.append(to);
+    json.append(QLatin1String("\"}"));
+
+    return json;
+}
+
+/**
+  Attempt to decrypt a message. If the decryption fails, it returns the string "error", the decrypted message otherwise. 
+  It will use the given secret to attempt decryption. In addition, it will enforce that the nonce is greater than the last seen nonce, 
+  unless the skipNonceCheck = true, which is used when attempting decrtption with a temp secret key.
+*/
+QString MobileCrypto::decryptText(const QJsonDocument& msg, const unsigned char* secret, unsigned char* lastRemoteNonce) {
+    // Decrypt and then process
+    QString noncehex = msg.object().value("nonce").toString();
+    QString encryptedhex = msg.object().value("payload").toString();
+
+    // Enforce limits on the size of the message
+    int encryptedLen = encryptedhex.length() / 2;
+    if (noncehex.length() > ((int)crypto_secretbox_NONCEBYTES * 2) ||
+        encryptedhex.length() > 2 * 50 * 1024 /*50kb*/ || encryptedLen < (int)crypto_secretbox_MACBYTES) {
+        return "error";
+    }
+
+    // Check to make sure that the nonce is greater than the last known remote nonce
+    unsigned char noncebin[crypto_secretbox_NONCEBYTES];
+    if (!hexToBin(noncehex, noncebin, crypto_secretbox_NONCEBYTES))
+        return "error";
+
+    assert(crypto_secretbox_KEYBYTES == crypto_hash_sha256_BYTES);
+    if (sodium_compare(lastRemoteNonce, noncebin, crypto_secretbox_NONCEBYTES) != -1) {
+        // Refuse to accept a lower nonce, return an error
+        return "error";
+    }
+
+    // Decrypt in place
+    auto buf = buffer(encryptedLen);
+    if (!hexToBin(encryptedhex, buf, encryptedLen) ||
+            crypto_secretbox_open_easy(buf, buf, encryptedLen, noncebin, secret) != 0) {
+        return "error";
+    }
+
+    // Update the last seen remote nonce
+    memcpy(lastRemoteNonce, noncebin, crypto_secretbox_NONCEBYTES);
+
+    // The message ends at the first NUL, if there is one
+    int decryptedLen = encryptedLen - crypto_secretbox_MACBYTES;
+    auto end = (const unsigned char*)memchr(buf, 0, decryptedLen);
+    auto payload = QString::fromUtf8((const char*)buf, end ? end - buf : decryptedLen);
+    sodium_memzero(buf, decryptedLen);
+
+    return payload;
+}
+
+// The size a binary message (with its length) is padded to
+int MobileCrypto::paddedSize(int len) {
+    for (int bucket : { 256, 1024, 4 * 1024, 16 * 1024, 64 * 1024 }) {
+        if (len <= bucket)
+            return bucket;
+    }
+
+    return (len + 64 * 1024 - 1) / (64 * 1024) * (64 * 1024);
+}
+
+QByteArray MobileCrypto::encryptBinary(const QString& msg, int protocol, const unsigned char* nonce, const unsigned char* secret,
+                                       qint64* uncompressedBytes, qint64* compressedBytes) {
+    auto    utf8   = msg.toUtf8();
+    quint32 header = utf8.size();
+
+    // Big messages, like the transaction list, are mostly repeated JSON keys and addresses, and compress well
+    if (protocol >= 3 && utf8.size() >= compressThreshold) {
+        auto compressed = qCompress(utf8);
+        if (compressed.size() < utf8.size()) {
+            *uncompressedBytes += utf8.size();
+            *compressedBytes   += compressed.size();
+
+            sodium_memzero(utf8.data(), utf8.size());
+            utf8   = compressed;
+            header = utf8.size() | compressedFlag;
+        }
+    }
+
+    int len = paddedSize(4 + utf8.size());
+
+    // Lay out the frame, with the padded message where the ciphertext goes, and encrypt it in place
+    QByteArray out(binaryHeaderSize + len + crypto_secretbox_MACBYTES, 0);
+    auto box = (unsigned char*)out.data() + binaryHeaderSize;
+    qToBigEndian<quint32>(header, box);
+    memcpy(box + 4, utf8.constData(), utf8.size());
+
+    out[0] = (char)protocol;
+    memcpy(out.data() + 1, nonce, crypto_secretbox_NONCEBYTES);
+    crypto_secretbox_easy(box, box, len, nonce, secret);
+
+    sodium_memzero(utf8.data(), utf8.size());
+    return out;
+}
+
+// Decrypt a binary (protocol 2 or 3) message. Returns "error" if it can't be decrypted, just like decryptText()
+QString MobileCrypto::decryptBinary(const QByteArray& msg, const unsigned char* secret, unsigned char* lastRemoteNonce) {
+    int encryptedLen = msg.size() - binaryHeaderSize;
+    if (msg.size() < binaryHeaderSize || (msg[0] != 2 && msg[0] != 3) ||
+            encryptedLen < (int)crypto_secretbox_MACBYTES + 4 || encryptedLen > maxBinaryPayload) {
+        return "error";
+    }
+
+    auto noncebin = (const unsigned char*)msg.constData() + 1;
+    if (sodium_compare(lastRemoteNonce, noncebin, crypto_secretbox_NONCEBYTES) != -1) {
+        // Refuse to accept a lower nonce
+        return "error";
+    }
+
+    auto buf = buffer(encryptedLen);
+    memcpy(buf, msg.constData() + binaryHeaderSize, encryptedLen);
+    if (crypto_secretbox_open_easy(buf, buf, encryptedLen, noncebin, secret) != 0) {
+        return "error";
+    }
+
+    int     plainLen   = encryptedLen - crypto_secretbox_MACBYTES;
+    quint32 header     = qFromBigEndian<quint32>(buf);
+    bool    compressed = msg[0] == 3 && (header & compressedFlag);
+    quint32 len        = compressed ? header & ~compressedFlag : header;
+
+    // qCompress() puts the uncompressed size first, so a message that would blow up is refused before it is unpacked
+    if (len > (quint32)plainLen - 4 || (compressed && (len < 4 || qFromBigEndian<quint32>(buf + 4) > (quint32)maxUncompressed))) {
+        sodium_memzero(buf, plainLen);
+        return "error";
+    }
+
+    QString payload;
+    if (compressed) {
+        auto utf8 = qUncompress(buf + 4, len);
+        if (utf8.isEmpty()) {
+            sodium_memzero(buf, plainLen);
+            return "error";
+        }
+
+        payload = QString::fromUtf8(utf8);
+        sodium_memzero(utf8.data(), utf8.size());
+    } else {
+        payload = QString::fromUtf8((const char*)buf + 4, len);
+    }
+    sodium_memzero(buf, plainLen);
+
+    // Update the last seen remote nonce
+    memcpy(lastRemoteNonce, noncebin, crypto_secretbox_NONCEBYTES);
+
+    return payload;
+}
@@ -0,0 +1,48 @@
+#ifndef MOBILECRYPTO_H
+#define MOBILECRYPTO_H
+
+#include "precompiled.h"
+
+/**
+ * Encrypts and decrypts the messages between the wallet and the mobile app. It doesn't know about devices or
+ * sockets. The caller hands it the key and the nonce, so tools/cryptobench can build it on its own.
+ *
+ * Messages are encrypted and decrypted in place, in a scratch buffer that each thread keeps, rather than in new
+ * buffers for every step. tools/cryptobench measures how fast they are, and counts the allocations that are left.
+ */
+class MobileCrypto
+{
+public:
+    // Protocol 1: JSON with the nonce, the encrypted message (padded with spaces to a multiple of 256) and the device
+    // it is for, all in hex
+    static QString      encryptText(const QString& msg, const unsigned char* nonce, const unsigned char* secret, const QString& to);
+
+    // Protocols 2 and 3. A message that was compressed adds its size before and after to the counters.
+    static QByteArray   encryptBinary(const QString& msg, int protocol, const unsigned char* nonce, const unsigned char* secret,
+                                      qint64* uncompressedBytes, qint64* compressedBytes);
+
+    // The decrypt functions check the nonce against lastRemoteNonce, and update it if the message decrypts. They
+    // return "error" if it doesn't.
+    static QString      decryptText(const QJsonDocument& msg, const unsigned char* secret, unsigned char* lastRemoteNonce);
+    static QString      decryptBinary(const QByteArray& msg, const unsigned char* secret, unsigned char* lastRemoteNonce);
+
+    // The size a binary message (with its length) is padded to
+    static int          paddedSize(int len);
+
+    // Binary (protocol 2) messages are [version][nonce][secretbox of [length][message][zero padding]]. The padding
+    // rounds the message up to one of a few sizes, so the size of the frame says little about what is in it.
+    static const int        binaryHeaderSize   = 1 + crypto_secretbox_NONCEBYTES;
+    static const int        maxBinaryPayload   = 256 * 1024;
+
+    // Protocol 3 is protocol 2, except that messages of compressThreshold bytes or more may be qCompress()ed, which
+    // is flagged in the top bit of the length. Compressing happens before the padding, so the frame sizes still only
+    // give away the bucket.
+    static const quint32    compressedFlag     = 0x80000000u;
+    static const int        compressThreshold  = 1024;
+    static const int        maxUncompressed    = 4 * maxBinaryPayload;
+
+private:
+    static unsigned char*   buffer(int len);
+};
+
+#endif // MOBILECRYPTO_H
@@ -6,6 +6,7 @@
 #include <cstdlib>
 #include <ctime>
 #include <cmath>
+#include <queue>
 
 #include <QtGlobal>
 
@@ -34,12 +35,14 @@
 #include <QDir>
 #include <QMenu>
 #include <QCompleter>
+#include <QSortFilterProxyModel>
 #include <QPushButton>
 #include <QDateTime>
 #include <QTimer>
 #include <QSettings>
 #include <QStyle>
 #include <QFile>
+#include <QSaveFile>
 #include <QTemporaryFile>
 #include <QErrorMessage>
 #include <QApplication>
@@ -56,6 +59,11 @@
 #include <QUrl>
 #include <QQueue>
 #include <QProcess>
+#include <QThread>
+#include <QThreadPool>
+#include <QMutex>
+#include <QtEndian>
+#include <QPointer>
 #include <QDesktopServices>
 #include <QtNetwork/QNetworkRequest>
 #include <QtNetwork/QNetworkAccessManager>
@@ -0,0 +1,85 @@
+#include "prooftimes.h"
+#include "mainwindow.h"
+#include "settings.h"
+#include "journaledstore.h"
+
+const int ProofTimes::bucketSizes[] = { 1, 2, 5, 10, 25, 54 };
+const int ProofTimes::numBuckets    = sizeof(bucketSizes) / sizeof(bucketSizes[0]);
+
+ProofTimes* ProofTimes::instance = nullptr;
+
+ProofTimes* ProofTimes::getInstance() {
+    if (!instance)
+        instance = new ProofTimes();
+
+    return instance;
+}
+
+ProofTimes::ProofTimes() {
+    for (const auto& i : JournaledStore::forFile(writeableFile())->getAll()) {
+        auto parts = QString::fromUtf8(i.second).split(",");
+        if (parts.size() != 2)
+            continue;
+
+        stats.insert(i.first, Stats { parts[0].toLongLong(), parts[1].toInt() });
+    }
+}
+
+QString ProofTimes::writeableFile() {
+    auto filename = QStringLiteral("prooftimes.dat");
+
+    auto dir = QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+    if (!dir.exists())
+        QDir().mkpath(dir.absolutePath());
+
+    return dir.filePath(filename);
+}
+
+int ProofTimes::bucketFor(int recipients) {
+    for (int i = 0; i < numBuckets; i++) {
+        if (recipients <= bucketSizes[i])
+            return i;
+    }
+    return numBuckets - 1;
+}
+
+QString ProofTimes::bucketKey(bool shielded, int bucket) {
+    return (shielded ? QStringLiteral("z/") : QStringLiteral("t/")) % QString::number(bucketSizes[bucket]);
+}
+
+qint64 ProofTimes::estimate(const Tx& tx) {
+    bool shielded = !Settings::isTAddress(tx.fromAddr);
+    int  bucket   = bucketFor(tx.toAddrs.size());
+
+    auto it = stats.constFind(bucketKey(shielded, bucket));
+    if (it != stats.constEnd())
+        return it->avg;
+
+    // Nothing this size yet, so scale the nearest size we have seen. Every recipient adds an output
+    // to prove, on top of the spends, which cost about the same whatever the number of recipients.
+    for (int d = 1; d < numBuckets; d++) {
+        for (int other : { bucket - d, bucket + d }) {
+            if (other < 0 || other >= numBuckets)
+                continue;
+
+            it = stats.constFind(bucketKey(shielded, other));
+            if (it != stats.constEnd())
+                return it->avg * (1 + bucketSizes[bucket]) / (1 + bucketSizes[other]);
+        }
+    }
+
+    return defaultEstimate;
+}
+
+void ProofTimes::record(const Tx& tx, qint64 msecs) {
+    auto key = bucketKey(!Settings::isTAddress(tx.fromAddr), bucketFor(tx.toAddrs.size()));
+
+    // A plain average for the first few, and then a moving average so that a node that gets busier
+    // (or is upgraded) is picked up
+    auto& s = stats[key];
+    if (s.count < maxWeight)
+        s.count++;
+    s.avg += (msecs - s.avg) / s.count;
+
+    JournaledStore::forFile(writeableFile())->put(key, (QString::number(s.avg) % "," % QString::number(s.count)).toUtf8());
+}
@@ -0,0 +1,47 @@
+#ifndef PROOFTIMES_H
+#define PROOFTIMES_H
+
+#include "precompiled.h"
+
+struct Tx;
+
+/**
+ * Remembers how long zerod took to compute past transactions, so we can say how long a pending one will take.
+ * Sends are grouped by whether they spend transparent or shielded funds, and by their number of recipients.
+ * The averages are kept in "prooftimes.dat" (a JournaledStore), since they depend on the node's hardware and
+ * are only useful once there are a few of them.
+ */
+class ProofTimes
+{
+public:
+    static ProofTimes* getInstance();
+
+    // How long zerod is expected to take to compute the Tx, in msecs
+    qint64  estimate(const Tx& tx);
+
+    // A Tx was computed in msecs
+    void    record(const Tx& tx, qint64 msecs);
+
+private:
+    ProofTimes();
+
+    struct Stats {
+        qint64  avg;
+        int     count;
+    };
+
+    static QString  writeableFile();
+    static int      bucketFor(int recipients);
+    static QString  bucketKey(bool shielded, int bucket);
+
+    QHash<QString, Stats>   stats;
+
+    static const int        bucketSizes[];          // The largest number of recipients in each bucket
+    static const int        numBuckets;
+    static const int        maxWeight           = 10;           // Older samples fade out after about this many
+    static const qint64     defaultEstimate     = 60 * 1000;
+
+    static ProofTimes*      instance;
+};
+
+#endif // PROOFTIMES_H
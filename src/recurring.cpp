@@ -1,4 +1,5 @@
 #include "recurring.h"
+#include "journaledstore.h"
 
 #include "mainwindow.h"
 #include "rpc.h"
@@ -40,6 +41,13 @@ RecurringPaymentInfo RecurringPaymentInfo::fromJson(QJsonObject j) {
         item.status = (PaymentStatus)h.toObject()["status"].toInt();
         item.err    = h.toObject()["err"].toString();
 
+        // The wallet closed while the payment was being sent. If it never got to zerod, it can just be paid
+        // again. If it did, zerod may or may not have sent it.
+        if (item.status == PaymentStatus::QUEUED)
+            item.status = PaymentStatus::NOT_STARTED;
+        else if (item.status == PaymentStatus::SENDING)
+            item.status = PaymentStatus::UNKNOWN;
+
         r.payments.append(item);
     }
 
@@ -135,7 +143,7 @@ RecurringPaymentInfo* Recurring::getNewRecurringFromTx(QWidget* parent, MainWind
         ui.lblTo->setText(tx.toAddrs[0].addr);
 
         // Default is USD
-        ui.lblAmt->setText(Settings::getUSDFromZecAmount(tx.toAddrs[0].amount));
+        ui.lblAmt->setText(tx.toAddrs[0].amount.toDecimalUSDString());
 
         ui.txtMemo->setPlainText(tx.toAddrs[0].txtMemo);
         ui.txtMemo->setEnabled(false);
@@ -147,10 +155,10 @@ RecurringPaymentInfo* Recurring::getNewRecurringFromTx(QWidget* parent, MainWind
             return;
 
         if (c == "USD") {
-            ui.lblAmt->setText(Settings::getUSDFromZecAmount(tx.toAddrs[0].amount));
+            ui.lblAmt->setText(tx.toAddrs[0].amount.toDecimalUSDString());
         }
         else {
-            ui.lblAmt->setText(Settings::getDecimalString(tx.toAddrs[0].amount));
+            ui.lblAmt->setText(tx.toAddrs[0].amount.toDecimalString());
         }
     });
 
@@ -203,11 +211,11 @@ void Recurring::updateInfoWithTx(RecurringPaymentInfo* r, Tx tx) {
     r->fromAddr = tx.fromAddr;
     if (r->currency.isEmpty() || r->currency == "USD") {
         r->currency = "USD";
-        r->amt = tx.toAddrs[0].amount * Settings::getInstance()->getZECPrice();
+        r->amt = tx.toAddrs[0].amount.toDecimalDouble() * Settings::getInstance()->getZECPrice();
     }
     else {
         r->currency = Settings::getTokenName();
-        r->amt = tx.toAddrs[0].amount;
+        r->amt = tx.toAddrs[0].amount.toDecimalDouble();
     }
 
     // Make sure that the number of payments is properly listed in the array
@@ -263,7 +271,8 @@ void Recurring::addRecurringInfo(const RecurringPaymentInfo& rpi) {
     
     payments.insert(rpi.getHash(), rpi);
     
-    writeToStorage();
+    writeToStorage(rpi.getHash());
+    reschedule(rpi.getHash());
 }
 
 void Recurring::removeRecurringInfo(QString hash) {
@@ -274,39 +283,46 @@ void Recurring::removeRecurringInfo(QString hash) {
     
     payments.remove(hash);
     
-    writeToStorage();
+    JournaledStore::forFile(writeableFile())->remove(hash);
+    reschedule(hash);
 }
 
 
 void Recurring::readFromStorage() {
-    QFile file(writeableFile());
-    file.open(QIODevice::ReadOnly);
-
-    QTextStream in(&file);
-    auto jsondoc = QJsonDocument::fromJson(in.readAll().toUtf8());
+    auto store = JournaledStore::forFile(writeableFile());
 
     payments.clear();
 
-    for (auto k : jsondoc.array()) {
-        auto p = RecurringPaymentInfo::fromJson(k.toObject());
-        payments.insert(p.getHash(), p);
-    }
-}
+    if (store->needsMigration()) {
+        // Payments file from an older version, which was a single JSON array. Convert it to the journaled store.
+        QFile file(writeableFile());
+        file.open(QIODevice::ReadOnly);
 
+        QTextStream in(&file);
+        auto jsondoc = QJsonDocument::fromJson(in.readAll().toUtf8());
 
-void Recurring::writeToStorage() {
-    QFile file(writeableFile());
-    file.open(QIODevice::ReadWrite | QIODevice::Truncate);
+        QList<QPair<QString, QByteArray>> entries;
+        for (auto k : jsondoc.array()) {
+            auto p = RecurringPaymentInfo::fromJson(k.toObject());
+            payments.insert(p.getHash(), p);
+            entries.push_back(QPair<QString, QByteArray>(p.getHash(), QJsonDocument(k.toObject()).toJson(QJsonDocument::Compact)));
+        }
 
-    QJsonArray arr;
-    for (auto v : payments.values()) {
-        arr.append(v.toJson());
+        store->replaceAll(entries);
+    }
+    else {
+        for (const auto& k : store->getAll()) {
+            auto p = RecurringPaymentInfo::fromJson(QJsonDocument::fromJson(k.second).object());
+            payments.insert(p.getHash(), p);
+        }
     }
 
-    QTextStream out(&file);   
-    out << QJsonDocument(arr).toJson();
+    rescheduleAll();
+}
 
-    file.close();
+// Save a single recurring payment. Only that payment is appended to the store's journal.
+void Recurring::writeToStorage(const QString& hash) {
+    JournaledStore::forFile(writeableFile())->put(hash, QJsonDocument(payments[hash].toJson()).toJson(QJsonDocument::Compact));
 }
 
 /**
@@ -324,15 +340,80 @@ bool Recurring::updatePaymentItem(QString hash, int paymentNumber,
     payments[hash].payments[paymentNumber].err    = err;
     payments[hash].payments[paymentNumber].status = status;
 
-    // Upda teht file on disk
-    writeToStorage();
-
-    // Then read it back to refresh the hashes
-    readFromStorage();
+    // Update the file on disk. The hash doesn't depend on the payment items, so there's no need
+    // to read it back.
+    writeToStorage(hash);
+    reschedule(hash);
 
     return true;
 }
 
+Recurring::Recurring() {
+    dueTimer = new QTimer();
+    dueTimer->setSingleShot(true);
+    QObject::connect(dueTimer, &QTimer::timeout, [=] () {
+        if (main != nullptr)
+            processPending(main);
+    });
+
+    batchTimer = new QTimer();
+    batchTimer->setSingleShot(true);
+    QObject::connect(batchTimer, &QTimer::timeout, [=] () {
+        sendBatchedPayments();
+    });
+}
+
+// Work out when the recurring payment with this hash is next due, and re-arm the timer if needed
+void Recurring::reschedule(const QString& hash) {
+    auto it = payments.constFind(hash);
+    if (it == payments.constEnd() || it->getNumPendingPayments() == 0) {
+        nextDue.remove(hash);
+    }
+    else {
+        auto due = it->getNextPayment().toSecsSinceEpoch();
+        if (nextDue.value(hash, -1) != due) {
+            nextDue.insert(hash, due);
+            dueHeap.push(DueEntry(due, hash));
+        }
+    }
+
+    armDueTimer();
+}
+
+void Recurring::rescheduleAll() {
+    nextDue.clear();
+    dueHeap = decltype(dueHeap)();
+
+    for (auto it = payments.constBegin(); it != payments.constEnd(); ++it) {
+        if (it->getNumPendingPayments() == 0)
+            continue;
+
+        auto due = it->getNextPayment().toSecsSinceEpoch();
+        nextDue.insert(it.key(), due);
+        dueHeap.push(DueEntry(due, it.key()));
+    }
+
+    armDueTimer();
+}
+
+// Set the timer to go off when the earliest payment is due
+void Recurring::armDueTimer() {
+    // Drop entries that were rescheduled or removed since they were pushed
+    while (!dueHeap.empty() && nextDue.value(dueHeap.top().second, -1) != dueHeap.top().first) {
+        dueHeap.pop();
+    }
+
+    if (dueHeap.empty()) {
+        dueTimer->stop();
+        return;
+    }
+
+    // QTimer takes an int of msecs, so wake up at least once a day and check again
+    auto secs = dueHeap.top().first - QDateTime::currentSecsSinceEpoch();
+    secs = std::max((qint64)0, std::min(secs, (qint64)24 * 60 * 60));
+    dueTimer->start(secs * 1000);
+}
+
 Recurring* Recurring::getInstance() {
     if (!instance) { 
         instance = new Recurring(); 
@@ -349,6 +430,8 @@ Recurring* Recurring::instance = nullptr;
  * Main worker method that will go over all the recurring paymets and process any pending ones
  */
 void Recurring::processPending(MainWindow* main) {
+    this->main = main;
+
     // Refuse to run on mainnet
     if (!Settings::getInstance()->isTestnet())
         return;
@@ -356,8 +439,27 @@ void Recurring::processPending(MainWindow* main) {
     if (!main->isPaymentsReady())
         return;
 
-    // For each recurring payment
-    for (auto rpi: payments.values()) {
+    // Pull all the recurring payments that are due off the heap. Nothing is due most of the time, so this is
+    // usually just a look at the top of the heap.
+    auto now = QDateTime::currentSecsSinceEpoch();
+    QList<QString> due;
+    while (!dueHeap.empty() && dueHeap.top().first <= now) {
+        auto entry = dueHeap.top();
+        dueHeap.pop();
+
+        if (nextDue.value(entry.second, -1) == entry.first) {
+            nextDue.remove(entry.second);
+            due.append(entry.second);
+        }
+    }
+
+    // For each recurring payment that is due
+    for (auto hash: due) {
+        if (!payments.contains(hash))
+            continue;
+
+        auto rpi = payments[hash];
+
         // Collect all pending payments that are past due
         QList<RecurringPaymentInfo::PaymentItem> pending;
 
@@ -379,7 +481,12 @@ void Recurring::processPending(MainWindow* main) {
             // Options are: Pay latest one, Pay all or Pay none.
             processMultiplePending(rpi, main);
         }
+
+        // Updating the payment items reschedules it, but make sure it's back on the heap either way
+        reschedule(hash);
     }
+
+    armDueTimer();
 }
 
 /**
@@ -476,54 +583,102 @@ void Recurring::executeRecurringPayment(MainWindow* main, RecurringPaymentInfo r
         amt = rpi.amt / Settings::getInstance()->getZECPrice();
     }
 
-    // Build a Tx
-    Tx tx;
-    tx.fromAddr = rpi.fromAddr;
-    tx.fee      = Settings::getMinerFee();
-    
     // If this is a multiple payment, we'll add up all the amounts
     if (paymentNumbers.size() > 1)
         amt *= paymentNumbers.size();
 
-    tx.toAddrs.append(ToFields { rpi.toAddr, amt, rpi.memo, rpi.memo.toUtf8().toHex() });
-
-    // To prevent some weird race conditions, we immediately mark the payment as paid.
-    // If something goes wrong, we'll get the error callback below, and the status will be 
-    // updated. If it succeeds, we'll once again update the status with the txid
+    // Mark the payments as queued right away, so they aren't picked up again while they wait for the batch.
+    // They are only marked as paid once the Tx has been computed.
     for (int paymentNumber: paymentNumbers) {
-        updatePaymentItem(rpi.getHash(), paymentNumber, "", "", PaymentStatus::COMPLETED);
+        updatePaymentItem(rpi.getHash(), paymentNumber, "", "", PaymentStatus::QUEUED);
     }            
 
-    // Send it off to the RPC
-    doSendTx(main, tx, [=] (QString txid, QString err) {
-        if (err.isEmpty()) {
-            // Success, update the rpi
-            for (int paymentNumber: paymentNumbers) {
-                updatePaymentItem(rpi.getHash(), paymentNumber, txid, "", PaymentStatus::COMPLETED);
-            }            
-        } else {
-            // Errored out. Bummer.
-            for (int paymentNumber: paymentNumbers) {
-                updatePaymentItem(rpi.getHash(), paymentNumber, "", err, PaymentStatus::ERROR);
+    // Queue it up with any other payments from the same address, so they can share a Tx (and a proof)
+    batches[rpi.fromAddr].append(BatchedPayment { rpi.getHash(), rpi.toAddr, rpi.memo, Amount::fromDouble(amt), paymentNumbers });
+
+    this->main = main;
+    if (!batchTimer->isActive())
+        batchTimer->start(batchWindowMs);
+}
+
+void Recurring::sendBatchedPayments() {
+    if (main == nullptr)
+        return;
+
+    auto allBatches = batches;
+    batches.clear();
+
+    for (auto it = allBatches.constBegin(); it != allBatches.constEnd(); ++it) {
+        auto remaining = it.value();
+
+        while (!remaining.isEmpty()) {
+            // Build a Tx with as many of the payments as it can take. z_sendmany doesn't allow the same 
+            // address twice, so payments to an address that's already in the Tx wait for the next one.
+            Tx tx;
+            tx.fromAddr = it.key();
+            tx.fee      = Settings::getMinerFee();
+
+            QList<BatchedPayment> included;
+            QList<BatchedPayment> deferred;
+            QSet<QString>         toAddrs;
+            for (const auto& payment : remaining) {
+                if (tx.toAddrs.size() >= Settings::getMaxTxRecipients() || toAddrs.contains(payment.toAddr)) {
+                    deferred.append(payment);
+                    continue;
+                }
+
+                toAddrs.insert(payment.toAddr);
+                tx.toAddrs.append(ToFields { payment.toAddr, payment.amount, payment.memo, payment.memo.toUtf8().toHex() });
+                included.append(payment);
             }
+            remaining = deferred;
+
+            // Send it off to the RPC, and map the result back to every payment in it
+            doSendTx(main, tx, [=] () {
+                for (const auto& payment : included) {
+                    for (int paymentNumber: payment.paymentNumbers) {
+                        updatePaymentItem(payment.hash, paymentNumber, "", "", PaymentStatus::SENDING);
+                    }
+                }
+            }, [=] (QString txid, QString err, bool unknown) {
+                for (const auto& payment : included) {
+                    for (int paymentNumber: payment.paymentNumbers) {
+                        if (err.isEmpty()) {
+                            // Success, update the rpi
+                            updatePaymentItem(payment.hash, paymentNumber, txid, "", PaymentStatus::COMPLETED);
+                        } else if (unknown) {
+                            // zerod lost track of it, so it may have been paid
+                            updatePaymentItem(payment.hash, paymentNumber, "", err, PaymentStatus::UNKNOWN);
+                        } else {
+                            // Errored out. Bummer.
+                            updatePaymentItem(payment.hash, paymentNumber, "", err, PaymentStatus::ERROR);
+                        }
+                    }
+                }
+            });
         }
-    });
+    }
 }
 
 /**
  * Execute a send Tx
  */ 
-void Recurring::doSendTx(MainWindow* mainwindow, Tx tx, std::function<void(QString, QString)> cb) {
+void Recurring::doSendTx(MainWindow* mainwindow, Tx tx, std::function<void(void)> submitted, std::function<void(QString, QString, bool)> cb) {
     mainwindow->getRPC()->executeTransaction(tx, [=] (QString opid) {
             mainwindow->ui->statusBar->showMessage(QObject::tr("Computing Recurring Tx: ") % opid);
+            submitted();
         },
         [=] (QString /*opid*/, QString txid) { 
             mainwindow->ui->statusBar->showMessage(Settings::txidStatusMessage + " " + txid);
-            cb(txid, "");
+            cb(txid, "", false);
         },
         [=] (QString opid, QString errStr) {
             mainwindow->ui->statusBar->showMessage(QObject::tr(" Tx ") % opid % QObject::tr(" failed"), 15 * 1000);
-            cb("", errStr);
+            cb("", errStr, false);
+        },
+        BackgroundTxPriority,
+        [=] (QString, QString errStr) {
+            cb("", errStr, true);
         });
     
 }
@@ -724,6 +879,8 @@ QVariant RecurringPaymentsListViewModel::data(const QModelIndex &index, int role
                     case PaymentStatus::COMPLETED:   return tr("Paid");
                     case PaymentStatus::ERROR:       return tr("Error");
                     case PaymentStatus::UNKNOWN:     return tr("Unknown");
+                    case PaymentStatus::QUEUED:      return tr("Queued");
+                    case PaymentStatus::SENDING:     return tr("Sending");
                     default:                         return tr("Unknown");
                 }
             }
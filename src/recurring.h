@@ -24,7 +24,9 @@ enum PaymentStatus {
     SKIPPED,
     COMPLETED,
     ERROR,
-    UNKNOWN
+    UNKNOWN,
+    QUEUED,         // Waiting to be batched and handed to zerod. Retried if the wallet closes before it was.
+    SENDING         // Handed to zerod, waiting for the Tx to be computed
 };
 
 QString schedule_desc(Schedule s);
@@ -91,7 +93,7 @@ public:
     void        addRecurringInfo(const RecurringPaymentInfo& rpi);
     void        removeRecurringInfo(QString hash);
 
-    void        writeToStorage();
+    void        writeToStorage(const QString& hash);
     void        readFromStorage();
 
     // Worker method that goes through all pending recurring payments to see if any 
@@ -99,19 +101,50 @@ public:
     void        processPending(MainWindow* main);
     // If multiple are pending, we need to ask the user
     void        processMultiplePending(RecurringPaymentInfo rpi, MainWindow* main);
-    // Execute a particular payment item
+    // Execute a particular payment item. The payment is queued, and sent along with any other
+    // payments from the same address that come due within the batching window.
     void        executeRecurringPayment(MainWindow *, RecurringPaymentInfo rpi, QList<int> paymentNumber);
+    // Send all the queued payments, one Tx per from address (or more, if there are too many recipients)
+    void        sendBatchedPayments();
 
-    // Execute a Tx
-    void        doSendTx(MainWindow* rpc, Tx tx, std::function<void(QString, QString)> cb);
+    // Execute a Tx. submitted is called once zerod has accepted it, and cb when it's done.
+    void        doSendTx(MainWindow* rpc, Tx tx, std::function<void(void)> submitted, std::function<void(QString, QString, bool)> cb);
 
     bool updatePaymentItem(QString hash, int paymentNumber, QString txid, QString err, PaymentStatus status);
 
     QList<RecurringPaymentInfo> getAsList() { return payments.values(); }
 private:
-    Recurring() = default;
+    Recurring();
+
+    // Scheduling of the next due payment of each recurring payment
+    void        reschedule(const QString& hash);
+    void        rescheduleAll();
+    void        armDueTimer();
+
     QMap<QString, RecurringPaymentInfo> payments;
 
+    // Min-heap of (due time in secs since epoch, hash). An entry is stale, and is skipped, if it no longer
+    // matches nextDue, so rescheduling is just a push.
+    typedef QPair<qint64, QString> DueEntry;
+    std::priority_queue<DueEntry, std::vector<DueEntry>, std::greater<DueEntry>> dueHeap;
+    QHash<QString, qint64>  nextDue;        // hash -> due time of its first NOT_STARTED payment
+    QTimer*                 dueTimer        = nullptr;
+    MainWindow*             main            = nullptr;
+
+    // Payments waiting to be sent, batched by from address
+    struct BatchedPayment {
+        QString     hash;
+        QString     toAddr;
+        QString     memo;
+        Amount      amount;
+        QList<int>  paymentNumbers;
+    };
+
+    QMap<QString, QList<BatchedPayment>>    batches;
+    QTimer*                                 batchTimer  = nullptr;
+
+    static const int batchWindowMs      = 5 * 1000;
+
     static Recurring* instance;
 };
 
@@ -1,13 +1,18 @@
 #include "rpc.h"
 
 #include "addressbook.h"
+#include "addresslistmodel.h"
+#include "prooftimes.h"
 #include "settings.h"
+#include "trace.h"
 #include "turnstile.h"
 #include "version.h"
 #include "websockets.h"
 
 using json = nlohmann::json;
 
+const int RPC::maxOpPollInterval;
+
 QString convertSecondsToDays(qint64 n) {
     QString activeDays = "";
 
@@ -58,7 +63,10 @@ RPC::RPC(MainWindow* main) {
     //Local ZeroNodes
     localZeroNodesTableModel = new LocalZNTableModel(ui->tableZeroNodeLocal);
     main->ui->tableZeroNodeLocal->setModel(localZeroNodesTableModel);
-    Settings::getInstance()->autoDetectZeroNodeConf(localZeroNodesTableModel);
+    {
+        TraceSpan span("Detect ZeroNode conf");
+        Settings::getInstance()->autoDetectZeroNodeConf(localZeroNodesTableModel);
+    }
 
     // Set up timer to refresh Price
     priceTimer = new QTimer(main);
@@ -98,7 +106,6 @@ RPC::~RPC() {
     delete balancesTableModel;
     delete turnstile;
 
-    delete utxos;
     delete balancesOverview;
     delete usedAddresses;
     delete zaddresses;
@@ -140,6 +147,10 @@ void RPC::setConnection(Connection* c) {
     // Force update, because this might be coming from a settings update
     // where we need to immediately refresh
     refresh(true);
+
+    // If zerod was restarted, it has forgotten about the ops we were watching
+    if (!watchingOps.isEmpty())
+        checkLostOps(watchingOps.keys());
 }
 
 void RPC::startZeroNodeAll (const std::function<void(json)>& cb) {
@@ -468,9 +479,9 @@ void RPC::fillTxJsonParams(json& params, Tx tx) {
         // Construct the JSON params
         json rec = json::object();
         rec["address"]      = toAddr.addr.toStdString();
-        // Force it through string for rounding. Without this, decimal points beyond 8 places
+        // Send it as a decimal string. Without this, decimal points beyond 8 places
         // will appear, causing an "invalid amount" error
-        rec["amount"]       = Settings::getDecimalString(toAddr.amount).toStdString(); //.toDouble();
+        rec["amount"]       = toAddr.amount.toDecimalString().toStdString();
         if (Settings::isZAddress(toAddr.addr) && !toAddr.encodedMemo.trimmed().isEmpty())
             rec["memo"]     = toAddr.encodedMemo.toStdString();
 
@@ -484,7 +495,7 @@ void RPC::fillTxJsonParams(json& params, Tx tx) {
     // Add fees if custom fees are allowed.
     if (Settings::getInstance()->getAllowCustomFees()) {
         params.push_back(1); // minconf
-        params.push_back(tx.fee);
+        params.push_back(tx.fee.toDecimalDouble());
     }
 }
 
@@ -498,9 +509,8 @@ void RPC::noConnection() {
     main->ui->statusBar->showMessage(QObject::tr("No Connection"), 1000);
 
     // Clear balances table.
-    QMap<QString, double> emptyBalances;
-    QList<UnspentOutput>  emptyOutputs;
-    balancesOverviewTableModel->setNewData(&emptyBalances, &emptyOutputs);
+    QMap<QString, Amount> emptyBalances;
+    balancesOverviewTableModel->setNewData(&emptyBalances, std::make_shared<UTXOIndex>());
 
     // Clear balances table.
     QList<allBalances>  emptyAllBalances;
@@ -523,8 +533,8 @@ void RPC::noConnection() {
     ui->balTotal->setToolTip("");
     ui->balUSDTotal->setToolTip("");
 
-    // Clear send tab from address
-    ui->inputsCombo->clear();
+    // Clear the address combos
+    AddressListModel::getInstance()->clear();
 }
 
 /// This will refresh all the balance data from zerod
@@ -835,12 +845,10 @@ void RPC::refreshGZeroNodes() {
     getGZeroNodeList([=] (json reply) {
         QList<GlobalZeroNodes> gzndata;
 
-        for (auto& it : reply.get<json::array_t>()) {
+        gzndata.reserve(reply.size());
 
-            QDateTime lastSeen;
-            QDateTime lastPaid;
-            lastSeen.setTime_t(it["lastseen"].get<json::number_unsigned_t>());
-            lastPaid.setTime_t(it["lastpaid"].get<json::number_unsigned_t>());
+        for (auto& it : reply.get<json::array_t>()) {
+            auto txhash = QString::fromStdString(it["txhash"]);
 
             GlobalZeroNodes gzn{
                 (qint64)it["rank"].get<json::number_unsigned_t>(),
@@ -848,18 +856,17 @@ void RPC::refreshGZeroNodes() {
                 (qint64)it["version"].get<json::number_unsigned_t>(),
                 QString::fromStdString(it["status"].get<json::string_t>()),
                 (qint64)it["activetime"].get<json::number_unsigned_t>(),
-                (QString)lastSeen.toString("MM/dd/yyyy hh:mm"),
-                (QString)lastPaid.toString("MM/dd/yyyy hh:mm"),
-                QString::fromStdString(it["txhash"]),
+                (qint64)it["lastseen"].get<json::number_unsigned_t>(),
+                (qint64)it["lastpaid"].get<json::number_unsigned_t>(),
+                txhash,
                 QString::fromStdString(it["ip"]),
-                localZeroNodesTableModel->isLocal(QString::fromStdString(it["txhash"]))
+                localZeroNodesTableModel->isLocal(txhash)
                 };
 
             gzndata.push_back(gzn);
-
         }
 
-        // Update model data, which updates the table view
+        // Update model data, which diffs against the previous list and updates the table view
         globalZeroNodesTableModel->addGlobalZNData(gzndata);
     });
 
@@ -917,51 +924,26 @@ void RPC::getZNPrivateKey(Ui_znsetup* zn) {
     });
 }
 
-void RPC::getZNOutputs(Ui_znsetup* zn, QList<ZNOutputs>* outputs, QList<LocalZeroNodes>* znData) {
+void RPC::getZNOutputs(Ui_znsetup* zn, QList<ZNOutputs>* outputs) {
 
     if (conn == nullptr)
         return noConnection();
 
     getZeroNodeOutputs([=] (json reply) {
-        auto newOutputs = new QList<ZNOutputs>;
+        outputs->clear();
         for (auto& it : reply.get<json::array_t>()) {
 
             ZNOutputs newOutput{
                 QString::fromStdString(it["txhash"]),
                 (qint64)it["outputidx"].get<json::number_unsigned_t>()
             };
-            newOutputs->push_back(newOutput);
-        }
 
-
-        auto usedOutputs = new QList<ZNOutputs>;
-        for(auto& it: *znData) {
-          ZNOutputs usedOutput {
-            it.txid,
-            it.index
-          };
-          usedOutputs->push_back(usedOutput);
-        }
-
-        outputs->clear();
-        for (auto& it: *newOutputs) {
-            bool isUsed = false;
-
-            for (auto& uit: *usedOutputs) {
-                if (it.txid == uit.txid && it.index == uit.index) {
-                    isUsed = true;
-                    continue;
-                }
-            }
-            if (!isUsed)
-              outputs->push_back(it);
+            // Skip outputs that are already used by one of our zeronodes
+            if (!isZeroNodeOutput(newOutput.txid, newOutput.index))
+                outputs->push_back(newOutput);
         }
 
         localZeroNodesTableModel->updateZNOutput(zn);
-
-        delete usedOutputs;
-        delete newOutputs;
-
     });
 }
 
@@ -980,6 +962,7 @@ void RPC::refreshAddresses() {
         delete zaddresses;
         zaddresses = newzaddresses;
 
+        AddressListModel::getInstance()->addAddresses(*zaddresses);
     });
 
 
@@ -994,11 +977,15 @@ void RPC::refreshAddresses() {
         delete taddresses;
         taddresses = newtaddresses;
 
+        AddressListModel::getInstance()->addAddresses(*taddresses);
+
         // If there are no t Addresses, create one
         if (taddresses->size() == 0) {
             newTaddr([=] (json reply) {
                 // What if taddress gets deleted before this executes?
-                taddresses->append(QString::fromStdString(reply.get<json::string_t>()));
+                auto addr = QString::fromStdString(reply.get<json::string_t>());
+                taddresses->append(addr);
+                AddressListModel::getInstance()->addNewAddress(addr);
             });
         }
 
@@ -1007,18 +994,24 @@ void RPC::refreshAddresses() {
 
 // Function to create the data model and update the views, used below.
 void RPC::updateUI(bool anyUnconfirmed) {
+    TraceSpan span("RPC::updateUI");
+
     ui->unconfirmedWarning->setVisible(anyUnconfirmed);
 
     // Update balances model data, which will update the table too
     balancesOverviewTableModel->setNewData(balancesOverview, utxos);
     balancesTableModel->setNewData(addressBalances);
+    AddressListModel::getInstance()->setBalances(balancesOverview);
 
     // Update from address
     main->updateFromCombo();
+
+    // Push the new balances to the mobile app
+    AppDataServer::getInstance()->infoChanged(main);
 };
 
 // Function to process reply of the listunspent and z_listunspent API calls, used below.
-bool RPC::processUnspent(const json& reply, QMap<QString, double>* balancesMap, QList<UnspentOutput>* newUtxos) {
+bool RPC::processUnspent(const json& reply, QMap<QString, Amount>* balancesMap, UTXOIndex* newUtxos) {
     bool anyUnconfirmed = false;
     for (auto& it : reply.get<json::array_t>()) {
         QString qsAddr = QString::fromStdString(it["address"]);
@@ -1027,12 +1020,13 @@ bool RPC::processUnspent(const json& reply, QMap<QString, double>* balancesMap,
             anyUnconfirmed = true;
         }
 
-        newUtxos->push_back(
+        auto amount = Amount::fromDouble(it["amount"].get<json::number_float_t>());
+        newUtxos->add(
             UnspentOutput{ qsAddr, QString::fromStdString(it["txid"]),
-                            Settings::getDecimalString(it["amount"].get<json::number_float_t>()),
+                            amount,
                             (int)confirmations, it["spendable"].get<json::boolean_t>() });
 
-        (*balancesMap)[qsAddr] = (*balancesMap)[qsAddr] + it["amount"].get<json::number_float_t>();
+        (*balancesMap)[qsAddr] += amount;
     }
     return anyUnconfirmed;
 };
@@ -1083,37 +1077,40 @@ void RPC::refreshGetAllData() {
     if  (conn == nullptr)
         return noConnection();
 
+    auto traceStart = Trace::now();
+
     getAllData([=] (json reply) {
+        TraceSpan span("Process getalldata");
 
         // 1. Update Balance Data
-        auto balImmature          = QString::fromStdString(reply["immaturebalance"]).toDouble();
-        auto balLocked            = QString::fromStdString(reply["lockedbalance"]).toDouble();
-        auto balT                 = QString::fromStdString(reply["transparentbalance"]).toDouble();
-        auto balTUnconfirmed      = QString::fromStdString(reply["transparentbalanceunconfirmed"]).toDouble();
-        auto balZ                 = QString::fromStdString(reply["privatebalance"]).toDouble();
-        auto balZUnconfirmed      = QString::fromStdString(reply["privatebalanceunconfirmed"]).toDouble();
-        auto balTotal             = QString::fromStdString(reply["totalbalance"]).toDouble();
-        auto balTotalUnconfirmed  = QString::fromStdString(reply["totalunconfirmed"]).toDouble();
-
-
-        AppDataModel::getInstance()->setBalances(balT + balTUnconfirmed, balZ + balZUnconfirmed);
-
-        ui->balImmature       ->setText(Settings::getZECDisplayFormat(balImmature));
-        ui->balLocked         ->setText(Settings::getZECDisplayFormat(balLocked));
-        ui->balUnconfirmed    ->setText(Settings::getZECDisplayFormat(balTUnconfirmed + balZUnconfirmed));
-        ui->balSheilded       ->setText(Settings::getZECDisplayFormat(balZ));
-        ui->balTransparent    ->setText(Settings::getZECDisplayFormat(balT));
-        ui->balTotal          ->setText(Settings::getZECDisplayFormat(balTotal + balTotalUnconfirmed + balLocked + balImmature));
-
-        ui->balImmature       ->setToolTip(Settings::getZECDisplayFormat(balImmature));
-        ui->balLocked         ->setToolTip(Settings::getZECDisplayFormat(balLocked));
-        ui->balUnconfirmed    ->setToolTip(Settings::getZECDisplayFormat(balTUnconfirmed + balZUnconfirmed));
-        ui->balSheilded       ->setToolTip(Settings::getZECDisplayFormat(balZ));
-        ui->balTransparent    ->setToolTip(Settings::getZECDisplayFormat(balT));
-        ui->balTotal          ->setToolTip(Settings::getZECDisplayFormat(balTotal + balTotalUnconfirmed + balLocked + balImmature));
-
-        ui->balUSDTotal       ->setText(Settings::getUSDFromZecAmount(balTotal + balTotalUnconfirmed + balLocked + balImmature));
-        ui->balUSDTotal       ->setToolTip(Settings::getUSDFromZecAmount(balTotal + balTotalUnconfirmed + balLocked + balImmature));
+        auto balImmature          = Amount::fromDecimalString(QString::fromStdString(reply["immaturebalance"]));
+        auto balLocked            = Amount::fromDecimalString(QString::fromStdString(reply["lockedbalance"]));
+        auto balT                 = Amount::fromDecimalString(QString::fromStdString(reply["transparentbalance"]));
+        auto balTUnconfirmed      = Amount::fromDecimalString(QString::fromStdString(reply["transparentbalanceunconfirmed"]));
+        auto balZ                 = Amount::fromDecimalString(QString::fromStdString(reply["privatebalance"]));
+        auto balZUnconfirmed      = Amount::fromDecimalString(QString::fromStdString(reply["privatebalanceunconfirmed"]));
+        auto balTotal             = Amount::fromDecimalString(QString::fromStdString(reply["totalbalance"]));
+        auto balTotalUnconfirmed  = Amount::fromDecimalString(QString::fromStdString(reply["totalunconfirmed"]));
+        auto balAll               = balTotal + balTotalUnconfirmed + balLocked + balImmature;
+
+        AppDataModel::getInstance()->setBalances((balT + balTUnconfirmed).toDecimalDouble(), (balZ + balZUnconfirmed).toDecimalDouble());
+
+        ui->balImmature       ->setText(balImmature.toDecimalZECString());
+        ui->balLocked         ->setText(balLocked.toDecimalZECString());
+        ui->balUnconfirmed    ->setText((balTUnconfirmed + balZUnconfirmed).toDecimalZECString());
+        ui->balSheilded       ->setText(balZ.toDecimalZECString());
+        ui->balTransparent    ->setText(balT.toDecimalZECString());
+        ui->balTotal          ->setText(balAll.toDecimalZECString());
+
+        ui->balImmature       ->setToolTip(balImmature.toDecimalZECString());
+        ui->balLocked         ->setToolTip(balLocked.toDecimalZECString());
+        ui->balUnconfirmed    ->setToolTip((balTUnconfirmed + balZUnconfirmed).toDecimalZECString());
+        ui->balSheilded       ->setToolTip(balZ.toDecimalZECString());
+        ui->balTransparent    ->setToolTip(balT.toDecimalZECString());
+        ui->balTotal          ->setToolTip(balAll.toDecimalZECString());
+
+        ui->balUSDTotal       ->setText(balAll.toDecimalUSDString());
+        ui->balUSDTotal       ->setToolTip(balAll.toDecimalUSDString());
 
         //Update data for Balances Tab
         auto newAddressBalances = new QList<allBalances>;
@@ -1122,16 +1119,14 @@ void RPC::refreshGetAllData() {
         {
             allBalances newAddressBalance;
             newAddressBalance.address = QString::fromStdString(it.key());
-            newAddressBalance.confirmed = QString::number(it.value()["amount"].get<double>(),'f', 8);
-            newAddressBalance.unconfirmed = QString::number(it.value()["unconfirmed"].get<double>(),'f', 8);
-            newAddressBalance.immature = QString::number(it.value()["immature"].get<double>(),'f', 8);
-            newAddressBalance.locked = QString::number(it.value()["locked"].get<double>(),'f', 8);
+            newAddressBalance.confirmed = Amount::fromDouble(it.value()["amount"].get<double>());
+            newAddressBalance.unconfirmed = Amount::fromDouble(it.value()["unconfirmed"].get<double>());
+            newAddressBalance.immature = Amount::fromDouble(it.value()["immature"].get<double>());
+            newAddressBalance.locked = Amount::fromDouble(it.value()["locked"].get<double>());
             newAddressBalance.watch = QString::number(it.value()["spendable"].get<json::boolean_t>());
-            double totalBalance = it.value()["amount"].get<double>();
-            totalBalance += it.value()["unconfirmed"].get<double>();
-            totalBalance += it.value()["immature"].get<double>();
-            totalBalance += it.value()["locked"].get<double>();
-            if (totalBalance > 0.0) {
+            auto totalBalance = newAddressBalance.confirmed + newAddressBalance.unconfirmed +
+                                newAddressBalance.immature + newAddressBalance.locked;
+            if (totalBalance > Amount()) {
                 newAddressBalances->append(newAddressBalance);
             }
         }
@@ -1213,39 +1208,75 @@ void RPC::refreshGetAllData() {
         }
         // Update model data, which updates the table view
         transactionsTableModel->addTData(txdata);
+        AppDataServer::getInstance()->transactionsChanged(transactionsTableModel);
     });
 
 
     // 3. Get the UTXOs
-    // First, create a new UTXO list. It will be replacing the existing list when everything is processed.
-    auto newUtxos = new QList<UnspentOutput>();
-    auto newBalances = new QMap<QString, double>();
+    // First, create a new UTXO index. It will be replacing the existing index when everything is processed.
+    auto newUtxos = std::make_shared<UTXOIndex>();
+    auto newBalances = new QMap<QString, Amount>();
 
     // Call the Transparent and Z unspent APIs serially and then, once they're done, update the UI
     getTransparentUnspent([=] (json reply) {
-        auto anyTUnconfirmed = processUnspent(reply, newBalances, newUtxos);
+        TraceSpan span("Process listunspent");
+        auto anyTUnconfirmed = processUnspent(reply, newBalances, newUtxos.get());
 
         getZUnspent([=] (json reply) {
-            auto anyZUnconfirmed = processUnspent(reply, newBalances, newUtxos);
+            TraceSpan span("Process z_listunspent");
+            auto anyZUnconfirmed = processUnspent(reply, newBalances, newUtxos.get());
 
             // Swap out the balances and UTXOs
             delete balancesOverview;
-            delete utxos;
 
             balancesOverview = newBalances;
             utxos       = newUtxos;
+            walletSummary    = summarize(*newBalances);
 
             updateUI(anyTUnconfirmed || anyZUnconfirmed);
+            Trace::since("Refresh balances", traceStart);
 
             main->balancesReady();
         });
     });
 }
 
+WalletSummary RPC::summarize(const QMap<QString, Amount>& balances) {
+    WalletSummary summary;
+    Amount        maxZ, maxT;
+
+    for (auto it = balances.constBegin(); it != balances.constEnd(); it++) {
+        const auto& addr = it.key();
+        const auto& bal  = it.value();
+
+        if (bal > summary.maxSpendable)
+            summary.maxSpendable = bal;
+
+        if (Settings::isZAddress(addr)) {
+            if (bal > maxZ) {
+                maxZ = bal;
+                summary.maxZAddr = addr;
+            }
+            if (bal > summary.maxZSpendable && Settings::getInstance()->isSaplingAddress(addr))
+                summary.maxZSpendable = bal;
+        } else if (bal > maxT) {
+            maxT = bal;
+            summary.maxTAddr = addr;
+        }
+    }
+
+    return summary;
+}
+
 void RPC::addNewTxToWatch(const QString& newOpid, WatchedTx wtx) {
+    // Proving takes a while, so there is no point asking about the op straight away
+    wtx.submittedAt  = QDateTime::currentMSecsSinceEpoch();
+    wtx.estimate     = ProofTimes::getInstance()->estimate(wtx.tx);
+    wtx.pollInterval = Settings::quickUpdateSpeed;
+    wtx.nextPoll     = wtx.submittedAt + wtx.pollInterval;
     watchingOps.insert(newOpid, wtx);
 
-    watchTxStatus();
+    updateWatchingOps();
 }
 
 /**
@@ -1271,84 +1302,359 @@ void RPC::executeStandardUITransaction(Tx tx) {
     );
 }
 
-// Execute a transaction!
+/**
+ * Queue a transaction to be sent. Every send makes zerod compute a proof on the CPU, so only getProvingSlots()
+ * sends are handed to zerod at a time, and the rest wait here, user sends first. A slot is used from the time
+ * z_sendmany is called until the operation finishes.
+ *
+ * If zerod forgets the operation before we hear how it went, it may or may not have been sent. lost is called for
+ * that, or error if there's no lost.
+ */
 void RPC::executeTransaction(Tx tx,
         const std::function<void(QString opid)> submitted,
         const std::function<void(QString opid, QString txid)> computed,
-        const std::function<void(QString opid, QString errStr)> error) {
-    // First, create the json params
-    json params = json::array();
-    fillTxJsonParams(params, tx);
-    std::cout << std::setw(2) << params << std::endl;
-
-    sendZTransaction(params, [=](const json& reply) {
-        QString opid = QString::fromStdString(reply.get<json::string_t>());
-
-        // And then start monitoring the transaction
-        addNewTxToWatch( opid, WatchedTx { opid, tx, computed, error} );
-        submitted(opid);
-    },
-    [=](QString errStr) {
-        error("", errStr);
-    });
+        const std::function<void(QString opid, QString errStr)> error,
+        TxPriority priority,
+        const std::function<void(QString opid, QString errStr)> lost) {
+    sendQueue[priority].enqueue(QueuedTx { tx, submitted, computed, error, lost,
+                                           QDateTime::currentMSecsSinceEpoch(), ProofTimes::getInstance()->estimate(tx) });
+
+    sendQueuedTxs();
 }
 
+int RPC::getProvingSlots() {
+    int slots = Settings::getInstance()->getProvingSlots();
+    if (slots > 0)
+        return slots;
 
+    // Each proof already uses several threads
+    return std::max(1, QThread::idealThreadCount() / 4);
+}
+
+int RPC::getQueuedTxCount() {
+    int count = 0;
+    for (const auto& q : sendQueue) {
+        count += q.size();
+    }
+    return count;
+}
+
+void RPC::sendQueuedTxs() {
+    if (conn == nullptr)
+        return;
+
+    auto now  = QDateTime::currentMSecsSinceEpoch();
+    int  busy = std::count_if(watchingOps.begin(), watchingOps.end(), [=] (const auto& wtx) { return holdsProvingSlot(wtx, now); });
+
+    while (submitting + busy < getProvingSlots()) {
+        auto q = std::find_if(std::begin(sendQueue), std::end(sendQueue), [] (const auto& pending) { return !pending.isEmpty(); });
+        if (q == std::end(sendQueue))
+            break;
+
+        // Within a priority, the quickest proof goes first
+        auto first = std::min_element(q->begin(), q->end(), [=] (const auto& a, const auto& b) { return sendsBefore(a, b, now); });
+        auto next  = *first;
+        q->erase(first);
+
+        // First, create the json params
+        json params = json::array();
+        fillTxJsonParams(params, next.tx);
+        std::cout << std::setw(2) << params << std::endl;
+
+        submitting++;
+        sendZTransaction(params, [=](const json& reply) {
+            QString opid = QString::fromStdString(reply.get<json::string_t>());
+            submitting--;
+
+            // And then start monitoring the transaction
+            addNewTxToWatch( opid, WatchedTx { opid, next.tx, next.computed, next.error, next.lost } );
+            next.submitted(opid);
+
+            AppDataServer::getInstance()->opChanged(this, opid, "computing", "", "");
+        },
+        [=](QString errStr) {
+            submitting--;
+            next.error("", errStr);
+
+            sendQueuedTxs();
+        });
+    }
+
+    updateWatchingOps();
+}
+
+/**
+ * Ask zerod about the watched ops that are due. z_getoperationresult only returns the ops that have finished,
+ * and also removes them from zerod's list, so the reply stays small no matter how many ops are pending, and
+ * an op that isn't in the reply is still running. Each running op backs off on its own, so a long batch of sends
+ * doesn't turn into an RPC every few seconds for each one.
+ */
 void RPC::watchTxStatus() {
     if  (conn == nullptr)
         return noConnection();
 
-    // Make an RPC to load pending operation statues
+    auto now = QDateTime::currentMSecsSinceEpoch();
+
+    json opids = json::array();
+    for (auto& wtx : watchingOps) {
+        if (!wtx.polling && wtx.nextPoll <= now) {
+            wtx.polling = true;
+            opids.push_back(wtx.opid.toStdString());
+        }
+    }
+
+    if (opids.empty())
+        return updateWatchingOps();
+
+    json payload = {
+        {"jsonrpc", "1.0"},
+        {"id", "someid"},
+        {"method", "z_getoperationresult"},
+        {"params", {opids}}
+    };
+
+    conn->doRPC(payload, [=] (const json& reply) {
+        bool anySuccess = false;
+        for (auto& it : reply.get<json::array_t>()) {
+            opFinished(it, anySuccess);
+        }
+
+        // Whatever is left is still being computed, so ask about it less often
+        auto polled = QDateTime::currentMSecsSinceEpoch();
+        for (auto& opid : opids) {
+            auto it = watchingOps.find(QString::fromStdString(opid));
+            if (it == watchingOps.end())
+                continue;
+
+            it->polling      = false;
+            it->pollInterval = std::min(it->pollInterval * 3 / 2, maxOpPollInterval);
+            it->nextPoll     = polled + it->pollInterval;
+
+            // But don't sleep through the time it is expected to finish
+            auto expected = it->submittedAt + it->estimate;
+            if (expected > polled + Settings::quickUpdateSpeed && expected < it->nextPoll)
+                it->nextPoll = expected;
+        }
+
+        // Refresh balances to show unconfirmed balances
+        if (anySuccess)
+            refresh(true);
+
+        // An op that is long overdue might be one that zerod has forgotten about, so it would never finish
+        QList<QString> overdue;
+        for (auto& wtx : watchingOps) {
+            if (!wtx.checked && !holdsProvingSlot(wtx, polled)) {
+                wtx.checked = true;
+                overdue.append(wtx.opid);
+            }
+        }
+        if (!overdue.isEmpty())
+            checkLostOps(overdue);
+
+        // Finished and overdue ops free up their slots
+        sendQueuedTxs();
+    },
+    [=] (auto, auto) {
+        // Try these again on the next tick
+        for (auto& opid : opids) {
+            auto it = watchingOps.find(QString::fromStdString(opid));
+            if (it != watchingOps.end())
+                it->polling = false;
+        }
+
+        updateWatchingOps();
+    });
+}
+
+void RPC::opFinished(const json& result, bool& anySuccess) {
+    QString id = QString::fromStdString(result["id"]);
+    auto it = watchingOps.find(id);
+    if (it == watchingOps.end())
+        return;
+
+    auto wtx = it.value();
+    watchingOps.erase(it);
+
+    QString status = QString::fromStdString(result["status"]);
+    if (status == "success") {
+        auto txid = QString::fromStdString(result["result"]["txid"]);
+
+        // Remember how long it took, for the estimates. zerod's own timing leaves out the time we took to notice.
+        auto took = QDateTime::currentMSecsSinceEpoch() - wtx.submittedAt;
+        if (result.find("execution_secs") != result.end() && result["execution_secs"].is_number())
+            took = (qint64)(result["execution_secs"].get<double>() * 1000);
+        ProofTimes::getInstance()->record(wtx.tx, took);
+
+        wtx.completed(id, txid);
+        anySuccess = true;
+
+        AppDataServer::getInstance()->opChanged(this, id, status, txid, "");
+    } else if (status == "failed") {
+        // If it failed, then we'll actually show a warning.
+        auto errorMsg = QString::fromStdString(result["error"]["message"]);
+        wtx.error(id, errorMsg);
+
+        AppDataServer::getInstance()->opChanged(this, id, status, "", errorMsg);
+    } else {
+        wtx.error(id, QObject::tr("The operation was %1").arg(status));
+
+        AppDataServer::getInstance()->opChanged(this, id, status, "", "");
+    }
+}
+
+/**
+ * An op holds a proving slot while it's computing, but not once it's long overdue, so ops that zerod lost
+ * (because it restarted, or because the result was fetched but the reply never made it back) can't stall
+ * the send queue forever. An op is never overdue before minOverdueTime, so a low or stale estimate can't
+ * let more proofs run at once than there are slots.
+ */
+bool RPC::holdsProvingSlot(const WatchedTx& wtx, qint64 now) {
+    return now < wtx.submittedAt + std::max(wtx.estimate * overdueEstimates, (qint64)minOverdueTime);
+}
+
+// Ask zerod about the ops. The ones it doesn't know about anymore will never finish, so stop watching them.
+void RPC::checkLostOps(const QList<QString>& opids) {
+    json ids = json::array();
+    for (const auto& opid : opids) {
+        ids.push_back(opid.toStdString());
+    }
+
     json payload = {
         {"jsonrpc", "1.0"},
         {"id", "someid"},
         {"method", "z_getoperationstatus"},
+        {"params", {ids}}
     };
 
     conn->doRPCIgnoreError(payload, [=] (const json& reply) {
-        // There's an array for each item in the status
+        QSet<QString> known;
         for (auto& it : reply.get<json::array_t>()) {
-            // If we were watching this Tx and its status became "success", then we'll show a status bar alert
-            QString id = QString::fromStdString(it["id"]);
-            if (watchingOps.contains(id)) {
-                // And if it ended up successful
-                QString status = QString::fromStdString(it["status"]);
-                main->loadingLabel->setVisible(false);
-
-                if (status == "success") {
-                    auto txid = QString::fromStdString(it["result"]["txid"]);
-
-                    auto wtx = watchingOps[id];
-                    watchingOps.remove(id);
-                    wtx.completed(id, txid);
-
-                    // Refresh balances to show unconfirmed balances
-                    refresh(true);
-                } else if (status == "failed") {
-                    // If it failed, then we'll actually show a warning.
-                    auto errorMsg = QString::fromStdString(it["error"]["message"]);
-
-                    auto wtx = watchingOps[id];
-                    watchingOps.remove(id);
-                    wtx.error(id, errorMsg);
-                }
-            }
+            known.insert(QString::fromStdString(it["id"]));
+        }
 
-            if (watchingOps.isEmpty()) {
-                txTimer->start(Settings::updateSpeed);
-            } else {
-                txTimer->start(Settings::quickUpdateSpeed);
-            }
+        for (const auto& opid : opids) {
+            auto it = watchingOps.find(opid);
+            if (it == watchingOps.end() || it->polling || known.contains(opid))
+                continue;
+
+            auto wtx = it.value();
+            watchingOps.erase(it);
+
+            qDebug() << "zerod doesn't know about" << opid << "anymore";
+            auto errorMsg = QObject::tr("zerod no longer knows about this transaction, probably because it was restarted. "
+                                        "Please check the transactions tab to see if it was sent.");
+            // It may have been sent (its result was fetched, but the reply got lost, or it was broadcast just before
+            // zerod restarted), so callers that would retry a failed Tx are told it's unknown instead
+            if (wtx.lost)
+                wtx.lost(opid, errorMsg);
+            else
+                wtx.error(opid, errorMsg);
+            AppDataServer::getInstance()->opChanged(this, opid, "failed", "", errorMsg);
         }
 
-        // If there is some op that we are watching, then show the loading bar, otherwise hide it
-        if (watchingOps.empty()) {
-            main->loadingLabel->setVisible(false);
-        } else {
-            main->loadingLabel->setVisible(true);
-            main->loadingLabel->setToolTip(QString::number(watchingOps.size()) + QObject::tr(" tx computing. This can take several minutes."));
+        sendQueuedTxs();
+    });
+}
+
+/**
+ * The order Txs of the same priority are sent in. Quick proofs go first, so a big Tx (say, a bulk payout chunk) doesn't
+ * hold up small ones queued behind it for its whole proving time. Txs that have been waiting longer than maxQueueAge
+ * go first, in the order they were queued, so a big Tx can't be put off forever.
+ */
+bool RPC::sendsBefore(const QueuedTx& a, const QueuedTx& b, qint64 now) {
+    bool aOld = now - a.queuedAt >= maxQueueAge;
+    bool bOld = now - b.queuedAt >= maxQueueAge;
+    if (aOld || bOld)
+        return aOld && bOld ? a.queuedAt < b.queuedAt : aOld;
+
+    return a.estimate < b.estimate;
+}
+
+/**
+ * How long until everything in the send queue has been computed, in msecs. Each proving slot is busy until its op
+ * is expected to finish, and each queued Tx, in the order they will be sent, goes into the slot that frees up first.
+ */
+qint64 RPC::estimateQueueWait() {
+    auto now = QDateTime::currentMSecsSinceEpoch();
+
+    std::priority_queue<qint64, std::vector<qint64>, std::greater<qint64>> slotFree;
+    for (const auto& wtx : watchingOps) {
+        if (!holdsProvingSlot(wtx, now))
+            continue;
+
+        // Ops that are taking longer than expected should be done any time now
+        slotFree.push(std::max(wtx.submittedAt + wtx.estimate - now, (qint64)Settings::quickUpdateSpeed));
+    }
+    while ((int)slotFree.size() < getProvingSlots()) {
+        slotFree.push(0);
+    }
+
+    qint64 wait = 0;
+    for (const auto& q : sendQueue) {
+        auto inOrder = q;
+        std::stable_sort(inOrder.begin(), inOrder.end(), [=] (const auto& a, const auto& b) { return sendsBefore(a, b, now); });
+
+        for (const auto& queued : inOrder) {
+            auto done = slotFree.top() + queued.estimate;
+            slotFree.pop();
+            slotFree.push(done);
+
+            wait = std::max(wait, done);
         }
+    }
+
+    return wait;
+}
+
+// Wake up for the next op that is due, and show the computing ops and the send queue in the status bar
+void RPC::updateWatchingOps() {
+    auto queued = getQueuedTxCount();
+    if (queued == 0) {
+        main->queueLabel->setVisible(false);
+    } else {
+        auto mins = std::max((qint64)1, (estimateQueueWait() + 30 * 1000) / (60 * 1000));
+
+        main->queueLabel->setText(QObject::tr("%1 queued, ~%2 min").arg(queued).arg(mins));
+        main->queueLabel->setToolTip(QObject::tr("%1 transactions are waiting to be computed, %2 at a time. "
+                                                 "All of them should be sent in about %3 minutes.")
+                                        .arg(queued).arg(getProvingSlots()).arg(mins));
+        main->queueLabel->setVisible(true);
+    }
+
+    if (watchingOps.isEmpty()) {
+        main->loadingLabel->setVisible(false);
+        txTimer->start(Settings::updateSpeed);
+        return;
+    }
+
+    auto now      = QDateTime::currentMSecsSinceEpoch();
+    auto nextPoll = now + maxOpPollInterval;
+    for (const auto& wtx : watchingOps) {
+        if (!wtx.polling)
+            nextPoll = std::min(nextPoll, wtx.nextPoll);
+    }
+    txTimer->start((int)std::max(nextPoll - now, (qint64)250));
+
+    // The ops that have been computing longest come first
+    auto ops = watchingOps.values();
+    std::sort(ops.begin(), ops.end(), [] (const WatchedTx& a, const WatchedTx& b) {
+        return a.submittedAt < b.submittedAt;
     });
+
+    QStringList lines;
+    for (const auto& wtx : ops.mid(0, 10)) {
+        auto left = (wtx.submittedAt + wtx.estimate - now) / 1000;
+        if (left > 0) {
+            lines.append(QObject::tr("%1: about %2s left").arg(wtx.opid).arg(left));
+        } else {
+            lines.append(QObject::tr("%1: taking longer than expected").arg(wtx.opid));
+        }
+    }
+    if (ops.size() > 10)
+        lines.append(QObject::tr("and %1 more").arg(ops.size() - 10));
+
+    main->loadingLabel->setVisible(true);
+    main->loadingLabel->setToolTip(QString::number(watchingOps.size()) + QObject::tr(" tx computing") % ":\n" % lines.join("\n"));
 }
 
 void RPC::checkForUpdate(bool silent) {
@@ -22,8 +22,8 @@ struct GlobalZeroNodes{
     qint64          version;
     QString         status;
     qint64          active;
-    QString          lastSeen;
-    QString          lastPaid;
+    qint64          lastSeen;       // Seconds since epoch, formatted only when displayed
+    qint64          lastPaid;
     QString         txid;
     QString         ipAddress;
     bool            local;
@@ -45,6 +45,33 @@ struct WatchedTx {
     Tx tx;
     std::function<void(QString, QString)> completed;
     std::function<void(QString, QString)> error;
+    std::function<void(QString, QString)> lost;     // zerod forgot the op, so it may or may not have been sent
+
+    qint64  submittedAt  = 0;                // msecs since epoch when zerod started computing it
+    qint64  estimate     = 0;                // How long it should take to compute, in msecs
+    qint64  nextPoll     = 0;                // msecs since epoch when the op is next asked about
+    int     pollInterval = 0;                // Grows each time the op is found still running
+    bool    polling      = false;            // Part of an RPC that hasn't returned yet
+    bool    checked      = false;            // Asked zerod whether it still knows about the op, since it's overdue
+};
+
+// Sends waiting in the queue are handed to zerod in this order
+enum TxPriority {
+    UserTxPriority = 0,         // Sent by the user, from the send tab or the mobile app
+    BackgroundTxPriority,       // Recurring payments and bulk payouts
+    MigrationTxPriority,        // Turnstile migration steps
+    NumTxPriorities
+};
+
+struct QueuedTx {
+    Tx tx;
+    std::function<void(QString)> submitted;
+    std::function<void(QString, QString)> computed;
+    std::function<void(QString, QString)> error;
+    std::function<void(QString, QString)> lost;
+
+    qint64  queuedAt    = 0;                 // msecs since epoch
+    qint64  estimate    = 0;                 // How long it should take to compute, in msecs
 };
 
 struct MigrationStatus {
@@ -56,6 +83,15 @@ struct MigrationStatus {
     QList<QString>  txids;
 };
 
+// Worked out from the balances once each time they are refreshed, so the send tab and the mobile app don't have to
+// walk every address to find these
+struct WalletSummary {
+    Amount      maxSpendable;           // The biggest balance of any address
+    Amount      maxZSpendable;          // The biggest balance of a sapling address
+    QString     maxZAddr;               // The z address with the biggest balance, empty if none have any
+    QString     maxTAddr;               // The t address with the biggest balance, empty if none have any
+};
+
 QString convertSecondsToDays(qint64 n);
 
 class RPC
@@ -74,7 +110,7 @@ public:
     void startZNAlias(QString alias);
     void startZNAll();
     void getZNPrivateKey(Ui_znsetup* zn);
-    void getZNOutputs(Ui_znsetup* zn, QList<ZNOutputs>* outputs, QList<LocalZeroNodes>* znData);
+    void getZNOutputs(Ui_znsetup* zn, QList<ZNOutputs>* outputs);
     void refreshAddresses();
 
     void checkForUpdate(bool silent = true);
@@ -86,13 +122,18 @@ public:
     void executeTransaction(Tx tx,
         const std::function<void(QString opid)> submitted,
         const std::function<void(QString opid, QString txid)> computed,
-        const std::function<void(QString opid, QString errStr)> error);
+        const std::function<void(QString opid, QString errStr)> error,
+        TxPriority priority = UserTxPriority,
+        const std::function<void(QString opid, QString errStr)> lost = nullptr);
+    void sendQueuedTxs();
+    int  getProvingSlots();
+    int  getQueuedTxCount();
 
     void fillTxJsonParams(json& params, Tx tx);
     void sendZTransaction(json params, const std::function<void(json)>& cb, const std::function<void(QString)>& err);
     void watchTxStatus();
 
-    const QMap<QString, WatchedTx> getWatchingTxns() { return watchingOps; }
+    const QHash<QString, WatchedTx> getWatchingTxns() { return watchingOps; }
     void addNewTxToWatch(const QString& newOpid, WatchedTx wtx);
 
     const LocalZNTableModel*          getLocalZeroNodesModel()  { return localZeroNodesTableModel; }
@@ -100,8 +141,9 @@ public:
     const TxTableModel*               getTransactionsModel()    { return transactionsTableModel; }
     const QList<QString>*             getAllZAddresses()        { return zaddresses; }
     const QList<QString>*             getAllTAddresses()        { return taddresses; }
-    const QList<UnspentOutput>*       getUTXOs()                { return utxos; }
-    const QMap<QString, double>*      getAllBalances()          { return balancesOverview; }
+    const UTXOIndex*                  getUTXOs()                { return utxos.get(); }
+    const QMap<QString, Amount>*      getAllBalances()          { return balancesOverview; }
+    const WalletSummary&              getWalletSummary()        { return walletSummary; }
     const QMap<QString, bool>*        getUsedAddresses()        { return usedAddresses; }
 
     void newZaddr(const std::function<void(json)>& cb);
@@ -132,11 +174,19 @@ private:
     void refreshGetAllData();
     void refreshMigration();
 
-    bool processUnspent     (const json& reply, QMap<QString, double>* newBalances, QList<UnspentOutput>* newUtxos);
+    bool processUnspent     (const json& reply, QMap<QString, Amount>* newBalances, UTXOIndex* newUtxos);
+    static WalletSummary summarize(const QMap<QString, Amount>& balances);
     void updateUI           (bool anyUnconfirmed);
 
     void getInfoThenRefresh(bool force);
 
+    void opFinished         (const json& result, bool& anySuccess);
+    void checkLostOps       (const QList<QString>& opids);
+    bool holdsProvingSlot   (const WatchedTx& wtx, qint64 now);
+    void updateWatchingOps  ();
+    qint64 estimateQueueWait();
+    static bool sendsBefore (const QueuedTx& a, const QueuedTx& b, qint64 now);
+
     void getBalance(const std::function<void(json)>& cb);
 
     void getTransparentUnspent  (const std::function<void(json)>& cb);
@@ -154,14 +204,21 @@ private:
     Connection*                 conn                        = nullptr;
     QProcess*                   ezcashd                     = nullptr;
 
-    QList<UnspentOutput>*       utxos                       = nullptr;
-    QMap<QString, double>*      balancesOverview            = nullptr;
+    std::shared_ptr<UTXOIndex>  utxos;
+    QMap<QString, Amount>*      balancesOverview            = nullptr;
+    WalletSummary               walletSummary;
     QList<allBalances>*         addressBalances             = nullptr;
     QMap<QString, bool>*        usedAddresses               = nullptr;
     QList<QString>*             zaddresses                  = nullptr;
     QList<QString>*             taddresses                  = nullptr;
 
-    QMap<QString, WatchedTx>    watchingOps;
+    QHash<QString, WatchedTx>   watchingOps;
+    QQueue<QueuedTx>            sendQueue[NumTxPriorities];
+    int                         submitting                  = 0;    // z_sendmany calls that haven't returned yet
+    static const int            maxOpPollInterval           = 30 * 1000;
+    static const int            overdueEstimates            = 4;    // An op taking this many times its estimate is overdue
+    static const int            minOverdueTime              = 10 * 60 * 1000;   // ...but never before this long
+    static const int            maxQueueAge                 = 10 * 60 * 1000;   // Queued Txs this old are sent in order
 
     GlobalZNTableModel*             globalZeroNodesTableModel   = nullptr;
     LocalZNTableModel*              localZeroNodesTableModel    = nullptr;
@@ -22,6 +22,9 @@ void MainWindow::setupSendTab() {
     // Cancel Button
     QObject::connect(ui->cancelSendButton, &QPushButton::clicked, this, &MainWindow::cancelButton);
 
+    // The inputs combo shows every address that has a balance
+    ui->inputsCombo->setAddressFilter(AddressFilterProxyModel::FundedAddresses);
+
     // Input Combobox current text changed
     QObject::connect(ui->inputsCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
         this, &MainWindow::inputComboTextChanged);
@@ -64,7 +67,7 @@ void MainWindow::setupSendTab() {
     QObject::connect(ui->minerFeeAmt, &QLineEdit::textChanged, [=](auto txt) {
         ui->lblMinerFeeUSD->setText(Settings::getUSDFromZecAmount(txt.toDouble()));
     });
-    ui->minerFeeAmt->setText(Settings::getDecimalString(Settings::getMinerFee()));
+    ui->minerFeeAmt->setText(Settings::getMinerFee().toDecimalString());
 
      // Set up focus enter to set fees
     QObject::connect(ui->tabWidget, &QTabWidget::currentChanged, [=] (int pos) {
@@ -149,16 +152,13 @@ void MainWindow::editSchedule() {
 }
 
 void MainWindow::updateLabelsAutoComplete() {
-    QList<QString> list;
-    auto labels = AddressBook::getInstance()->getAllAddressLabels();
-
-    std::transform(labels.begin(), labels.end(), std::back_inserter(list), [=] (auto la) -> QString {
-        return la.first % "/" % la.second;
-    });
+    // Already sorted case insensitively, so the completer can binary search instead of scanning
+    auto list = AddressBook::getInstance()->getCompletions();
 
     delete labelCompleter;
     labelCompleter = new QCompleter(list, this);
     labelCompleter->setCaseSensitivity(Qt::CaseInsensitive);
+    labelCompleter->setModelSorting(QCompleter::CaseInsensitivelySortedModel);
 
     // Then, find all the address fields and update the completer.
     //QRegExp re("Address[0-9]+", Qt::CaseInsensitive);
@@ -169,32 +169,14 @@ void MainWindow::updateLabelsAutoComplete() {
 }
 
 void MainWindow::setDefaultPayFrom() {
-    auto findMax = [=] (QString startsWith) {
-        double max_amt = 0;
-        int    idx     = -1;
-
-        for (int i=0; i < ui->inputsCombo->count(); i++) {
-            auto addr = ui->inputsCombo->itemText(i);
-            if (addr.startsWith(startsWith)) {
-                auto amt = rpc->getAllBalances()->value(addr);
-                if (max_amt < amt) {
-                    max_amt = amt;
-                    idx = i;
-                }
-            }
-        }
-
-        return idx;
-    };
-
     // By default, select the z-address with the most balance from the inputs combo
-    auto maxZ = findMax("z");
-    if (maxZ >= 0) {
-        ui->inputsCombo->setCurrentIndex(maxZ);
+    const auto& summary = rpc->getWalletSummary();
+    if (!summary.maxZAddr.isEmpty()) {
+        ui->inputsCombo->setCurrentText(summary.maxZAddr);
+    } else if (!summary.maxTAddr.isEmpty()) {
+        ui->inputsCombo->setCurrentText(summary.maxTAddr);
     } else {
-        auto maxT = findMax("t");
-        maxT  = maxT >= 0 ? maxT : 0;
-        ui->inputsCombo->setCurrentIndex(maxT);
+        ui->inputsCombo->setCurrentIndex(0);
     }
 };
 
@@ -202,34 +184,30 @@ void MainWindow::updateFromCombo() {
     if (!rpc || !rpc->getAllBalances())
         return;
 
-    auto lastFromAddr = ui->inputsCombo->currentText();
-
-    ui->inputsCombo->clear();
-    auto i = rpc->getAllBalances()->constBegin();
-
-    // Add all the addresses into the inputs combo box
-    while (i != rpc->getAllBalances()->constEnd()) {
-        ui->inputsCombo->addItem(i.key(), i.value());
-        if (i.key() == lastFromAddr) ui->inputsCombo->setCurrentText(i.key());
-
-        ++i;
+    // The rows themselves are kept up to date by the AddressListModel, so the current selection survives
+    // a refresh. We only need to pick the default address the first time the combo gets any addresses.
+    if (ui->inputsCombo->count() == 0) {
+        payFromDefaulted = false;
+        return;
     }
 
-    if (lastFromAddr.isEmpty()) {
+    if (!payFromDefaulted) {
         setDefaultPayFrom();
+        payFromDefaulted = true;
     }
     else {
-        ui->inputsCombo->setCurrentText(lastFromAddr);
+        // The balance of the selected address might have changed
+        inputComboTextChanged(ui->inputsCombo->currentIndex());
     }
 }
 
 void MainWindow::inputComboTextChanged(int index) {
     auto addr   = ui->inputsCombo->itemText(index);
     auto bal    = rpc->getAllBalances()->value(addr);
-    auto balFmt = Settings::getZECDisplayFormat(bal);
+    auto balFmt = bal.toDecimalZECString();
 
     ui->sendAddressBalance->setText(balFmt);
-    ui->sendAddressBalanceUSD->setText(Settings::getUSDFromZecAmount(bal));
+    ui->sendAddressBalanceUSD->setText(bal.toDecimalUSDString());
 }
 
 
@@ -436,7 +414,7 @@ void MainWindow::clearSendForm() {
     setMemoEnabled(1, false);
 
     // Reset the fee
-    ui->minerFeeAmt->setText(Settings::getDecimalString(Settings::getMinerFee()));
+    ui->minerFeeAmt->setText(Settings::getMinerFee().toDecimalString());
 
     // Start the deletion after the first item, since we want to keep 1 send field there all there
     for (int i=1; i < totalItems; i++) {
@@ -463,18 +441,18 @@ void MainWindow::maxAmountChecked(int checked) {
         if (rpc->getAllBalances() == nullptr) return;
 
         // Calculate maximum amount
-        double sumAllAmounts = 0.0;
+        Amount sumAllAmounts;
         // Calculate all other amounts
         int totalItems = ui->sendToWidgets->children().size() - 2;   // The last one is a spacer, so ignore that
         // Start counting the sum skipping the first one, because the MAX button is on the first one, and we don't
         // want to include it in the sum.
         for (int i=1; i < totalItems; i++) {
             auto amt  = ui->sendToWidgets->findChild<QLineEdit*>(QString("Amount")  % QString::number(i+1));
-            sumAllAmounts += amt->text().toDouble();
+            sumAllAmounts += Amount::fromDouble(amt->text().toDouble());
         }
 
         if (Settings::getInstance()->getAllowCustomFees()) {
-            sumAllAmounts = ui->minerFeeAmt->text().toDouble();
+            sumAllAmounts = Amount::fromDouble(ui->minerFeeAmt->text().toDouble());
         }
         else {
             sumAllAmounts += Settings::getMinerFee();
@@ -483,9 +461,9 @@ void MainWindow::maxAmountChecked(int checked) {
         auto addr = ui->inputsCombo->currentText();
 
         auto maxamount  = rpc->getAllBalances()->value(addr) - sumAllAmounts;
-        maxamount       = (maxamount < 0) ? 0 : maxamount;
+        maxamount       = (maxamount < Amount()) ? Amount() : maxamount;
 
-        ui->Amount1->setText(Settings::getDecimalString(maxamount));
+        ui->Amount1->setText(maxamount.toDecimalString());
     } else if (checked == Qt::Unchecked) {
         // Just remove the readonly part, don't change the content
         ui->Amount1->setReadOnly(false);
@@ -504,7 +482,7 @@ Tx MainWindow::createTxFromSendPage() {
 
     // For each addr/amt in the sendTo tab
     int totalItems = ui->sendToWidgets->children().size() - 2;   // The last one is a spacer, so ignore that
-    double totalAmt = 0;
+    Amount totalAmt;
     for (int i=0; i < totalItems; i++) {
         QString addr = ui->sendToWidgets->findChild<QLineEdit*>(QString("Address") % QString::number(i+1))->text().trimmed();
         // Remove label if it exists
@@ -518,7 +496,8 @@ Tx MainWindow::createTxFromSendPage() {
             amtStr = "-1";; // The user didn't specify an amount
         }
 
-        double amt = amtStr.toDouble();
+        // User input may have more than 8 decimal places, so round it like zerod would
+        Amount amt = Amount::fromDouble(amtStr.toDouble());
         totalAmt += amt;
         QString memo = ui->sendToWidgets->findChild<QLabel*>(QString("MemoTxt")  % QString::number(i+1))->text().trimmed();
 
@@ -526,7 +505,7 @@ Tx MainWindow::createTxFromSendPage() {
     }
 
     if (Settings::getInstance()->getAllowCustomFees()) {
-        tx.fee = ui->minerFeeAmt->text().toDouble();
+        tx.fee = Amount::fromDouble(ui->minerFeeAmt->text().toDouble());
     } else {
         tx.fee = Settings::getMinerFee();
     }
@@ -547,9 +526,9 @@ Tx MainWindow::createTxFromSendPage() {
         });
 
         if (saplingAddr != rpc->getAllZAddresses()->end()) {
-            double change = rpc->getAllBalances()->value(tx.fromAddr) - totalAmt - tx.fee;
+            Amount change = rpc->getAllBalances()->value(tx.fromAddr) - totalAmt - tx.fee;
 
-            if (Settings::getDecimalString(change) != "0") {
+            if (!change.isZero()) {
                 QString changeMemo = tr("Change from ") + tx.fromAddr;
                 tx.toAddrs.push_back(ToFields{ *saplingAddr, change, changeMemo, changeMemo.toUtf8().toHex() });
             }
@@ -619,7 +598,7 @@ bool MainWindow::confirmTx(Tx tx, RecurringPaymentInfo* rpi) {
 
     // For each addr/amt/memo, construct the JSON and also build the confirm dialog box
     int row = 0;
-    double totalSpending = 0;
+    Amount totalSpending;
 
     for (int i=0; i < tx.toAddrs.size(); i++) {
         auto toAddr = tx.toAddrs[i];
@@ -637,7 +616,7 @@ bool MainWindow::confirmTx(Tx tx, RecurringPaymentInfo* rpi) {
             // Amount (ZEC)
             auto Amt = new QLabel(confirm.sendToAddrs);
             Amt->setObjectName(QString("Amt") % QString::number(i + 1));
-            Amt->setText(Settings::getZECDisplayFormat(toAddr.amount));
+            Amt->setText(toAddr.amount.toDecimalZECString());
             Amt->setAlignment(Qt::AlignRight | Qt::AlignTrailing | Qt::AlignVCenter);
             confirm.gridLayout->addWidget(Amt, row, 1, 1, 1);
             totalSpending += toAddr.amount;
@@ -645,7 +624,7 @@ bool MainWindow::confirmTx(Tx tx, RecurringPaymentInfo* rpi) {
             // Amount (USD)
             auto AmtUSD = new QLabel(confirm.sendToAddrs);
             AmtUSD->setObjectName(QString("AmtUSD") % QString::number(i + 1));
-            AmtUSD->setText(Settings::getUSDFromZecAmount(toAddr.amount));
+            AmtUSD->setText(toAddr.amount.toDecimalUSDString());
             AmtUSD->setAlignment(Qt::AlignRight | Qt::AlignTrailing | Qt::AlignVCenter);
             confirm.gridLayout->addWidget(AmtUSD, row, 2, 1, 1);
 
@@ -687,7 +666,7 @@ bool MainWindow::confirmTx(Tx tx, RecurringPaymentInfo* rpi) {
         minerFee->setObjectName(QStringLiteral("minerFee"));
         minerFee->setAlignment(Qt::AlignRight|Qt::AlignTrailing|Qt::AlignVCenter);
         confirm.gridLayout->addWidget(minerFee, row, 1, 1, 1);
-        minerFee->setText(Settings::getZECDisplayFormat(tx.fee));
+        minerFee->setText(tx.fee.toDecimalZECString());
         totalSpending += tx.fee;
 
         auto minerFeeUSD = new QLabel(confirm.sendToAddrs);
@@ -696,7 +675,7 @@ bool MainWindow::confirmTx(Tx tx, RecurringPaymentInfo* rpi) {
         minerFeeUSD->setObjectName(QStringLiteral("minerFeeUSD"));
         minerFeeUSD->setAlignment(Qt::AlignRight|Qt::AlignTrailing|Qt::AlignVCenter);
         confirm.gridLayout->addWidget(minerFeeUSD, row, 2, 1, 1);
-        minerFeeUSD->setText(Settings::getUSDFromZecAmount(tx.fee));
+        minerFeeUSD->setText(tx.fee.toDecimalUSDString());
 
         if (Settings::getInstance()->getAllowCustomFees() && tx.fee != Settings::getMinerFee()) {
             confirm.warningLabel->setVisible(true);
@@ -725,9 +704,9 @@ bool MainWindow::confirmTx(Tx tx, RecurringPaymentInfo* rpi) {
     confirm.sendFrom->setText(fnSplitAddressForWrap(tx.fromAddr));
     confirm.sendFrom->setFont(fixedFont);
     QString tooltip = tr("Current balance      : ") +
-        Settings::getZECUSDDisplayFormat(rpc->getAllBalances()->value(tx.fromAddr));
+        rpc->getAllBalances()->value(tx.fromAddr).toDecimalZECUSDString();
     tooltip += "\n" + tr("Balance after this Tx: ") +
-        Settings::getZECUSDDisplayFormat(rpc->getAllBalances()->value(tx.fromAddr) - totalSpending);
+        (rpc->getAllBalances()->value(tx.fromAddr) - totalSpending).toDecimalZECUSDString();
     confirm.sendFrom->setToolTip(tooltip);
 
     // Show the dialog and submit it if the user confirms
@@ -816,7 +795,7 @@ QString MainWindow::doSendTxValidations(Tx tx) {
 
         // This technically shouldn't be possible, but issue #62 seems to have discovered a bug
         // somewhere, so just add a check to make sure.
-        if (toAddr.amount < 0) {
+        if (toAddr.amount < Amount()) {
             return QString(tr("Amount for address '%1' is invalid!").arg(toAddr.addr));
         }
     }
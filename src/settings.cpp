@@ -223,7 +223,7 @@ void Settings::autoDetectZeroNodeConf(LocalZNTableModel* localZeroNodesTableMode
             newLocalZeroNode.index = list[4].toLongLong(&ok);
 
             if (ok)
-                zeroNodeSettings.push_back(newLocalZeroNode);
+                addZeroNodeSetting(newLocalZeroNode);
         }
     }
 
@@ -363,6 +363,14 @@ void Settings::setAllowFetchPrices(bool allow) {
      QSettings().setValue("options/allowfetchprices", allow);
 }
 
+int Settings::getProvingSlots() {
+    return QSettings().value("options/provingslots", 0).toInt();
+}
+
+void Settings::setProvingSlots(int slots) {
+    QSettings().setValue("options/provingslots", slots);
+}
+
 bool Settings::getAllowCustomFees() {
     // Load from the QT Settings.
     return QSettings().value("options/customfees", false).toBool();
@@ -449,15 +457,7 @@ QString Settings::getUSDFromZecAmount(double bal) {
 
 
 QString Settings::getDecimalString(double amt) {
-    QString f = QString::number(amt, 'f', 8);
-
-    while (f.contains(".") && (f.right(1) == "0" || f.right(1) == ".")) {
-        f = f.left(f.length() - 1);
-    }
-    if (f == "-0")
-        f = "0";
-
-    return f;
+    return Amount::fromDouble(amt).toDecimalString();
 }
 
 QString Settings::getZECDisplayFormat(double bal) {
@@ -552,12 +552,12 @@ bool Settings::removeFromZcashConf(QString confLocation, QString option) {
     return true;
 }
 
-double Settings::getMinerFee() {
-    return 0.0001;
+Amount Settings::getMinerFee() {
+    return Amount::fromZats(10000);
 }
 
-double Settings::getZboardAmount() {
-    return 0.0001;
+Amount Settings::getZboardAmount() {
+    return Amount::fromZats(10000);
 }
 
 QString Settings::getZboardAddr() {
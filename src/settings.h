@@ -3,6 +3,7 @@
 
 #include "precompiled.h"
 #include "localzntablemodel.h"
+#include "amount.h"
 
 struct Config {
     QString         host;
@@ -100,6 +101,9 @@ public:
     bool    getCheckForUpdates();
     void    setCheckForUpdates(bool allow);
 
+    int     getProvingSlots();          // 0 means pick from the number of cores
+    void    setProvingSlots(int slots);
+
     QString get_theme_name();
     void set_theme_name(QString theme_name);
 
@@ -144,11 +148,12 @@ public:
     static QString getTokenName();
     static QString getDonationAddr();
 
-    static double  getMinerFee();
-    static double  getZboardAmount();
+    static Amount  getMinerFee();
+    static Amount  getZboardAmount();
     static QString getZboardAddr();
 
     static int     getMaxMobileAppTxns() { return 30; }
+    static int     getMaxTxRecipients()  { return 54; }     // zerod's limit on z_sendmany outputs
 
     static bool    isValidAddress(QString addr);
 
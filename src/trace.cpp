@@ -0,0 +1,143 @@
+#include "trace.h"
+
+using json = nlohmann::json;
+
+bool                    Trace::enabled = false;
+QString                 Trace::fileName;
+QElapsedTimer           Trace::clock;
+QMutex                  Trace::lock;
+QList<Trace::Event>     Trace::events;
+QHash<Qt::HANDLE, int>  Trace::threadIds;
+QStringList             Trace::threadNames;
+quint64                 Trace::nextAsyncId = 1;
+
+void Trace::start(const QString& fileName) {
+    Trace::fileName = fileName;
+    clock.start();
+    enabled = true;
+
+    qDebug() << "Tracing to" << fileName;
+}
+
+qint64 Trace::now() {
+    if (!enabled)
+        return 0;
+
+    return clock.nsecsElapsed() / 1000;
+}
+
+void Trace::complete(const QString& name, qint64 startUs) {
+    if (!enabled)
+        return;
+
+    add(name, 'X', startUs, now() - startUs);
+}
+
+void Trace::since(const QString& name, qint64 startUs) {
+    if (!enabled)
+        return;
+
+    addAsync(name, startUs, now());
+}
+
+void Trace::instant(const QString& name) {
+    if (!enabled)
+        return;
+
+    add(name, 'i', now(), 0);
+}
+
+// Small, stable ids, since the native thread handles are huge numbers that chrome://tracing shows as-is.
+// Must be called with the lock held.
+int Trace::threadId() {
+    auto handle = QThread::currentThreadId();
+    auto it = threadIds.constFind(handle);
+    if (it != threadIds.constEnd())
+        return it.value();
+
+    int tid = threadIds.size() + 1;
+    threadIds.insert(handle, tid);
+
+    // Pooled threads all have the same name, so number them
+    auto thread = QThread::currentThread();
+    if (thread == qApp->thread()) {
+        threadNames.append("GUI");
+    } else {
+        auto name = thread->objectName().isEmpty() ? QString("Worker") : thread->objectName();
+        threadNames.append(name % " " % QString::number(tid));
+    }
+
+    return tid;
+}
+
+void Trace::add(const QString& name, char phase, qint64 ts, qint64 dur) {
+    QMutexLocker locker(&lock);
+
+    // Don't let a wallet that was left running with tracing on use up all the memory
+    if (events.size() >= maxEvents)
+        return;
+
+    events.append(Event{ name, phase, ts, dur, threadId(), 0 });
+}
+
+void Trace::addAsync(const QString& name, qint64 startUs, qint64 endUs) {
+    QMutexLocker locker(&lock);
+
+    if (events.size() + 2 > maxEvents)
+        return;
+
+    auto id  = nextAsyncId++;
+    auto tid = threadId();
+    events.append(Event{ name, 'b', startUs, 0, tid, id });
+    events.append(Event{ name, 'e', endUs,   0, tid, id });
+}
+
+void Trace::flush() {
+    if (!enabled)
+        return;
+
+    json traceEvents = json::array();
+    {
+        QMutexLocker locker(&lock);
+
+        for (int i = 0; i < threadNames.size(); i++) {
+            traceEvents.push_back({
+                {"name", "thread_name"}, {"ph", "M"}, {"pid", 1}, {"tid", i + 1},
+                {"args", {{"name", threadNames[i].toStdString()}}}
+            });
+        }
+
+        for (const auto& e : events) {
+            json event = {
+                {"name", e.name.toStdString()}, {"ph", std::string(1, e.phase)},
+                {"ts", e.ts}, {"pid", 1}, {"tid", e.tid}
+            };
+            if (e.phase == 'X') {
+                event["dur"] = e.dur;
+            } else if (e.phase == 'i') {
+                event["s"] = "t";
+            } else {
+                event["cat"] = "async";
+                event["id"]  = e.id;
+            }
+
+            traceEvents.push_back(event);
+        }
+    }
+
+    json trace = {
+        {"traceEvents", traceEvents},
+        {"displayTimeUnit", "ms"}
+    };
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Couldn't open" << fileName << "for writing";
+        return;
+    }
+
+    file.write(QByteArray::fromStdString(trace.dump()));
+    if (!file.commit()) {
+        qDebug() << "Couldn't write" << fileName;
+    }
+}
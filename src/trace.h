@@ -0,0 +1,77 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "precompiled.h"
+
+/**
+ * Records named spans of what the wallet is doing, so slow startups and refreshes can be looked at in
+ * chrome://tracing or Perfetto. Tracing is only on when the wallet is started with --trace <file>, and when it is off
+ * every call returns straight away.
+ *
+ * Events are kept in memory and written out as Chrome trace-event JSON by flush(). The wallet flushes once the first
+ * balances are shown (so there is a startup trace even if it is killed later) and again when it exits.
+ */
+class Trace
+{
+public:
+    static void     start(const QString& fileName);
+    static bool     isEnabled() { return enabled; }
+
+    // Microseconds since tracing started
+    static qint64   now();
+
+    // A span that started at startUs, on this thread, and ends now
+    static void     complete(const QString& name, qint64 startUs);
+    // A span that started at startUs and ends now, in a callback. These overlap each other and the spans on the
+    // thread, so they are written as async events, which get their own tracks.
+    static void     since(const QString& name, qint64 startUs);
+    static void     instant(const QString& name);
+
+    static void     flush();
+
+private:
+    struct Event {
+        QString     name;
+        char        phase;
+        qint64      ts;
+        qint64      dur;
+        int         tid;
+        quint64     id;             // Pairs up the begin and end of an async span
+    };
+
+    static void     add(const QString& name, char phase, qint64 ts, qint64 dur);
+    static void     addAsync(const QString& name, qint64 startUs, qint64 endUs);
+    static int      threadId();
+
+    static const int maxEvents = 200000;
+
+    static bool             enabled;
+    static QString          fileName;
+    static QElapsedTimer    clock;
+    static QMutex           lock;
+    static QList<Event>     events;
+    static QHash<Qt::HANDLE, int> threadIds;
+    static QStringList      threadNames;
+    static quint64          nextAsyncId;
+};
+
+// Records a span from its construction to the end of the enclosing scope
+class TraceSpan
+{
+public:
+    TraceSpan(const char* name) : name(name) {
+        if (Trace::isEnabled())
+            startUs = Trace::now();
+    }
+
+    ~TraceSpan() {
+        if (Trace::isEnabled())
+            Trace::complete(QString::fromLatin1(name), startUs);
+    }
+
+private:
+    const char* name;
+    qint64      startUs = 0;
+};
+
+#endif // TRACE_H
@@ -1,4 +1,5 @@
 #include "turnstile.h"
+#include "journaledstore.h"
 #include "mainwindow.h"
 #include "balancestablemodel.h"
 #include "rpc.h"
@@ -36,7 +37,7 @@ QString Turnstile::writeableFile() {
 }
 
 void Turnstile::removeFile() {
-    QFile(writeableFile()).remove();
+    JournaledStore::forFile(writeableFile())->removeFiles();
 }
 
 // Data stream write/read methods for migration items
@@ -51,28 +52,61 @@ QDataStream &operator>>(QDataStream& ds, TurnstileMigrationItem& item) {
                  >> item.destAddr >> item.amount >> item.blockNumber >> item.status;
 }
 
+// Each plan item is stored under its intermediate t-address, which is new for every item, so updating
+// the status of a step only appends that one item to the journal.
+static QByteArray serializeItem(const TurnstileMigrationItem& item) {
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out << item;
+    return data;
+}
+
 void Turnstile::writeMigrationPlan(QList<TurnstileMigrationItem> plan) {
     //qDebug() << QString("Writing plan");
     printPlan(plan);
 
-    QFile file(writeableFile());
-    file.open(QIODevice::ReadWrite | QIODevice::Truncate);
-    QDataStream out(&file);   // we will serialize the data into the file
-    out << plan;
-    file.close();
+    auto store = JournaledStore::forFile(writeableFile());
+
+    QSet<QString> keys;
+    for (const auto& item : plan) {
+        keys.insert(item.intTAddr);
+        store->put(item.intTAddr, serializeItem(item));    // No-op if the item didn't change
+    }
+
+    // Remove steps that are not in the plan anymore
+    for (const auto& entry : store->getAll()) {
+        if (!keys.contains(entry.first))
+            store->remove(entry.first);
+    }
 }
 
 QList<TurnstileMigrationItem> Turnstile::readMigrationPlan() {
-    QFile file(writeableFile());
-    
-    QList<TurnstileMigrationItem> plan;
-    if (!file.exists()) return plan;
+    auto store = JournaledStore::forFile(writeableFile());
 
-    file.open(QIODevice::ReadOnly);
-    QDataStream in(&file);    // read the data serialized from the file
-    in >> plan; 
-
-    file.close();
+    QList<TurnstileMigrationItem> plan;
+    if (store->needsMigration()) {
+        // Plan from an older version. Read it and convert it to the journaled store.
+        QFile file(writeableFile());
+        file.open(QIODevice::ReadOnly);
+        QDataStream in(&file);    // read the data serialized from the file
+        in >> plan; 
+
+        file.close();
+
+        QList<QPair<QString, QByteArray>> entries;
+        for (const auto& item : plan) {
+            entries.push_back(QPair<QString, QByteArray>(item.intTAddr, serializeItem(item)));
+        }
+        store->replaceAll(entries);
+    }
+    else {
+        for (const auto& entry : store->getAll()) {
+            TurnstileMigrationItem item;
+            QDataStream in(entry.second);
+            in >> item;
+            plan.push_back(item);
+        }
+    }
 
     // Sort to see when the next step is.
     std::sort(plan.begin(), plan.end(), [&] (auto a, auto b) {
@@ -84,7 +118,7 @@ QList<TurnstileMigrationItem> Turnstile::readMigrationPlan() {
 
 void Turnstile::planMigration(QString zaddr, QString destAddr, int numsplits, int numBlocks) {
     // First, get the balance and split up the amounts
-    auto bal = rpc->getAllBalances()->value(zaddr);
+    auto bal = rpc->getAllBalances()->value(zaddr).toDecimalDouble();
     auto splits = splitAmount(bal, numsplits);
 
     // Then, generate an intermediate t-address for each part using getBatchRPC
@@ -166,7 +200,7 @@ QList<double> Turnstile::splitAmount(double amount, int parts) {
     }
     
     // Add the Tx fees
-    sumofparts += amounts.size() * Settings::getMinerFee();
+    sumofparts += amounts.size() * Settings::getMinerFee().toDecimalDouble();
 
     return amounts;
 }
@@ -174,7 +208,7 @@ QList<double> Turnstile::splitAmount(double amount, int parts) {
 void Turnstile::fillAmounts(QList<double>& amounts, double amount, int count) {
     if (count == 1 || amount < 0.01) {
         // Also account for the fees needed to send all these transactions
-        auto actual = amount - (Settings::getMinerFee() * (amounts.size() + 1));
+        auto actual = amount - (Settings::getMinerFee().toDecimalDouble() * (amounts.size() + 1));
 
         amounts.push_back(actual);
         return;
@@ -267,9 +301,7 @@ void Turnstile::executeMigrationStep() {
     // Fn to find if there are any unconfirmed funds for this address.
     auto fnHasUnconfirmed = [=] (QString addr) {
         auto utxoset = rpc->getUTXOs();
-        return std::find_if(utxoset->begin(), utxoset->end(), [=] (auto utxo) {
-                    return utxo.address == addr && utxo.confirmations == 0 && utxo.spendable;
-                }) != utxoset->end();
+        return utxoset != nullptr && utxoset->hasUnconfirmedSpendable(addr);
     };
 
     // Find the next step
@@ -293,19 +325,19 @@ void Turnstile::executeMigrationStep() {
         }
 
         auto balance = rpc->getAllBalances()->value(nextStep->fromAddr);
-        if (nextStep->amount > balance) {
+        if (Amount::fromDouble(nextStep->amount) > balance) {
             qDebug() << "Not enough balance!";
             nextStep->status = TurnstileMigrationItemStatus::NotEnoughBalance;
             writeMigrationPlan(plan);
             return;
         }
 
-        auto to = ToFields{ nextStep->intTAddr, nextStep->amount, "", "" };
+        auto to = ToFields{ nextStep->intTAddr, Amount::fromDouble(nextStep->amount), "", "" };
 
         // If this is the last step, then send the remaining amount instead of the actual amount.
         if (lastStep) {
             auto remainingAmount = balance - Settings::getMinerFee();
-            if (remainingAmount > 0) {
+            if (remainingAmount > Amount()) {
                 to.amount = remainingAmount;
             }
         }
@@ -338,8 +370,8 @@ void Turnstile::executeMigrationStep() {
         auto bal = rpc->getAllBalances()->value(nextStep->intTAddr);
         auto sendAmt = bal - Settings::getMinerFee();
 
-        if (sendAmt < 0) {
-            qDebug() << "Not enough balance!." << bal << ":" << sendAmt;
+        if (sendAmt < Amount()) {
+            qDebug() << "Not enough balance!." << bal.toDecimalString() << ":" << sendAmt.toDecimalString();
             nextStep->status = TurnstileMigrationItemStatus::NotEnoughBalance;
             writeMigrationPlan(plan);
             return;
@@ -374,7 +406,8 @@ void Turnstile::doSendTx(Tx tx, std::function<void(void)> cb) {
                 errStr = QObject::tr("The transaction with id ") % opid % QObject::tr(" failed. The error was") + ":\n\n" + errStr; 
 
             QMessageBox::critical(mainwindow, QObject::tr("Transaction Error"), errStr, QMessageBox::Ok);            
-        });
+        },
+        MigrationTxPriority);
     
 }
 
@@ -0,0 +1,46 @@
+#include "utxoindex.h"
+
+void UTXOIndex::add(const UnspentOutput& utxo) {
+    if (!summaries.contains(utxo.address))
+        addresses.push_back(utxo.address);
+
+    byAddress[utxo.address].push_back(utxos.size());
+    utxos.push_back(utxo);
+
+    auto& s = summaries[utxo.address];
+    if (utxo.confirmations == 0) {
+        s.unconfirmed += utxo.amount;
+        if (utxo.spendable)
+            s.unconfirmedSpendable++;
+    } else {
+        s.confirmed += utxo.amount;
+    }
+    s.noteCount++;
+    s.minConfirmations = std::min(s.minConfirmations, utxo.confirmations);
+}
+
+QList<UnspentOutput> UTXOIndex::getUTXOs(const QString& addr) const {
+    QList<UnspentOutput> result;
+    for (int i : byAddress.value(addr)) {
+        result.push_back(utxos.at(i));
+    }
+    return result;
+}
+
+const AddressUTXOSummary* UTXOIndex::getSummary(const QString& addr) const {
+    auto it = summaries.constFind(addr);
+    if (it == summaries.constEnd())
+        return nullptr;
+
+    return &it.value();
+}
+
+bool UTXOIndex::hasUnconfirmed(const QString& addr) const {
+    auto s = getSummary(addr);
+    return s != nullptr && s->minConfirmations == 0;
+}
+
+bool UTXOIndex::hasUnconfirmedSpendable(const QString& addr) const {
+    auto s = getSummary(addr);
+    return s != nullptr && s->unconfirmedSpendable > 0;
+}
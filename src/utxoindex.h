@@ -0,0 +1,52 @@
+#ifndef UTXOINDEX_H
+#define UTXOINDEX_H
+
+#include "precompiled.h"
+#include "amount.h"
+
+struct UnspentOutput {
+    QString address;
+    QString txid;
+    Amount  amount;
+    int     confirmations;
+    bool    spendable;
+};
+
+// Precomputed per-address aggregates over all the UTXOs of that address
+struct AddressUTXOSummary {
+    Amount  confirmed;
+    Amount  unconfirmed;
+    int     noteCount               = 0;
+    int     minConfirmations        = std::numeric_limits<int>::max();
+    int     unconfirmedSpendable    = 0;
+};
+
+/**
+ * Index of all the wallet's unspent outputs, keyed by address. It is built once per refresh by
+ * RPC::processUnspent and then shared (read-only) with the models and the send paths, so
+ * nobody has to walk the whole UTXO list to answer a per-address question.
+ */
+class UTXOIndex {
+public:
+    void add(const UnspentOutput& utxo);
+
+    int                             size() const            { return utxos.size(); }
+    const QList<UnspentOutput>&     getAll() const          { return utxos; }
+
+    // Addresses that have at least one UTXO, in the order they were first seen
+    const QList<QString>&           getAddresses() const    { return addresses; }
+
+    QList<UnspentOutput>            getUTXOs(const QString& addr) const;
+    const AddressUTXOSummary*       getSummary(const QString& addr) const;
+
+    bool                            hasUnconfirmed(const QString& addr) const;
+    bool                            hasUnconfirmedSpendable(const QString& addr) const;
+
+private:
+    QList<UnspentOutput>                utxos;
+    QList<QString>                      addresses;
+    QHash<QString, QList<int>>          byAddress;      // addr -> positions in utxos
+    QHash<QString, AddressUTXOSummary>  summaries;
+};
+
+#endif // UTXOINDEX_H
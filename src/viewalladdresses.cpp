@@ -1,16 +1,218 @@
 #include "viewalladdresses.h"
+#include "addressbook.h"
+#include "addresslistmodel.h"
 #include "settings.h"
 
+const int ViewAllAddressesModel::PageSize;
+
 ViewAllAddressesModel::ViewAllAddressesModel(QTableView *parent, QList<QString> taddrs, RPC* rpc)
      : QAbstractTableModel(parent) {
-    headers << tr("Address") << tr("Balance (%1)").arg(Settings::getTokenName());
-    addresses = taddrs;
+    headers << tr("Address") << tr("Balance (%1)").arg(Settings::getTokenName()) << tr("Last Activity");
     this->rpc = rpc;
+
+    auto addressList = AddressListModel::getInstance();
+
+    rows.reserve(taddrs.size());
+    for (const auto& addr : taddrs) {
+        if (rowIndex.contains(addr))
+            continue;
+
+        rowIndex.insert(addr, rows.size());
+        rows.push_back(Row{ addr, addressList->getBalance(addr), 0 });
+    }
+
+    // Latest transaction time for each address, in a single pass over the transactions
+    auto txns = rpc->getTransactionsModel();
+    if (txns != nullptr) {
+        for (int i = 0; i < txns->rowCount(QModelIndex()); i++) {
+            auto it = rowIndex.constFind(txns->getAddr(i));
+            if (it != rowIndex.constEnd() && rows[it.value()].lastActivity < txns->getDate(i)) {
+                rows[it.value()].lastActivity = txns->getDate(i);
+            }
+        }
+    }
+
+    byAddress.reserve(rows.size());
+    for (int i = 0; i < rows.size(); i++) {
+        byAddress.push_back(i);
+    }
+    std::sort(byAddress.begin(), byAddress.end(), [=] (int l, int r) {
+        return rows[l].address < rows[r].address;
+    });
+
+    // The RPC pushes balance changes into the AddressListModel, and only signals the rows that changed
+    QObject::connect(addressList, &QAbstractItemModel::dataChanged, this, &ViewAllAddressesModel::balancesChanged);
+
+    rebuildView();
+}
+
+// Show only the addresses (or the addresses whose label) start with the prefix
+void ViewAllAddressesModel::setSearch(const QString& prefix) {
+    if (search == prefix.trimmed())
+        return;
+
+    search = prefix.trimmed();
+    rebuildView();
+}
+
+QString ViewAllAddressesModel::getAddress(int row) const {
+    if (row < 0 || row >= loaded)
+        return QString();
+
+    return rows[view[row]].address;
+}
+
+bool ViewAllAddressesModel::rowLessThan(int l, int r) const {
+    if (sortOrder == Qt::DescendingOrder)
+        std::swap(l, r);
+
+    const auto& left  = rows[l];
+    const auto& right = rows[r];
+    switch (sortColumn) {
+    case Column::Balance:
+        if (left.balance != right.balance)
+            return left.balance < right.balance;
+        break;
+    case Column::LastActivity:
+        if (left.lastActivity != right.lastActivity)
+            return left.lastActivity < right.lastActivity;
+        break;
+    }
+
+    return left.address < right.address;
+}
+
+// Put the view in display order, and update the row -> view position map
+void ViewAllAddressesModel::sortView() {
+    std::sort(view.begin(), view.end(), [=] (int l, int r) { return rowLessThan(l, r); });
+
+    viewPos.fill(-1, rows.size());
+    for (int pos = 0; pos < view.size(); pos++) {
+        viewPos[view[pos]] = pos;
+    }
+}
+
+// Rebuild the list of matching rows from scratch, and start paging again from the top
+void ViewAllAddressesModel::rebuildView() {
+    beginResetModel();
+
+    view.clear();
+    if (search.isEmpty()) {
+        view = byAddress;
+    }
+    else {
+        // Addresses starting with the prefix are a contiguous run of byAddress
+        auto first = std::lower_bound(byAddress.begin(), byAddress.end(), search, [=] (int row, const QString& prefix) {
+            return rows[row].address < prefix;
+        });
+        for (auto it = first; it != byAddress.end() && rows[*it].address.startsWith(search); ++it) {
+            view.push_back(*it);
+        }
+
+        // And the addresses with a matching label, from the address book's prefix index
+        QSet<int> labelled;
+        for (const auto& label : AddressBook::getInstance()->getLabelsWithPrefix(search)) {
+            if (!label.first.startsWith(search, Qt::CaseInsensitive) || label.second.startsWith(search))
+                continue;
+
+            auto it = rowIndex.constFind(label.second);
+            if (it != rowIndex.constEnd() && !labelled.contains(it.value())) {
+                labelled.insert(it.value());
+                view.push_back(it.value());
+            }
+        }
+    }
+
+    sortView();
+    loaded = std::min(PageSize, view.size());
+
+    endResetModel();
+}
+
+// Re-sort the rows in place, keeping the selection
+void ViewAllAddressesModel::resortView() {
+    layoutAboutToBeChanged();
+
+    auto persistent = persistentIndexList();
+    QList<int> persistentRows;
+    for (const auto& idx : persistent) {
+        persistentRows.push_back(view[idx.row()]);
+    }
+
+    sortView();
+
+    for (int i = 0; i < persistent.size(); i++) {
+        int pos = viewPos[persistentRows[i]];
+        changePersistentIndex(persistent[i], pos < loaded ? index(pos, persistent[i].column()) : QModelIndex());
+    }
+
+    layoutChanged();
+}
+
+void ViewAllAddressesModel::balancesChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight) {
+    QList<int> changed;
+    for (int i = topLeft.row(); i <= bottomRight.row(); i++) {
+        auto src = topLeft.sibling(i, 0);
+        auto it  = rowIndex.constFind(src.data(AddressListModel::AddressRole).toString());
+        if (it == rowIndex.constEnd())
+            continue;
+
+        auto bal = Amount::fromZats(src.data(AddressListModel::BalanceRole).toLongLong());
+        if (rows[it.value()].balance != bal) {
+            rows[it.value()].balance = bal;
+            changed.push_back(it.value());
+        }
+    }
+
+    if (changed.isEmpty())
+        return;
+
+    if (sortColumn == Column::Balance) {
+        resortView();
+        return;
+    }
+
+    for (int row : changed) {
+        int pos = viewPos[row];
+        if (pos >= 0 && pos < loaded)
+            dataChanged(index(pos, Column::Balance), index(pos, Column::Balance));
+    }
 }
 
+void ViewAllAddressesModel::sort(int column, Qt::SortOrder order) {
+    if (sortColumn == column && sortOrder == order)
+        return;
 
-int ViewAllAddressesModel::rowCount(const QModelIndex&) const {
-    return addresses.size();
+    sortColumn = column;
+    sortOrder  = order;
+    resortView();
+}
+
+bool ViewAllAddressesModel::canFetchMore(const QModelIndex& parent) const {
+    if (parent.isValid())
+        return false;
+
+    return loaded < view.size();
+}
+
+void ViewAllAddressesModel::fetchMore(const QModelIndex& parent) {
+    if (parent.isValid())
+        return;
+
+    int more = std::min(PageSize, view.size() - loaded);
+    if (more <= 0)
+        return;
+
+    beginInsertRows(QModelIndex(), loaded, loaded + more - 1);
+    loaded += more;
+    endInsertRows();
+}
+
+int ViewAllAddressesModel::rowCount(const QModelIndex& parent) const {
+    if (parent.isValid())
+        return 0;
+
+    return loaded;
 }
 
 int ViewAllAddressesModel::columnCount(const QModelIndex&) const {
@@ -18,18 +220,38 @@ int ViewAllAddressesModel::columnCount(const QModelIndex&) const {
 }
 
 QVariant ViewAllAddressesModel::data(const QModelIndex &index, int role) const {
-    QString address = addresses.at(index.row());
+    if (!index.isValid() || index.row() >= loaded)
+        return QVariant();
+
+    const auto& row = rows[view[index.row()]];
+    if (role == Qt::TextAlignmentRole && index.column() == Column::Balance) return QVariant(Qt::AlignRight | Qt::AlignVCenter);
+
     if (role == Qt::DisplayRole) {
         switch(index.column()) {
-            case 0: return address;
-            case 1: return rpc->getAllBalances()->value(address, 0.0);
+            case Column::Address:      return row.address;
+            case Column::Balance:      return row.balance.toDecimalString();
+            case Column::LastActivity:
+                if (row.lastActivity == 0)
+                    return QString();
+                return QDateTime::fromMSecsSinceEpoch(row.lastActivity * (qint64)1000).toLocalTime().toString();
         }
     }
+
+    if (role == Qt::ToolTipRole && index.column() == Column::Address) {
+        auto label = AddressBook::getInstance()->getLabelForAddress(row.address);
+        if (!label.isEmpty())
+            return label;
+    }
+
     return QVariant();
-}  
+}
 
 
 QVariant ViewAllAddressesModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (role == Qt::TextAlignmentRole && section == Column::Balance) {
+        return QVariant(Qt::AlignRight | Qt::AlignVCenter);
+    }
+
     if (role == Qt::DisplayRole && orientation == Qt::Horizontal) {
         return headers.at(section);
     }
@@ -4,21 +4,64 @@
 #include "precompiled.h"
 #include "rpc.h"
 
+/**
+ * All the wallet's t-addresses, for the "View All Addresses" dialog. Wallets used for payment processing
+ * can have 100k+ addresses, so the model keeps its own sorted index of rows, does the prefix search with a
+ * binary search over the addresses, hands the rows to the view a page at a time (canFetchMore/fetchMore),
+ * and picks up balance changes from the AddressListModel instead of looking them up on every paint.
+ */
 class ViewAllAddressesModel : public QAbstractTableModel {
 
 public:
+    enum Column {
+        Address      = 0,
+        Balance      = 1,
+        LastActivity = 2
+    };
+
     ViewAllAddressesModel(QTableView* parent, QList<QString> taddrs, RPC* rpc);
     ~ViewAllAddressesModel() = default;
 
+    void     setSearch(const QString& prefix);
+    QString  getAddress(int row) const;
+
     int      rowCount(const QModelIndex &parent) const;
     int      columnCount(const QModelIndex &parent) const;
     QVariant data(const QModelIndex &index, int role) const;
     QVariant headerData(int section, Qt::Orientation orientation, int role) const;
 
+    void     sort(int column, Qt::SortOrder order);
+    bool     canFetchMore(const QModelIndex &parent) const;
+    void     fetchMore(const QModelIndex &parent);
+
 private:
-    QList<QString> addresses;
-    QStringList headers;    
+    struct Row {
+        QString address;
+        Amount  balance;
+        qint64  lastActivity;   // Seconds since epoch of the latest transaction, 0 if none
+    };
+
+    static const int PageSize = 500;
+
+    bool rowLessThan(int l, int r) const;
+    void sortView();
+    void rebuildView();
+    void resortView();
+    void balancesChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight);
+
+    QVector<Row>        rows;
+    QHash<QString, int> rowIndex;       // address -> index in rows
+    QVector<int>        byAddress;      // indexes into rows, sorted by address. Used for the prefix search
+    QVector<int>        view;           // indexes into rows that match the search, in display order
+    QVector<int>        viewPos;        // index in rows -> position in view, or -1 if not shown
+    int                 loaded = 0;     // How many rows of the view have been fetched into the table
+
+    int                 sortColumn = Balance;
+    Qt::SortOrder       sortOrder  = Qt::DescendingOrder;
+    QString             search;
+
+    QStringList headers;
     RPC* rpc;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,13 +1,36 @@
 #include "websockets.h"
 
+#include "mobilecrypto.h"
 #include "rpc.h"
 #include "settings.h"
 #include "ui_mobileappconnector.h"
 #include "version.h"
 
+ClientWebSocket::ClientWebSocket(WormholeClient* w) {
+    client      = w->getSocket();
+    wormhole    = w;
+    viaWormhole = true;
+    key         = w;
+    server      = nullptr;
+    protocol    = 1;
+}
+
+bool ClientWebSocket::isValid() {
+    if (viaWormhole)
+        return !wormhole.isNull();
+
+    return client && (!server || server->isValidConnection(client)) && client->isValid();
+}
+
 // Weap the sendTextMessage to check if the connection is valid and that the parent WebServer didn't close this connection
 // for some reason.
 void ClientWebSocket::sendTextMessage(QString m) {
+    if (viaWormhole) {
+        if (wormhole)
+            wormhole->sendTextMessage(m);
+        return;
+    }
+
     if (client) {
         if (server && !server->isValidConnection(client)) {
             return;
@@ -18,6 +41,17 @@ void ClientWebSocket::sendTextMessage(QString m) {
     }
 }
 
+void ClientWebSocket::sendBinaryMessage(const QByteArray& m) {
+    if (client) {
+        if (server && !server->isValidConnection(client)) {
+            return;
+        }
+
+        if (client->isValid())
+            client->sendBinaryMessage(m);
+    }
+}
+
 WSServer::WSServer(quint16 port, bool debug, QObject *parent) :
     QObject(parent),
     m_pWebSocketServer(new QWebSocketServer(QStringLiteral("Direct Connection Server"),
@@ -66,10 +100,16 @@ void WSServer::processTextMessage(QString message)
 
 void WSServer::processBinaryMessage(QByteArray message)
 {
-    //QWebSocket *pClient = qobject_cast<QWebSocket *>(sender());
+    QWebSocket *pClient = qobject_cast<QWebSocket *>(sender());
     if (m_debug)
-        qDebug() << "Binary Message received:" << message;
+        qDebug() << "Binary Message received:" << message.size() << "bytes";
 
+    if (pClient) {
+        // The first byte is the protocol version, which the reply will use too
+        int protocol = !message.isEmpty() && message[0] == 3 ? 3 : 2;
+        std::shared_ptr<ClientWebSocket> client = std::make_shared<ClientWebSocket>(pClient, this, protocol);
+        AppDataServer::getInstance()->processBinaryMessage(message, m_mainWindow, client, AppConnectionType::DIRECT);
+    }
 }
 
 void WSServer::socketDisconnected()
@@ -89,6 +129,12 @@ void WSServer::socketDisconnected()
 WormholeClient::WormholeClient(MainWindow* p, QString wormholeCode) {
     this->parent = p;
     this->code = wormholeCode;
+    disconnectedAt = QDateTime::currentMSecsSinceEpoch();
+
+    timer = new QTimer(this);
+    QObject::connect(timer, &QTimer::timeout, this, &WormholeClient::heartbeat);
+    timer->start(heartbeatInterval);
+
     connect();
 }
 
@@ -111,27 +157,43 @@ void WormholeClient::connect() {
 
     QObject::connect(m_webSocket, &QWebSocket::connected, this, &WormholeClient::onConnected);
     QObject::connect(m_webSocket, &QWebSocket::disconnected, this, &WormholeClient::closed);
+    QObject::connect(m_webSocket, &QWebSocket::pong, this, &WormholeClient::onPong);
+
+    // A connection that can't be made doesn't always say "disconnected", so retry on errors too
+    QObject::connect(m_webSocket, QOverload<QAbstractSocket::SocketError>::of(&QWebSocket::error),
+                     this, &WormholeClient::closed);
 
     m_webSocket->open(QUrl("wss://wormhole.zecqtwallet.com:443"));
     //m_webSocket->open(QUrl("ws://127.0.0.1:7070"));
 }
 
+// Wait twice as long after each failed attempt, up to maxRetryDelay. The wait is randomized between half and all
+// of that, so wallets that lost the relay at the same time don't all come back at the same time.
 void WormholeClient::retryConnect() {    
-    QTimer::singleShot(5 * 1000 * pow(2, retryCount), [=]() {
-        if (retryCount < 10) {
-            qDebug() << "Retrying websocket connection";
-            this->retryCount++;
-            connect();
-        }
-        else {
-            qDebug() << "Retry count exceeded, will not attempt retry any more";
-        }
+    if (retryPending || shuttingDown)
+        return;
+    retryPending = true;
+
+    qint64 delay = std::min((qint64)maxRetryDelay, (qint64)minRetryDelay << std::min(retryCount, 16));
+    delay = delay / 2 + randombytes_uniform(delay / 2 + 1);
+    retryCount++;
+
+    qDebug() << "Retrying websocket connection in" << delay << "ms";
+    QTimer::singleShot(delay, this, [=]() {
+        retryPending = false;
+        reconnects++;
+        connect();
     });
 }
 
 // Called when the websocket is closed. If this was closed without our explicitly closing it, 
 // then we need to try and reconnect
 void WormholeClient::closed() {
+    if (isConnected) {
+        isConnected    = false;
+        disconnectedAt = QDateTime::currentMSecsSinceEpoch();
+    }
+
     if (!shuttingDown) {
        retryConnect();
     }
@@ -140,7 +202,13 @@ void WormholeClient::closed() {
 void WormholeClient::onConnected()
 {
     qDebug() << "WebSocket connected";
-    retryCount = 0;
+    auto now = QDateTime::currentMSecsSinceEpoch();
+
+    retryCount         = 0;
+    isConnected        = true;
+    disconnectedMsecs += now - disconnectedAt;
+    lastPong           = now;
+    lastKeepalive      = now;
 
     QObject::connect(m_webSocket, &QWebSocket::textMessageReceived,
                         this, &WormholeClient::onTextMessageReceived);
@@ -151,23 +219,132 @@ void WormholeClient::onConnected()
 
     m_webSocket->sendTextMessage(payload);
 
-    // On connected, we'll also create a timer to ping it every 4 minutes, since the websocket 
-    // will timeout after 5 minutes
-    timer = new QTimer(parent);
-    QObject::connect(timer, &QTimer::timeout, [=]() {
-        if (!shuttingDown && m_webSocket->isValid()) {
-            auto payload = QJsonDocument(QJsonObject {
-                {"ping", "ping"}
-            }).toJson();
-            m_webSocket->sendTextMessage(payload);
-        }
-    });
-    timer->start(4 * 60 * 1000); // 4 minutes
+    // Send the replies that were waiting for us to come back
+    while (!outbox.isEmpty()) {
+        m_webSocket->sendTextMessage(outbox.dequeue());
+    }
+}
+
+void WormholeClient::onPong(quint64 elapsedTime, const QByteArray&) {
+    rtt      = elapsedTime;
+    lastPong = QDateTime::currentMSecsSinceEpoch();
+}
+
+void WormholeClient::heartbeat() {
+    if (shuttingDown)
+        return;
+
+    // If a connection attempt failed without telling us, start another one
+    if (!isConnected) {
+        if (m_webSocket->state() == QAbstractSocket::UnconnectedState)
+            retryConnect();
+        return;
+    }
+
+    auto now = QDateTime::currentMSecsSinceEpoch();
+
+    // The relay (or the network on the way to it) has gone away without closing the connection
+    if (now - lastPong > heartbeatTimeout) {
+        qDebug() << "Wormhole stopped answering pings, reconnecting";
+        m_webSocket->abort();
+        closed();
+        return;
+    }
+
+    m_webSocket->ping();
+
+    // The relay only counts messages, not websocket pings, when it decides a connection is idle
+    if (now - lastKeepalive >= keepaliveInterval) {
+        auto payload = QJsonDocument(QJsonObject {
+            {"ping", "ping"}
+        }).toJson();
+        m_webSocket->sendTextMessage(payload);
+        lastKeepalive = now;
+    }
+}
+
+void WormholeClient::sendTextMessage(const QString& m) {
+    if (isConnected && m_webSocket->isValid()) {
+        m_webSocket->sendTextMessage(m);
+        return;
+    }
+
+    // Hold on to it until we're back. If it has been a while, drop the oldest, which the app has likely given up on.
+    if (outbox.size() >= maxQueued) {
+        outbox.dequeue();
+        dropped++;
+    }
+    outbox.enqueue(m);
+    queued++;
+}
+
+QString WormholeClient::linkDesc() {
+    auto now     = QDateTime::currentMSecsSinceEpoch();
+    auto offline = disconnectedMsecs + (isConnected ? 0 : now - disconnectedAt);
+
+    return QObject::tr("%1, round trip %2, %3 reconnects, %4s offline, %5 queued, %6 dropped")
+        .arg(isConnected ? QObject::tr("Connected") : QObject::tr("Reconnecting"))
+        .arg(rtt < 0 ? QString("-") : QString::number(rtt) % " ms")
+        .arg(reconnects)
+        .arg(offline / 1000)
+        .arg(queued)
+        .arg(dropped);
 }
 
 void WormholeClient::onTextMessageReceived(QString message)
 {
-    AppDataServer::getInstance()->processMessage(message, parent, std::make_shared<ClientWebSocket>(m_webSocket), AppConnectionType::INTERNET);
+    auto client = std::make_shared<ClientWebSocket>(this);
+    client->setDeviceId(code);
+
+    AppDataServer::getInstance()->processMessage(message, parent, client, AppConnectionType::INTERNET);
+}
+
+
+//===============================
+// OrderedWorkers
+//===============================
+class WorkerJob : public QRunnable {
+public:
+    WorkerJob(std::function<void(void)> f) : fn(f) {}
+    void run() { fn(); }
+private:
+    std::function<void(void)> fn;
+};
+
+void OrderedWorkers::post(const void* key, std::function<void(void)> job) {
+    QMutexLocker locker(&lock);
+
+    auto& q = queues[key];
+    q.enqueue(job);
+
+    // If the queue was empty, nothing is running for this key, so start it
+    if (q.size() == 1)
+        pool.start(new WorkerJob([=] () { runNext(key); }));
+}
+
+void OrderedWorkers::runNext(const void* key) {
+    std::function<void(void)> job;
+    {
+        QMutexLocker locker(&lock);
+        job = queues[key].head();
+    }
+
+    job();
+
+    QMutexLocker locker(&lock);
+    auto& q = queues[key];
+    q.dequeue();
+    if (q.isEmpty()) {
+        queues.remove(key);
+    } else {
+        // Go to the back of the pool's queue, so other connections get a turn
+        pool.start(new WorkerJob([=] () { runNext(key); }));
+    }
+}
+
+// Run fn on the GUI thread, from the event loop. The sockets, the RPC and the UI are only used there.
+static void onGUIThread(std::function<void(void)> fn) {
+    QTimer::singleShot(0, qApp, fn);
 }
 
 
@@ -177,91 +354,285 @@ void WormholeClient::onTextMessageReceived(QString message)
 AppDataServer* AppDataServer::instance = nullptr; 
 
 QString AppDataServer::getWormholeCode(QString secretHex) {
-    unsigned char* secret = new unsigned char[crypto_secretbox_KEYBYTES];
+    unsigned char secret[crypto_secretbox_KEYBYTES];
     sodium_hex2bin(secret, crypto_secretbox_KEYBYTES, secretHex.toStdString().c_str(), crypto_secretbox_KEYBYTES*2, 
         NULL, NULL, NULL);
 
-    unsigned char* out1 = new unsigned char[crypto_hash_sha256_BYTES];
+    unsigned char out1[crypto_hash_sha256_BYTES];
     crypto_hash_sha256(out1, secret, crypto_secretbox_KEYBYTES);
 
-    unsigned char* out2 = new unsigned char[crypto_hash_sha256_BYTES];
+    unsigned char out2[crypto_hash_sha256_BYTES];
     crypto_hash_sha256(out2, out1, crypto_hash_sha256_BYTES);
 
-    char* wmcode = new char[crypto_hash_sha256_BYTES*2 + 1];
+    char wmcode[crypto_hash_sha256_BYTES*2 + 1];
     sodium_bin2hex(wmcode, crypto_hash_sha256_BYTES*2 + 1, out2, crypto_hash_sha256_BYTES);    
 
-    QString wmcodehex(wmcode);
+    sodium_memzero(secret, crypto_secretbox_KEYBYTES);
 
-    delete[] wmcode;
-    delete[] out2;
-    delete[] out1;
-    delete[] secret;
+    return QString(wmcode);
+}
 
-    return wmcodehex;
+static QString toHex(const unsigned char* bin, int len) {
+    return QString::fromLatin1(QByteArray::fromRawData((const char*)bin, len).toHex());
 }
 
-QString AppDataServer::getSecretHex() {
+/**
+ * The paired devices are read from the settings the first time they are needed, and then kept in memory, so sending
+ * and receiving messages doesn't have to touch the disk.
+ *
+ * Each device's saved local nonce is a high-water mark: it is always ahead of every nonce we have sent it, so after a
+ * crash we carry on from it and never reuse a nonce. It only needs to be saved once every localNonceReserve messages.
+ */
+void AppDataServer::loadDevices() {
+    QMutexLocker locker(&devicesLock);
+    if (devicesLoaded)
+        return;
+    devicesLoaded = true;
+
+    // The default local nonce starts from 1, to always keep it odd
+    auto defaultLocalNonce  = "01" + QString("00").repeated(crypto_secretbox_NONCEBYTES-1);
+    auto defaultRemoteNonce = QString("00").repeated(crypto_secretbox_NONCEBYTES);
+
     QSettings s;
+    int count = s.beginReadArray("mobileapp/devices");
+    for (int i = 0; i < count; i++) {
+        s.setArrayIndex(i);
+
+        auto d = makeDevice(s.value("secret").toString(),
+                            s.value("localnoncehex", defaultLocalNonce).toString(),
+                            s.value("remotenoncehex", defaultRemoteNonce).toString());
+        d->name              = s.value("name").toString();
+        d->lastSeen          = s.value("lastseentime", 0).toLongLong();
+        d->lastConnectedOver = (AppConnectionType) s.value("lastconnectedover", AppConnectionType::DIRECT).toInt();
+        d->allowInternet     = s.value("allowinternet", false).toBool();
+        devices.append(d);
+    }
+    s.endArray();
+
+    // Before several devices could be paired, the one device was saved straight under mobileapp/
+    if (count == 0 && !s.value("mobileapp/secret").toString().isEmpty()) {
+        auto d = makeDevice(s.value("mobileapp/secret").toString(),
+                            s.value("mobileapp/localnoncehex", defaultLocalNonce).toString(),
+                            s.value("mobileapp/remotenoncehex", defaultRemoteNonce).toString());
+        d->name              = s.value("mobileapp/connectedname").toString();
+        d->lastSeen          = s.value("mobileapp/lastseentime", 0).toLongLong();
+        d->lastConnectedOver = (AppConnectionType) s.value("mobileapp/lastconnectedover", AppConnectionType::DIRECT).toInt();
+        d->allowInternet     = s.value("mobileapp/allowinternet", false).toBool();
+        devices.append(d);
+
+        for (auto key : { "secret", "localnoncehex", "remotenoncehex", "connectedname", "lastseentime",
+                          "lastconnectedover", "allowinternet" }) {
+            s.remove(QString("mobileapp/") + key);
+        }
+    }
+
+    for (auto d : devices) {
+        reserveLocalNonces(d.get());
+    }
+    locker.unlock();
+
+    saveDevices();
+}
+
+std::shared_ptr<MobileDevice> AppDataServer::makeDevice(const QString& secretHex, const QString& localNonceHex, const QString& remoteNonceHex) {
+    auto d  = std::make_shared<MobileDevice>();
+    d->id   = getWormholeCode(secretHex);
+    d->keys = (MobileSession*) sodium_malloc(sizeof(MobileSession));
+    if (d->keys == nullptr)
+        qFatal("Couldn't allocate locked memory for the mobile app session");
+    sodium_memzero(d->keys, sizeof(MobileSession));
+
+    sodium_hex2bin(d->keys->secret, crypto_secretbox_KEYBYTES, secretHex.toStdString().c_str(), secretHex.length(),
+        NULL, NULL, NULL);
+    sodium_hex2bin(d->keys->localNonce, crypto_secretbox_NONCEBYTES, localNonceHex.toStdString().c_str(), localNonceHex.length(),
+        NULL, NULL, NULL);
+    sodium_hex2bin(d->keys->remoteNonce, crypto_secretbox_NONCEBYTES, remoteNonceHex.toStdString().c_str(), remoteNonceHex.length(),
+        NULL, NULL, NULL);
 
-    return s.value("mobileapp/secret", "").toString();
+    // The local nonce we start from is the saved reserve
+    memcpy(d->keys->localNonceSaved, d->keys->localNonce, crypto_secretbox_NONCEBYTES);
+
+    d->tokens     = rateLimitBurst;
+    d->lastRefill = QDateTime::currentMSecsSinceEpoch();
+
+    return d;
 }
 
-void AppDataServer::saveNewSecret(QString secretHex) {
-    QSettings().setValue("mobileapp/secret", secretHex);
+// Each device is only locked while it is copied into the settings, so its messages aren't held up while the settings
+// are written to disk. Saves happen one at a time, so an older copy can't be written over a newer one.
+void AppDataServer::saveDevices() {
+    QMutexLocker saveLocker(&saveLock);
+
+    auto all = getDevices();
+    QList<QByteArray> reserves;
+
+    QSettings s;
+    s.remove("mobileapp/devices");
+
+    s.beginWriteArray("mobileapp/devices", all.size());
+    for (int i = 0; i < all.size(); i++) {
+        const auto& d = all[i];
+        QMutexLocker locker(&d->lock);
+        s.setArrayIndex(i);
+
+        s.setValue("secret", toHex(d->keys->secret, crypto_secretbox_KEYBYTES));
+        s.setValue("localnoncehex", toHex(d->keys->localNonceReserved, crypto_secretbox_NONCEBYTES));
+        s.setValue("remotenoncehex", toHex(d->keys->remoteNonce, crypto_secretbox_NONCEBYTES));
+        s.setValue("name", d->name);
+        s.setValue("lastseentime", d->lastSeen);
+        s.setValue("lastconnectedover", d->lastConnectedOver);
+        s.setValue("allowinternet", d->allowInternet);
+
+        reserves.append(QByteArray((const char*)d->keys->localNonceReserved, crypto_secretbox_NONCEBYTES));
+    }
+    s.endArray();
+
+    s.sync();
 
-    if (secretHex.isEmpty())
-        setAllowInternetConnection(false);
+    // The reserves we wrote are on disk now, so nonces up to them can be sent
+    for (int i = 0; i < all.size(); i++) {
+        const auto& d = all[i];
+        QMutexLocker locker(&d->lock);
+
+        auto reserve = (const unsigned char*)reserves[i].constData();
+        if (sodium_compare(reserve, d->keys->localNonceSaved, crypto_secretbox_NONCEBYTES) > 0)
+            memcpy(d->keys->localNonceSaved, reserve, crypto_secretbox_NONCEBYTES);
+    }
 }
 
-bool AppDataServer::getAllowInternetConnection() {
-    return QSettings().value("mobileapp/allowinternet", false).toBool();
+// A copy of the list, so it can be used without holding devicesLock
+QList<std::shared_ptr<MobileDevice>> AppDataServer::getDevices() {
+    loadDevices();
+
+    QMutexLocker locker(&devicesLock);
+    return devices;
 }
 
-void AppDataServer::setAllowInternetConnection(bool allow) {
-    QSettings().setValue("mobileapp/allowinternet", allow);
+std::shared_ptr<MobileDevice> AppDataServer::findDevice(const QString& id) {
+    if (id.isEmpty())
+        return nullptr;
+
+    for (const auto& d : getDevices()) {
+        if (d->id == id)
+            return d;
+    }
+    return nullptr;
 }
 
-void AppDataServer::saveLastConnectedOver(AppConnectionType type) {
-    QSettings().setValue("mobileapp/lastconnectedover", type);
+// The wormhole codes of the devices that may connect over the internet
+QStringList AppDataServer::getInternetDeviceCodes() {
+    QStringList codes;
+    for (auto d : getDevices()) {
+        if (d->allowInternet)
+            codes.append(d->id);
+    }
+    return codes;
 }
 
-AppConnectionType AppDataServer::getLastConnectionType() {
-    return (AppConnectionType) QSettings().value("mobileapp/lastconnectedover", AppConnectionType::DIRECT).toInt();
+void AppDataServer::removeDevice(const QString& id, MainWindow* mainwindow) {
+    auto d = findDevice(id);
+    if (d == nullptr)
+        return;
+
+    // Its keys are freed when the last worker using it is done with it
+    {
+        QMutexLocker locker(&devicesLock);
+        devices.removeAll(d);
+    }
+
+    for (int i = subscribers.size() - 1; i >= 0; i--) {
+        if (subscribers[i]->getDeviceId() == id)
+            subscribers.removeAt(i);
+    }
+
+    if (d->allowInternet)
+        mainwindow->removeWormholeClient(id);
+
+    saveDevices();
 }
 
-void AppDataServer::saveLastSeenTime() {
-    QSettings().setValue("mobileapp/lastseentime", QDateTime::currentSecsSinceEpoch());
+// Move the reserve localNonceReserve messages ahead of the current one. The caller holds the device's lock (or the
+// device isn't shared yet), and has to save it before sending anything past the old reserve.
+void AppDataServer::reserveLocalNonces(MobileDevice* d) {
+    // Little endian, like sodium_increment(). The local nonce goes up by 2 for each message, so it stays odd.
+    unsigned char step[crypto_secretbox_NONCEBYTES] = {0};
+    quint32 n = 2 * localNonceReserve;
+    for (int i = 0; i < 4; i++) {
+        step[i] = (n >> (8 * i)) & 0xFF;
+    }
+
+    memcpy(d->keys->localNonceReserved, d->keys->localNonce, crypto_secretbox_NONCEBYTES);
+    sodium_add(d->keys->localNonceReserved, step, crypto_secretbox_NONCEBYTES);
 }
 
-QDateTime  AppDataServer::getLastSeenTime() {
-    return QDateTime::fromSecsSinceEpoch(QSettings().value("mobileapp/lastseentime", 0).toLongLong());
+/**
+ * The remote nonces can't be reserved ahead, since the apps pick them. They are saved a few seconds after they change,
+ * and straight away before a command that sends money, so a message replayed after a crash can't send it twice.
+ */
+void AppDataServer::saveSession() {
+    if (saveTimer)
+        saveTimer->stop();
+
+    if (devicesLoaded)
+        saveDevices();
 }
 
-void AppDataServer::setConnectedName(QString name) {
-    QSettings().setValue("mobileapp/connectedname", name);
+void AppDataServer::scheduleSaveSession() {
+    if (saveTimer == nullptr) {
+        saveTimer = new QTimer();
+        saveTimer->setSingleShot(true);
+        QObject::connect(saveTimer, &QTimer::timeout, [=] () { saveSession(); });
+    }
+
+    if (!saveTimer->isActive())
+        saveTimer->start(saveSessionDelay);
 }
 
-QString AppDataServer::getConnectedName() {
-    return QSettings().value("mobileapp/connectedname", "").toString();
+// A token bucket per device, so one busy phone can't keep the wallet busy for the others
+bool AppDataServer::allowMessage(MobileDevice* d) {
+    auto now = QDateTime::currentMSecsSinceEpoch();
+    d->tokens     = std::min((double)rateLimitBurst, d->tokens + (now - d->lastRefill) * rateLimitPerSec / 1000.0);
+    d->lastRefill = now;
+
+    if (d->tokens < 1)
+        return false;
+
+    d->tokens -= 1;
+    return true;
 }
 
 bool AppDataServer::isAppConnected() {
-    return !getConnectedName().isEmpty() && 
-        getLastSeenTime().daysTo(QDateTime::currentDateTime()) < 14;
+    for (const auto& d : getDevices()) {
+        QMutexLocker locker(&d->lock);
+        if (!d->name.isEmpty() && QDateTime::fromSecsSinceEpoch(d->lastSeen).daysTo(QDateTime::currentDateTime()) < 14)
+            return true;
+    }
+    return false;
 }
 
 void AppDataServer::connectAppDialog(MainWindow* parent) {
     QDialog d(parent);
     ui = new Ui_MobileAppConnector();
     ui->setupUi(&d);
+    uiParent = parent;
     Settings::saveRestore(&d);
 
     updateUIWithNewQRCode(parent);
     updateConnectedUI();
 
+    QObject::connect(ui->cmbDevices, QOverload<int>::of(&QComboBox::currentIndexChanged), [=] (int) {
+        updateDeviceUI();
+    });
+
+    // Keep the compression, load and link numbers current while the dialog is open
+    QTimer statsTimer;
+    QObject::connect(&statsTimer, &QTimer::timeout, [=] () {
+        updateDeviceUI();
+    });
+    statsTimer.start(Settings::quickUpdateSpeed);
+
     QObject::connect(ui->btnDisconnect, &QPushButton::clicked, [=] () {
-        QSettings().setValue("mobileapp/connectedname", "");
-        saveNewSecret("");
+        removeDevice(ui->cmbDevices->currentData().toString(), parent);
 
         updateConnectedUI();
     });
@@ -279,11 +650,7 @@ void AppDataServer::connectAppDialog(MainWindow* parent) {
 
     // If we're not listening for the app, then start the websockets
     if (!parent->isWebsocketListening()) {
-        QString wormholecode = "";
-        if (getAllowInternetConnection())
-            wormholecode = AppDataServer::getInstance()->getWormholeCode(AppDataServer::getInstance()->getSecretHex());
-
-        parent->createWebsocket(wormholecode);
+        parent->createWebsocket(getInternetDeviceCodes());
     }
 
     d.exec();
@@ -294,6 +661,7 @@ void AppDataServer::connectAppDialog(MainWindow* parent) {
     }
 
     // Cleanup
+    QMutexLocker locker(&devicesLock);
     tempSecret = "";
     
     delete tempWormholeClient;
@@ -301,6 +669,7 @@ void AppDataServer::connectAppDialog(MainWindow* parent) {
 
     delete ui;
     ui = nullptr;
+    uiParent = nullptr;
 }
 
 void AppDataServer::updateUIWithNewQRCode(MainWindow* mainwindow) {
@@ -342,6 +711,7 @@ void AppDataServer::updateUIWithNewQRCode(MainWindow* mainwindow) {
 }
 
 void AppDataServer::registerNewTempSecret(QString tmpSecretHex, bool allowInternet, MainWindow* main) {
+    QMutexLocker locker(&devicesLock);
     tempSecret = tmpSecretHex;
 
     delete tempWormholeClient;
@@ -364,247 +734,351 @@ void AppDataServer::updateConnectedUI() {
     if (ui == nullptr)
         return;
 
-    auto remoteName = getConnectedName();
+    // List the paired devices, keeping the one that was selected
+    auto selected = ui->cmbDevices->currentData().toString();
 
-    ui->lblRemoteName->setText(remoteName.isEmpty() ?  "(Not connected to any device)" : remoteName);
-    ui->lblLastSeen->setText(remoteName.isEmpty() ? "" : getLastSeenTime().toString(Qt::SystemLocaleLongDate));
-    ui->lblConnectionType->setText(remoteName.isEmpty() ? "" : connDesc(getLastConnectionType()));
+    ui->cmbDevices->blockSignals(true);
+    ui->cmbDevices->clear();
+    for (const auto& d : getDevices()) {
+        QMutexLocker locker(&d->lock);
+        ui->cmbDevices->addItem(d->name.isEmpty() ? QObject::tr("(Not connected yet)") : d->name, d->id);
+    }
+    auto idx = ui->cmbDevices->findData(selected);
+    ui->cmbDevices->setCurrentIndex(idx >= 0 ? idx : 0);
+    ui->cmbDevices->blockSignals(false);
 
-    ui->btnDisconnect->setEnabled(!remoteName.isEmpty());
+    updateDeviceUI();
 }
 
-QString AppDataServer::getNonceHex(NonceType nt) {
-    QSettings s;
-    QString hex;
-    if (nt == NonceType::LOCAL) {
-        // The default local nonce starts from 1, to always keep it odd
-        auto defaultLocalNonce = "01" + QString("00").repeated(crypto_secretbox_NONCEBYTES-1);
-        hex = s.value("mobileapp/localnoncehex", defaultLocalNonce).toString();
-    }
-    else {
-        hex = s.value("mobileapp/remotenoncehex", QString("00").repeated(crypto_secretbox_NONCEBYTES)).toString();
-    }
-    return hex;
+static QString bytesDesc(qint64 bytes) {
+    if (bytes < 1024)
+        return QObject::tr("%1 bytes").arg(bytes);
+    else if (bytes < 1024 * 1024)
+        return QObject::tr("%1 kB").arg(bytes / 1024.0, 0, 'f', 1);
+    else
+        return QObject::tr("%1 MB").arg(bytes / (1024.0 * 1024), 0, 'f', 1);
 }
 
-void AppDataServer::saveNonceHex(NonceType nt, QString noncehex) {
-    QSettings s;
-    assert(noncehex.length() == crypto_secretbox_NONCEBYTES * 2);
-    if (nt == NonceType::LOCAL) {
-        s.setValue("mobileapp/localnoncehex", noncehex);
-    }
-    else {
-        s.setValue("mobileapp/remotenoncehex", noncehex);
-    }
-    s.sync();
-}
+// Show the device that is selected in the list
+void AppDataServer::updateDeviceUI() {
+    if (ui == nullptr)
+        return;
 
-// Encrypt an outgoing message with the stored secret key.
-QString AppDataServer::encryptOutgoing(QString msg) {
-    if (msg.length() % 256 > 0) {
-        msg = msg + QString(" ").repeated(256 - (msg.length() % 256));
-    }
+    auto d = findDevice(ui->cmbDevices->currentData().toString());
+    QMutexLocker locker(d == nullptr ? nullptr : &d->lock);
 
-    QString localNonceHex = getNonceHex(NonceType::LOCAL);
+    ui->lblRemoteName->setText(d == nullptr ?  "(Not connected to any device)" : d->name);
+    ui->lblLastSeen->setText(d == nullptr ? "" : QDateTime::fromSecsSinceEpoch(d->lastSeen).toString(Qt::SystemLocaleLongDate));
+    ui->lblConnectionType->setText(d == nullptr ? "" : connDesc(d->lastConnectedOver));
 
-    unsigned char* noncebin = new unsigned char[crypto_secretbox_NONCEBYTES];
-    sodium_hex2bin(noncebin, crypto_secretbox_NONCEBYTES, localNonceHex.toStdString().c_str(), localNonceHex.length(),
-        NULL, NULL, NULL);
+    if (d == nullptr || d->uncompressedBytes == 0) {
+        ui->lblCompression->setText(QObject::tr("Not used"));
+    } else {
+        auto saved = d->uncompressedBytes - d->compressedBytes;
+        ui->lblCompression->setText(QObject::tr("%1 saved (%2:1)")
+            .arg(bytesDesc(saved))
+            .arg((double)d->uncompressedBytes / d->compressedBytes, 0, 'f', 1));
+    }
 
-    // Increment the nonce +2 and save
-    sodium_increment(noncebin, crypto_secretbox_NONCEBYTES);
-    sodium_increment(noncebin, crypto_secretbox_NONCEBYTES);
+    ui->lblMessageStats->setText(timingDesc());
 
-    char* newLocalNonce = new char[crypto_secretbox_NONCEBYTES*2 + 1];
-    sodium_memzero(newLocalNonce, crypto_secretbox_NONCEBYTES*2 + 1);
-    sodium_bin2hex(newLocalNonce, crypto_secretbox_NONCEBYTES*2+1, noncebin, crypto_box_NONCEBYTES);
+    auto wormhole = (d != nullptr && d->allowInternet && uiParent != nullptr) ? uiParent->getWormholeClient(d->id) : nullptr;
+    ui->lblLink->setText(wormhole == nullptr ? QObject::tr("Not used") : wormhole->linkDesc());
 
-    saveNonceHex(NonceType::LOCAL, QString(newLocalNonce));
+    ui->btnDisconnect->setEnabled(d != nullptr);
+}
 
-    unsigned char* secret = new unsigned char[crypto_secretbox_KEYBYTES];
-    sodium_hex2bin(secret, crypto_secretbox_KEYBYTES, getSecretHex().toStdString().c_str(), crypto_secretbox_KEYBYTES*2, 
-        NULL, NULL, NULL);
+// Increment the device's local nonce +2, and move the reserve on if we've used it up. The caller saves the new reserve
+// before sending anything encrypted with it.
+const unsigned char* AppDataServer::nextLocalNonce(MobileDevice* d) {
+    sodium_increment(d->keys->localNonce, crypto_secretbox_NONCEBYTES);
+    sodium_increment(d->keys->localNonce, crypto_secretbox_NONCEBYTES);
+    if (sodium_compare(d->keys->localNonce, d->keys->localNonceReserved, crypto_secretbox_NONCEBYTES) > 0)
+        reserveLocalNonces(d);
 
-    int msgSize = strlen(msg.toStdString().c_str());
-    unsigned char* encrpyted = new unsigned char[ msgSize + crypto_secretbox_MACBYTES];
+    return d->keys->localNonce;
+}
 
-    crypto_secretbox_easy(encrpyted, (const unsigned char *)msg.toStdString().c_str(), msgSize, noncebin, secret);
+// Encrypt the message for the device the client is, with the protocol it used, and send it. The nonces have to reach
+// the app in order, so the encrypting is done on the client's worker, and the frames are sent in the order they
+// were encrypted.
+void AppDataServer::sendEncrypted(std::shared_ptr<ClientWebSocket> pClient, QString msg) {
+    workers.post(pClient->getKey(), [=] () {
+        auto d = findDevice(pClient->getDeviceId());
+        if (d == nullptr)
+            return;
 
-    int encryptedHexSize = (msgSize + crypto_secretbox_MACBYTES) * 2 + 1;
-    char * encryptedHex = new char[encryptedHexSize];     
-    sodium_memzero(encryptedHex, encryptedHexSize);
-    sodium_bin2hex(encryptedHex, encryptedHexSize, encrpyted, msgSize + crypto_secretbox_MACBYTES);
+        bool        binary = pClient->getProtocol() >= 2;
+        QByteArray  binaryFrame;
+        QString     textFrame;
+        bool        unsaved;
+        {
+            QMutexLocker locker(&d->lock);
+            if (binary)
+                binaryFrame = encryptOutgoingBinary(d.get(), msg, pClient->getProtocol());
+            else
+                textFrame = encryptOutgoing(d.get(), msg);
+
+            unsaved = sodium_compare(d->keys->localNonce, d->keys->localNonceSaved, crypto_secretbox_NONCEBYTES) > 0;
+        }
 
-    auto json =  QJsonDocument(QJsonObject{
-            {"nonce", QString(newLocalNonce)},
-            {"payload", QString(encryptedHex)},
-            {"to", getWormholeCode(getSecretHex())}
+        // A nonce can only go out once it's covered by a saved reserve, so it is never reused after a crash
+        if (unsaved)
+            saveDevices();
+
+        // The message is timed until its first reply is on the socket, so the encrypting and the wait for the GUI
+        // thread are counted too
+        auto receivedAt = pClient->takeReceivedAt();
+        onGUIThread([=] () {
+            if (binary)
+                pClient->sendBinaryMessage(binaryFrame);
+            else
+                pClient->sendTextMessage(textFrame);
+
+            if (receivedAt != 0)
+                recordTiming(receivedAt);
         });
-    
-    delete[] noncebin;
-    delete[] newLocalNonce;
-    delete[] secret;
-    delete[] encrpyted;
-    delete[] encryptedHex;
-
-    return json.toJson();
+    });
 }
 
-/**
-  Attempt to decrypt a message. If the decryption fails, it returns the string "error", the decrypted message otherwise. 
-  It will use the given secret to attempt decryption. In addition, it will enforce that the nonce is greater than the last seen nonce, 
-  unless the skipNonceCheck = true, which is used when attempting decrtption with a temp secret key.
-*/
-QString AppDataServer::decryptMessage(QJsonDocument msg, QString secretHex, QString lastRemoteNonceHex) {
-    // Decrypt and then process
-    QString noncehex = msg.object().value("nonce").toString();
-    QString encryptedhex = msg.object().value("payload").toString();
-
-    // Enforce limits on the size of the message
-    if (noncehex.length() > ((int)crypto_secretbox_NONCEBYTES * 2) ||
-        encryptedhex.length() > 2 * 50 * 1024 /*50kb*/) {
-        return "error";
-    }
-
-    // Check to make sure that the nonce is greater than the last known remote nonce
-    unsigned char* lastRemoteBin = new unsigned char[crypto_secretbox_NONCEBYTES];
-    sodium_hex2bin(lastRemoteBin, crypto_secretbox_NONCEBYTES, lastRemoteNonceHex.toStdString().c_str(), lastRemoteNonceHex.length(),
-        NULL, NULL, NULL);
-
-    unsigned char* noncebin = new unsigned char[crypto_secretbox_NONCEBYTES];
-    sodium_hex2bin(noncebin, crypto_secretbox_NONCEBYTES, noncehex.toStdString().c_str(), noncehex.length(),
-        NULL, NULL, NULL);
-
-    assert(crypto_secretbox_KEYBYTES == crypto_hash_sha256_BYTES);
-    if (sodium_compare(lastRemoteBin, noncebin, crypto_secretbox_NONCEBYTES) != -1) {
-        // Refuse to accept a lower nonce, return an error
-        delete[] lastRemoteBin;
-        delete[] noncebin;
-        return "error";
-    }
-    
-    unsigned char* secret = new unsigned char[crypto_secretbox_KEYBYTES];
-    sodium_hex2bin(secret, crypto_secretbox_KEYBYTES, secretHex.toStdString().c_str(), crypto_secretbox_KEYBYTES*2, 
-        NULL, NULL, NULL);
+// Encrypt a reply for the device with the next local nonce. The caller holds the device's lock.
+QString AppDataServer::encryptOutgoing(MobileDevice* d, QString msg) {
+    return MobileCrypto::encryptText(msg, nextLocalNonce(d), d->keys->secret, d->id);
+}
 
-    unsigned char* encrypted = new unsigned char[encryptedhex.length() / 2];
-    sodium_hex2bin(encrypted, encryptedhex.length() / 2, encryptedhex.toStdString().c_str(), encryptedhex.length(),
-                    NULL, NULL, NULL);
+QByteArray AppDataServer::encryptOutgoingBinary(MobileDevice* d, QString msg, int protocol) {
+    return MobileCrypto::encryptBinary(msg, protocol, nextLocalNonce(d), d->keys->secret,
+                                       &d->uncompressedBytes, &d->compressedBytes);
+}
 
-    int decryptedLen = encryptedhex.length() / 2 - crypto_secretbox_MACBYTES;
-    unsigned char* decrypted = new unsigned char[decryptedLen];
-    int result = crypto_secretbox_open_easy(decrypted, encrypted, encryptedhex.length() / 2, noncebin, secret);
+/**
+ * Process an incoming text message. The message has to be encrypted with the secret key (or the temporary secret key).
+ * 
+ * Messages are handled on the workers, so parsing and decrypting them doesn't hold up the UI. Only the commands that
+ * need the RPC (sending a Tx) go back to the GUI thread. The rest are answered from the wallet snapshot.
+ */
+void AppDataServer::processMessage(QString message, MainWindow* mainWindow, std::shared_ptr<ClientWebSocket> pClient, AppConnectionType connType) {
+    pClient->setReceivedAt(clock.nsecsElapsed());
+    workers.post(pClient->getKey(), [=] () {
+        auto replyWithError = [=]() {
+            auto r = QJsonDocument(QJsonObject{
+                        {"error", "Encryption error"},
+                        {"to", pClient->getDeviceId()}
+                }).toJson();
+                onGUIThread([=] () { pClient->sendTextMessage(r); });
+                return;
+        };
+        
+        // First, extract the command from the message
+        auto msg = QJsonDocument::fromJson(message.toUtf8());
 
-    QString payload;
-    if (result == -1) {
-        payload = "error";        
-    } else {
-        // Update the last seen remote hex
-        saveNonceHex(NonceType::REMOTE, noncehex);
-        saveLastSeenTime();
+        // Check if we got an error from the websocket
+        if (msg.object().contains("error")) {
+            qDebug() << "Error:" << msg.toJson();
+            return;
+        }
 
-        char* decryptedStr = new char[decryptedLen + 1];
-        sodium_memzero(decryptedStr, decryptedLen + 1);
-        memcpy(decryptedStr, decrypted, decryptedLen);
+        // If the message is a ping, just ignore it
+        if (msg.object().contains("ping")) {
+            return;
+        }
 
-        payload = QString(decryptedStr);
+        // Then, check if the message is encrpted
+        if (!msg.object().contains("nonce")) {
+            replyWithError();
+            return;
+        }
 
-        delete[] decryptedStr;
-    }
+        processEncryptedMessage([=] (const unsigned char* secret, unsigned char* lastRemoteNonce) {
+            return MobileCrypto::decryptText(msg, secret, lastRemoteNonce);
+        }, mainWindow, pClient, connType);
+    });
+}
 
-    delete[] secret;
-    delete[] lastRemoteBin;
-    delete[] noncebin;
-    delete[] encrypted;
-    delete[] decrypted;
-    
-    return payload;
+// Process an incoming binary (protocol 2 or 3) message. The replies to it use the same protocol.
+void AppDataServer::processBinaryMessage(QByteArray message, MainWindow* mainWindow, std::shared_ptr<ClientWebSocket> pClient, AppConnectionType connType) {
+    pClient->setReceivedAt(clock.nsecsElapsed());
+    workers.post(pClient->getKey(), [=] () {
+        processEncryptedMessage([=] (const unsigned char* secret, unsigned char* lastRemoteNonce) {
+            return MobileCrypto::decryptBinary(message, secret, lastRemoteNonce);
+        }, mainWindow, pClient, connType);
+    });
 }
 
-// Process an incoming text message. The message has to be encrypted with the secret key (or the temporary secret key)
-void AppDataServer::processMessage(QString message, MainWindow* mainWindow, std::shared_ptr<ClientWebSocket> pClient, AppConnectionType connType) {
-    auto replyWithError = [=]() {
+/**
+ * Find the paired device that sent the message, by decrypting it with each device's key (the wormhole tells us which
+ * device it should be, so that one is tried first). If none of them can, and the connect dialog is showing a new
+ * secret, this may be a new device pairing, so try that as well.
+ *
+ * Runs on the client's worker.
+ */
+void AppDataServer::processEncryptedMessage(std::function<QString(const unsigned char*, unsigned char*)> decrypt,
+                                            MainWindow* mainWindow, std::shared_ptr<ClientWebSocket> pClient, AppConnectionType connType) {
+    auto replyWithError = [=](QString err) {
         auto r = QJsonDocument(QJsonObject{
-                    {"error", "Encryption error"},
-                    {"to", getWormholeCode(getSecretHex())}
+                    {"error", err},
+                    {"to", pClient->getDeviceId()}
             }).toJson();
-            pClient->sendTextMessage(r);
+            onGUIThread([=] () { pClient->sendTextMessage(r); });
             return;
     };
-    
-    // First, extract the command from the message
-    auto msg = QJsonDocument::fromJson(message.toUtf8());
 
-    // Check if we got an error from the websocket
-    if (msg.object().contains("error")) {
-        qDebug() << "Error:" << msg.toJson();
-        return;
+    QList<std::shared_ptr<MobileDevice>> candidates;
+    auto hinted = findDevice(pClient->getDeviceId());
+    if (hinted != nullptr)
+        candidates.append(hinted);
+    for (const auto& d : getDevices()) {
+        if (d != hinted)
+            candidates.append(d);
     }
 
-    // If the message is a ping, just ignore it
-    if (msg.object().contains("ping")) {
-        return;
+    std::shared_ptr<MobileDevice> device;
+    QString                       decrypted = "error";
+    for (const auto& d : candidates) {
+        QMutexLocker locker(&d->lock);
+        decrypted = decrypt(d->keys->secret, d->keys->remoteNonce);
+        if (decrypted != "error") {
+            device = d;
+            break;
+        }
     }
 
-    // Then, check if the message is encrpted
-    if (!msg.object().contains("nonce")) {
-        replyWithError();
-        return;
-    }
+    bool            newDevice = false;
+    WormholeClient* wormhole  = nullptr;
+    if (device == nullptr) {
+        QString secret;
+        {
+            QMutexLocker locker(&devicesLock);
+            secret = tempSecret;
+        }
 
-    auto decrypted = decryptMessage(msg, getSecretHex(), getNonceHex(NonceType::REMOTE));
-
-    // If the decryption failed, maybe this is a new connection, so see if the dialog is open and a 
-    // temp secret is in place
-    if (decrypted == "error") {
-        // If the dialog is open, then there might be a temporary, new secret key. Attempt to decrypt
-        // with that.
-        if (!tempSecret.isEmpty()) {
-            // Since this is a temp secret, the last seen nonce will be "0", so basically we'll accept any nonce
-            QString zeroNonce = QString("00").repeated(crypto_secretbox_NONCEBYTES);
-            decrypted = decryptMessage(msg, tempSecret, zeroNonce);
-            if (decrypted == "error") {
-                // Oh, well. Just return an error
-                replyWithError();
-                return;
-            }
-            else {
-                // This is a new connection. So, update the the secret. Note the last seen remote nonce has already been updated by
-                // decryptMessage()
-                saveNewSecret(tempSecret);
-                setAllowInternetConnection(tempWormholeClient != nullptr);
+        if (secret.isEmpty()) {
+            replyWithError("Encryption error");
+            return;
+        }
+
+        // Since this is a temp secret, the last seen nonce will be "0", so basically we'll accept any nonce. The device
+        // isn't shared with anyone until it's added to the list, so it doesn't need locking yet.
+        auto defaultLocalNonce = "01" + QString("00").repeated(crypto_secretbox_NONCEBYTES-1);
+        device = makeDevice(secret, defaultLocalNonce, QString("00").repeated(crypto_secretbox_NONCEBYTES));
 
-                // Swap out the wormhole connection
-                mainWindow->replaceWormholeClient(tempWormholeClient);
-                tempWormholeClient = nullptr;
+        decrypted = decrypt(device->keys->secret, device->keys->remoteNonce);
+        if (decrypted == "error") {
+            // Oh, well. Just return an error
+            replyWithError("Encryption error");
+            return;
+        }
 
-                saveLastConnectedOver(connType);
-                processDecryptedMessage(decrypted, mainWindow, pClient);
+        QMutexLocker locker(&devicesLock);
 
-                // If the Connection UI is showing, we have to update the UI as well
-                if (ui != nullptr) {
-                    // Update the connected phone information
-                    updateConnectedUI();
+        // Another message paired with this secret first, or the dialog moved on to a new one
+        if (tempSecret != secret) {
+            locker.unlock();
+            replyWithError("Encryption error");
+            return;
+        }
 
-                    // Update with a new QR Code for safety, so this secret isn't used by anyone else
-                    updateUIWithNewQRCode(mainWindow);
-                }
+        // This is a new device. Note the last seen remote nonce has already been updated by decrypt()
+        newDevice               = true;
+        device->allowInternet   = tempWormholeClient != nullptr;
+        reserveLocalNonces(device.get());
+        devices.append(device);
 
-                return;
-            }
+        // Its wormhole connection stays open
+        wormhole = tempWormholeClient;
+        tempWormholeClient = nullptr;
+
+        // A new secret is made for the next device
+        tempSecret = "";
+    }
+
+    {
+        QMutexLocker locker(&device->lock);
+        if (!allowMessage(device.get())) {
+            locker.unlock();
+            replyWithError("Too many requests");
+            return;
         }
-        else {
-            replyWithError();
+
+        device->lastSeen          = QDateTime::currentSecsSinceEpoch();
+        device->lastConnectedOver = connType;
+    }
+
+    if (newDevice)
+        saveDevices();
+
+    pClient->setDeviceId(device->id);
+
+    onGUIThread([=] () {
+        if (!newDevice) {
+            scheduleSaveSession();
             return;
         }
+
+        if (wormhole != nullptr)
+            mainWindow->addWormholeClient(wormhole);
+
+        // If the Connection UI is showing, we have to update the UI as well
+        if (ui != nullptr) {
+            // Update the connected phone information
+            updateConnectedUI();
+
+            // Update with a new QR Code for safety, so this secret isn't used by anyone else
+            updateUIWithNewQRCode(mainWindow);
+        }
+    });
+
+    processDecryptedMessage(decrypted, mainWindow, pClient);
+}
+
+void AppDataServer::recordTiming(qint64 receivedAt) {
+    auto now = clock.nsecsElapsed();
+    MessageTiming t { now / 1000000, (now - receivedAt) / 1000 };
+
+    QMutexLocker locker(&timingsLock);
+    if (timings.size() < maxTimings) {
+        timings.append(t);
     } else {
-        saveLastConnectedOver(connType);
-        processDecryptedMessage(decrypted, mainWindow, pClient);
-        return;
+        timings[nextTiming] = t;
+        nextTiming = (nextTiming + 1) % maxTimings;
     }
 }
 
-// Decrypted method will be executed here. 
+// The throughput over the last few seconds, and the percentiles of how long the recent messages took to be answered
+QString AppDataServer::timingDesc() {
+    QVector<MessageTiming> recent;
+    {
+        QMutexLocker locker(&timingsLock);
+        recent = timings;
+    }
+
+    if (recent.isEmpty())
+        return QObject::tr("None yet");
+
+    const qint64 window = 10 * 1000;
+    auto since = clock.elapsed() - window;
+
+    QVector<qint64> took;
+    int inWindow = 0;
+    for (const auto& t : recent) {
+        took.append(t.took);
+        if (t.doneAt >= since)
+            inWindow++;
+    }
+    std::sort(took.begin(), took.end());
+
+    auto percentile = [&] (int p) {
+        return took[std::min(took.size() - 1, took.size() * p / 100)] / 1000.0;
+    };
+
+    return QObject::tr("%1/s, %2 / %3 / %4 ms (50th / 95th / 99th)")
+        .arg(inWindow * 1000.0 / window, 0, 'f', 1)
+        .arg(percentile(50), 0, 'f', 1)
+        .arg(percentile(95), 0, 'f', 1)
+        .arg(percentile(99), 0, 'f', 1);
+}
+
+// Decrypted method will be executed here, on the client's worker.
 void AppDataServer::processDecryptedMessage(QString message, MainWindow* mainWindow, std::shared_ptr<ClientWebSocket> pClient) {
     // First, extract the command from the message
     auto msg = QJsonDocument::fromJson(message.toUtf8());
@@ -614,36 +1088,43 @@ void AppDataServer::processDecryptedMessage(QString message, MainWindow* mainWin
             {"errorCode", -1},
             {"errorMessage", "Unknown JSON format"}
         }).toJson();
-        pClient->sendTextMessage(encryptOutgoing(r));
+        sendEncrypted(pClient, r);
         return;
     }
     
     if (msg.object()["command"] == "getInfo") {
-        processGetInfo(msg.object(), mainWindow, pClient);
+        processGetInfo(msg.object(), pClient);
     }
     else if (msg.object()["command"] == "getTransactions") {
-        processGetTransactions(mainWindow, pClient);
+        processGetTransactions(pClient);
+    }
+    else if (msg.object()["command"] == "subscribe" || msg.object()["command"] == "unsubscribe") {
+        onGUIThread([=] () { processSubscribe(msg.object(), pClient); });
     }
     else if (msg.object()["command"] == "sendTx") {
-        processSendTx(msg.object()["tx"].toObject(), mainWindow, pClient);
+        onGUIThread([=] () {
+            // Make sure this message can't be replayed, even if we crash
+            saveSession();
+            processSendTx(msg.object()["tx"].toObject(), mainWindow, pClient);
+        });
     }
     else {
         auto r = QJsonDocument(QJsonObject{
             {"errorCode", -1},
             {"errorMessage", "Command not found:" + msg.object()["command"].toString()}
         }).toJson();
-        pClient->sendTextMessage(encryptOutgoing(r));
+        sendEncrypted(pClient, r);
     }
 }
 
-// "sendTx" command. This method will actually send money, so be careful with everything
+// "sendTx" command, on the GUI thread. This method will actually send money, so be careful with everything
 void AppDataServer::processSendTx(QJsonObject sendTx, MainWindow* mainwindow, std::shared_ptr<ClientWebSocket> pClient) {
     auto error = [=](QString reason) {
         auto r = QJsonDocument(QJsonObject{
            {"errorCode", -1},
            {"errorMessage", "Couldn't send Tx:" + reason}
         }).toJson();
-        pClient->sendTextMessage(encryptOutgoing(r));
+        sendEncrypted(pClient, r);
         return;
     };
 
@@ -658,9 +1139,9 @@ void AppDataServer::processSendTx(QJsonObject sendTx, MainWindow* mainwindow, st
     tx.fee = Settings::getMinerFee();
 
     // Find a from address that has at least the sending amout
-    double amt = sendTx["amount"].toString().toDouble();
+    Amount amt = Amount::fromDouble(sendTx["amount"].toString().toDouble());
     auto allBalances = mainwindow->getRPC()->getAllBalances();
-    QList<QPair<QString, double>> bals;
+    QList<QPair<QString, Amount>> bals;
     for (auto i : allBalances->keys()) {
         // Filter out sprout addresses
         if (Settings::getInstance()->isSproutAddress(i))
@@ -669,7 +1150,7 @@ void AppDataServer::processSendTx(QJsonObject sendTx, MainWindow* mainwindow, st
         if (allBalances->value(i) < amt)
             continue;
 
-        bals.append(QPair<QString, double>(i, allBalances->value(i)));
+        bals.append(QPair<QString, Amount>(i, allBalances->value(i)));
     }
 
     if (bals.isEmpty()) {
@@ -677,7 +1158,7 @@ void AppDataServer::processSendTx(QJsonObject sendTx, MainWindow* mainwindow, st
         return;
     }
 
-    std::sort(bals.begin(), bals.end(), [=](const QPair<QString, double>a, const QPair<QString, double> b) -> bool {
+    std::sort(bals.begin(), bals.end(), [=](const QPair<QString, Amount>a, const QPair<QString, Amount> b) -> bool {
         // Sort z addresses first
         return a.first > b.first;
     });
@@ -693,6 +1174,18 @@ void AppDataServer::processSendTx(QJsonObject sendTx, MainWindow* mainwindow, st
         return;
     }
 
+    // A dry run stops here, after everything has been checked, so apps (and load tests) can try a send for free
+    if (sendTx["dryrun"].toBool()) {
+        auto r = QJsonDocument(QJsonObject{
+                {"version", 1.0},
+                {"command", "sendTx"},
+                {"result",  "dryrun"},
+                {"from",    tx.fromAddr}
+            }).toJson();
+        sendEncrypted(pClient, r);
+        return;
+    }
+
     json params = json::array();
     mainwindow->getRPC()->fillTxJsonParams(params, tx);
     std::cout << std::setw(2) << params << std::endl;
@@ -707,7 +1200,7 @@ void AppDataServer::processSendTx(QJsonObject sendTx, MainWindow* mainwindow, st
                {"command", "sendTxSubmitted"},
                {"txid",  txid}
             }).toJson();
-            pClient->sendTextMessage(encryptOutgoing(r));
+            sendEncrypted(pClient, r);
         },
         // Errored while submitting Tx
         [=] (QString, QString errStr) {
@@ -716,7 +1209,7 @@ void AppDataServer::processSendTx(QJsonObject sendTx, MainWindow* mainwindow, st
                {"command", "sendTxFailed"},
                {"err",  errStr}
             }).toJson();
-            pClient->sendTextMessage(encryptOutgoing(r));
+            sendEncrypted(pClient, r);
         }   
     );
 
@@ -725,80 +1218,65 @@ void AppDataServer::processSendTx(QJsonObject sendTx, MainWindow* mainwindow, st
             {"command", "sendTx"},
             {"result",  "success"}
         }).toJson();
-    pClient->sendTextMessage(encryptOutgoing(r));
+    sendEncrypted(pClient, r);
 }
 
 // "getInfo" command
-void AppDataServer::processGetInfo(QJsonObject jobj, MainWindow* mainWindow, std::shared_ptr<ClientWebSocket> pClient) {
+void AppDataServer::processGetInfo(QJsonObject jobj, std::shared_ptr<ClientWebSocket> pClient) {
     auto connectedName = jobj["name"].toString();
     
-    if (mainWindow == nullptr || mainWindow->getRPC() == nullptr ||
-            mainWindow->getRPC()->getAllBalances() == nullptr) {
-        pClient->close(QWebSocketProtocol::CloseCodeNormal, "Not yet ready");
+    auto current = getSnapshot();
+    if (current->info.isEmpty()) {
+        onGUIThread([=] () { pClient->close(QWebSocketProtocol::CloseCodeNormal, "Not yet ready"); });
         return;
     }
 
+    bool renamed = false;
+    auto device  = findDevice(pClient->getDeviceId());
+    if (device != nullptr) {
+        QMutexLocker locker(&device->lock);
+        renamed      = device->name != connectedName;
+        device->name = connectedName;
+    }
 
-    // Max spendable safely from a z address and from any address
-    double maxZSpendable = 0;
-    double maxSpendable = 0;
-    for (auto a : mainWindow->getRPC()->getAllBalances()->keys()) {
-        if (Settings::getInstance()->isSaplingAddress(a)) {
-            if (mainWindow->getRPC()->getAllBalances()->value(a) > maxZSpendable) {
-                maxZSpendable = mainWindow->getRPC()->getAllBalances()->value(a);
-            }
-        }
-        if (mainWindow->getRPC()->getAllBalances()->value(a) > maxSpendable) {
-            maxSpendable = mainWindow->getRPC()->getAllBalances()->value(a);
-        }
+    if (renamed) {
+        saveDevices();
+        onGUIThread([=] () { updateConnectedUI(); });
     }
 
-    setConnectedName(connectedName);
+    auto info = current->info;
+    info["version"] = 1.0;
+    info["maxprotocol"] = pClient->getMaxProtocol();
+    info["command"] = "getInfo";
 
-    auto r = QJsonDocument(QJsonObject{
-        {"version", 1.0},
-        {"command", "getInfo"},
+    auto r = QJsonDocument(info).toJson();
+    sendEncrypted(pClient, r);
+}
+
+// The part of the "getInfo" reply that changes as the wallet is used
+QJsonObject AppDataServer::walletInfo(MainWindow* mainWindow) {
+    // Max spendable safely from a z address and from any address
+    const auto& summary = mainWindow->getRPC()->getWalletSummary();
+
+    return QJsonObject{
         {"saplingAddress", mainWindow->getRPC()->getDefaultSaplingAddress()},
         {"tAddress", mainWindow->getRPC()->getDefaultTAddress()},
         {"balance", AppDataModel::getInstance()->getTotalBalance()},
-        {"maxspendable", maxSpendable},
-        {"maxzspendable", maxZSpendable},
+        {"maxspendable", summary.maxSpendable.toDecimalDouble()},
+        {"maxzspendable", summary.maxZSpendable.toDecimalDouble()},
         {"tokenName", Settings::getTokenName()},
         {"zecprice", Settings::getInstance()->getZECPrice()},
         {"serverversion", QString(APP_VERSION)}
-    }).toJson();
-    pClient->sendTextMessage(encryptOutgoing(r));
+    };
 }
 
-void AppDataServer::processGetTransactions(MainWindow* mainWindow, std::shared_ptr<ClientWebSocket> pClient) {
-    QJsonArray txns;
-    auto model = mainWindow->getRPC()->getTransactionsModel();
+void AppDataServer::processGetTransactions(std::shared_ptr<ClientWebSocket> pClient) {
+    auto current = getSnapshot();
 
-    // Manually add pending ops, so that computing transactions will also show up
-    auto wtxns = mainWindow->getRPC()->getWatchingTxns();
-    for (auto opid : wtxns.keys()) {
-        txns.append(QJsonObject{
-            {"type", "send"},
-            {"datetime", QDateTime::currentSecsSinceEpoch()},
-            {"amount", Settings::getDecimalString(wtxns[opid].tx.toAddrs[0].amount)},
-            {"txid", ""},
-            {"address", wtxns[opid].tx.toAddrs[0].addr},
-            {"memo", wtxns[opid].tx.toAddrs[0].txtMemo},
-            {"confirmations", 0}
-            });
-    }
-    
-    // Add transactions
-    for (int i = 0; i < model->rowCount(QModelIndex()) && i < Settings::getMaxMobileAppTxns(); i++) {
-        txns.append(QJsonObject{
-            {"type", model->getType(i)},
-            {"datetime", model->getDate(i)},
-            {"amount", model->getAmt(i)},
-            {"txid", model->getTxId(i)},
-            {"address", model->getAddr(i)},
-            {"memo", model->getMemo(i)},
-            {"confirmations", model->getConfirmations(i)}
-        });
+    // Pending ops go first, so that computing transactions will also show up
+    QJsonArray txns = current->pending;
+    for (const auto& t : current->transactions) {
+        txns.append(t);
     }
 
     auto r = QJsonDocument(QJsonObject{
@@ -806,7 +1284,171 @@ void AppDataServer::processGetTransactions(MainWindow* mainWindow, std::shared_p
             {"command", "getTransactions"},
             {"transactions", txns}
         }).toJson();
-    pClient->sendTextMessage(encryptOutgoing(r));
+    sendEncrypted(pClient, r);
+}
+
+/**
+ * "subscribe" command. Instead of polling getInfo and getTransactions, a subscribed app is pushed events as the
+ * wallet changes:
+ *   {"event": "info", ...}                          the getInfo fields that changed
+ *   {"event": "transactions", "new": [...], "confirmations": [{"txid", "address", "type", "confirmations"}]}
+ *   {"event": "op", "opid", "status", "txid", "error"}   a send started computing, or finished
+ */
+void AppDataServer::processSubscribe(QJsonObject jobj, std::shared_ptr<ClientWebSocket> pClient) {
+    // The subscribers are only used on the GUI thread
+    for (int i = subscribers.size() - 1; i >= 0; i--) {
+        if (!subscribers[i]->isValid() || subscribers[i]->isSameSocket(*pClient))
+            subscribers.removeAt(i);
+    }
+
+    bool subscribe = jobj["command"].toString() == "subscribe";
+    if (subscribe)
+        subscribers.append(pClient);
+
+    auto r = QJsonDocument(QJsonObject{
+            {"version", 1.0},
+            {"command", jobj["command"].toString()},
+            {"subscribed", subscribe}
+        }).toJson();
+    sendEncrypted(pClient, r);
+}
+
+// Send an event to every subscribed app
+void AppDataServer::pushEvent(const QJsonObject& event) {
+    auto r = QJsonDocument(event).toJson();
+
+    for (int i = subscribers.size() - 1; i >= 0; i--) {
+        if (!subscribers[i]->isValid()) {
+            subscribers.removeAt(i);
+            continue;
+        }
+
+        sendEncrypted(subscribers[i], r);
+    }
+}
+
+// Replace the snapshot with a changed copy. Only called on the GUI thread, so there is only ever one writer.
+void AppDataServer::updateSnapshot(std::function<void(WalletSnapshot&)> change) {
+    auto next = std::make_shared<WalletSnapshot>(*getSnapshot());
+    change(*next);
+    std::atomic_store(&snapshot, std::shared_ptr<const WalletSnapshot>(next));
+}
+
+void AppDataServer::infoChanged(MainWindow* mainWindow) {
+    if (mainWindow->getRPC()->getAllBalances() == nullptr)
+        return;
+
+    auto info = walletInfo(mainWindow);
+    if (info != getSnapshot()->info)
+        updateSnapshot([=] (WalletSnapshot& s) { s.info = info; });
+
+    if (subscribers.isEmpty())
+        return;
+
+    QJsonObject changed;
+    for (auto it = info.constBegin(); it != info.constEnd(); it++) {
+        if (lastInfo.value(it.key()) != it.value())
+            changed.insert(it.key(), it.value());
+    }
+    lastInfo = info;
+
+    if (changed.isEmpty())
+        return;
+
+    changed["event"] = "info";
+    pushEvent(changed);
+}
+
+static QString txRowKey(const QString& txid, const QString& type, const QString& addr) {
+    return txid % "/" % type % "/" % addr;
+}
+
+void AppDataServer::transactionsChanged(const TxTableModel* model) {
+    if (model == nullptr)
+        return;
+
+    // An empty wallet has no rows either, so this can't be told from txConfirmations being empty
+    bool firstTime = !haveTransactions;
+    haveTransactions = true;
+
+    QJsonArray              txns;
+    QJsonArray              newRows;
+    QJsonArray              bumps;
+    QHash<QString, qint64>  confirmations;
+
+    for (int i = 0; i < model->rowCount(QModelIndex()) && i < Settings::getMaxMobileAppTxns(); i++) {
+        auto txid  = model->getTxId(i);
+        auto type  = model->getType(i);
+        auto addr  = model->getAddr(i);
+        auto confs = model->getConfirmations(i);
+
+        QJsonObject row{
+            {"type", type},
+            {"datetime", model->getDate(i)},
+            {"amount", model->getAmt(i)},
+            {"txid", txid},
+            {"address", addr},
+            {"memo", model->getMemo(i)},
+            {"confirmations", confs}
+        };
+        txns.append(row);
+
+        auto key = txRowKey(txid, type, addr);
+        confirmations.insert(key, confs);
+
+        auto prev = txConfirmations.constFind(key);
+        if (prev == txConfirmations.constEnd()) {
+            newRows.append(row);
+        } else if (prev.value() != confs) {
+            bumps.append(QJsonObject{
+                {"txid", txid},
+                {"type", type},
+                {"address", addr},
+                {"confirmations", confs}
+            });
+        }
+    }
+
+    updateSnapshot([=] (WalletSnapshot& s) { s.transactions = txns; });
+    txConfirmations = confirmations;
+
+    // The first time, everything is new, and the apps will get it from getTransactions
+    if (firstTime || subscribers.isEmpty() || (newRows.isEmpty() && bumps.isEmpty()))
+        return;
+
+    pushEvent(QJsonObject{
+        {"event", "transactions"},
+        {"new", newRows},
+        {"confirmations", bumps}
+    });
+}
+
+void AppDataServer::opChanged(RPC* rpc, QString opid, QString status, QString txid, QString err) {
+    QJsonArray pending;
+    auto wtxns = rpc->getWatchingTxns();
+    for (auto id : wtxns.keys()) {
+        pending.append(QJsonObject{
+            {"type", "send"},
+            {"datetime", wtxns[id].submittedAt / 1000},
+            {"amount", wtxns[id].tx.toAddrs[0].amount.toDecimalString()},
+            {"txid", ""},
+            {"address", wtxns[id].tx.toAddrs[0].addr},
+            {"memo", wtxns[id].tx.toAddrs[0].txtMemo},
+            {"confirmations", 0}
+            });
+    }
+    updateSnapshot([=] (WalletSnapshot& s) { s.pending = pending; });
+
+    if (subscribers.isEmpty())
+        return;
+
+    pushEvent(QJsonObject{
+        {"event", "op"},
+        {"opid", opid},
+        {"status", status},
+        {"txid", txid},
+        {"error", err}
+    });
 }
 
 // ==============================
@@ -11,19 +11,50 @@ QT_FORWARD_DECLARE_CLASS(QWebSocketServer)
 QT_FORWARD_DECLARE_CLASS(QWebSocket)
 
 class WSServer;
+class WormholeClient;
+class TxTableModel;
 
 // We're going to wrap the websocket in this class, because the underlying QWebSocket might get closed
 // or deleted while a callback is waiting to get the data back. Therefore, we write a custom "sendTextMessage"
 // class that checks all this before sending.
 class ClientWebSocket {
 public:
-    ClientWebSocket(QWebSocket* c, WSServer* s = nullptr) { client = c; server = s; }
+    ClientWebSocket(QWebSocket* c, WSServer* s = nullptr, int p = 1) { client = c; key = c; server = s; protocol = p; }
+    // A message that came through the wormhole. Replies go through the wormhole client, which holds on to them
+    // while it reconnects, so they aren't tied to the socket the message came in on.
+    ClientWebSocket(WormholeClient* w);
 
     void sendTextMessage(QString m);
-    void close(QWebSocketProtocol::CloseCode code, const QString& msg) { client->close(code, msg); }
+    void sendBinaryMessage(const QByteArray& m);
+    bool isValid();
+    bool isSameSocket(const ClientWebSocket& other) { return key == other.key; }
+
+    // The paired device on the other end, once a message from it has been decrypted. For the wormhole, this
+    // starts out as the code it is registered with, which is the id of the device it is for.
+    const QString& getDeviceId() { return deviceId; }
+    void setDeviceId(const QString& id) { deviceId = id; }
+    void close(QWebSocketProtocol::CloseCode code, const QString& msg) { if (client) client->close(code, msg); }
+
+    // The protocol the message we're replying to used. Replies use the same one.
+    int  getProtocol() { return protocol; }
+    // Binary frames can't go through the wormhole, so protocols 2 and 3 only work on direct connections
+    int  getMaxProtocol() { return server != nullptr ? 3 : 1; }
+
+    // Identifies the connection to the worker threads. Unlike the socket itself, it is safe to read from any thread.
+    const void* getKey() { return key; }
+
+    // When the message we're replying to arrived. The first reply to it takes this, to time how long it took.
+    void   setReceivedAt(qint64 at) { receivedAt.storeRelease(at); }
+    qint64 takeReceivedAt() { return receivedAt.fetchAndStoreOrdered(0); }
 private:
-    QWebSocket* client;
+    QPointer<QWebSocket> client;            // The wormhole deletes its socket when it reconnects
+    QPointer<WormholeClient> wormhole;
+    bool        viaWormhole = false;
+    const void* key;
     WSServer*   server;
+    int         protocol;
+    QString     deviceId;
+    QAtomicInteger<qint64> receivedAt { 0 };
 };
 
 class WSServer : public QObject
@@ -50,13 +81,23 @@ private:
     bool m_debug;
 };
 
+/**
+ * The connection to the wormhole relay, for an app that connects over the internet.
+ *
+ * When the connection drops, it is retried with exponential backoff and jitter, so a flapping relay doesn't get a
+ * reconnect storm from every wallet at once. While connected, a websocket ping every heartbeatInterval measures the
+ * round trip time, and a connection that stops answering them is dropped and retried. Replies sent while we're
+ * reconnecting are queued (up to maxQueued, dropping the oldest) and sent once we're back.
+ */
 class WormholeClient : public QObject {
     Q_OBJECT 
 
 private Q_SLOTS:
     void onConnected();
     void onTextMessageReceived(QString message);
+    void onPong(quint64 elapsedTime, const QByteArray& payload);
     void closed();
+    void heartbeat();
 
 public:
     WormholeClient(MainWindow* parent, QString wormholeCode);
@@ -65,6 +106,14 @@ public:
     void connect();
     void retryConnect();
 
+    void sendTextMessage(const QString& m);
+
+    const QString& getCode() { return code; }
+    QWebSocket*    getSocket() { return m_webSocket; }
+
+    // The link counters, for the connection dialog
+    QString linkDesc();
+
 private:
     MainWindow* parent = nullptr;    
     QWebSocket*  m_webSocket = nullptr;
@@ -73,12 +122,28 @@ private:
 
     QString     code;
     int  retryCount          = 0;
+    bool retryPending        = false;
+    bool isConnected         = false;
     bool shuttingDown        = false;
-};
 
-enum NonceType {
-    LOCAL = 1,
-    REMOTE
+    QQueue<QString> outbox;                 // Replies waiting for the connection to come back
+
+    // Counters. The times are msecs since epoch.
+    qint64  lastPong          = 0;
+    qint64  lastKeepalive     = 0;
+    qint64  rtt               = -1;         // msecs, -1 until the first pong
+    qint64  disconnectedAt    = 0;
+    qint64  disconnectedMsecs = 0;          // Total time spent disconnected, not counting the current outage
+    int     reconnects        = 0;
+    int     queued            = 0;
+    int     dropped           = 0;
+
+    static const int minRetryDelay     = 2 * 1000;
+    static const int maxRetryDelay     = 5 * 60 * 1000;
+    static const int heartbeatInterval = 30 * 1000;
+    static const int heartbeatTimeout  = 3 * heartbeatInterval;    // Without a pong, the connection is dead
+    static const int keepaliveInterval = 4 * 60 * 1000;            // The relay times out idle connections after 5 minutes
+    static const int maxQueued         = 100;
 };
 
 enum AppConnectionType {
@@ -86,6 +151,67 @@ enum AppConnectionType {
     INTERNET
 };
 
+// The key and nonces of a paired app. It is allocated with sodium_malloc(), so it is locked in memory
+// and never swapped to disk.
+struct MobileSession {
+    unsigned char   secret[crypto_secretbox_KEYBYTES];
+    unsigned char   localNonce[crypto_secretbox_NONCEBYTES];            // The last nonce we sent
+    unsigned char   localNonceReserved[crypto_secretbox_NONCEBYTES];    // The saved local nonce. We don't go past it without saving a new one.
+    unsigned char   localNonceSaved[crypto_secretbox_NONCEBYTES];       // The reserve that is on disk. Nonces past it aren't sent until it is saved.
+    unsigned char   remoteNonce[crypto_secretbox_NONCEBYTES];           // The last nonce the app sent
+};
+
+/**
+ * Runs jobs on a pool of worker threads. Jobs posted with the same key run one at a time, in the order they were
+ * posted, so each connection's messages are handled (and its replies encrypted and sent) in order, while different
+ * connections are handled in parallel. A busy connection gives up its thread after each job, so it can't starve
+ * the others.
+ */
+class OrderedWorkers {
+public:
+    OrderedWorkers(int maxThreads) { pool.setMaxThreadCount(maxThreads); }
+
+    void post(const void* key, std::function<void(void)> job);
+    void waitForDone() { pool.waitForDone(); }
+
+private:
+    void runNext(const void* key);
+
+    QThreadPool                                             pool;
+    QMutex                                                  lock;
+    QHash<const void*, QQueue<std::function<void(void)>>>   queues;     // The head of each queue is the job running
+};
+
+// What the apps are told about the wallet. It is rebuilt on the GUI thread when the wallet changes, and never changed
+// after that, so the workers can read it without touching the RPC or the table models.
+struct WalletSnapshot {
+    QJsonObject     info;                   // The getInfo fields. Empty until the balances have been loaded.
+    QJsonArray      pending;                // Sends that zerod is still computing
+    QJsonArray      transactions;           // The newest transactions, as sent by getTransactions
+};
+
+// A paired app. Each one has its own key and nonces, so any number of them can be connected at the same time.
+// The id and allowInternet never change once it is paired. Everything else is guarded by its lock.
+struct MobileDevice {
+    ~MobileDevice() { if (keys) sodium_free(keys); }
+
+    QMutex              lock;
+    QString             id;                         // The wormhole code, which is derived from the secret
+    MobileSession*      keys                = nullptr;
+    QString             name;
+    qint64              lastSeen            = 0;
+    AppConnectionType   lastConnectedOver   = DIRECT;
+    bool                allowInternet       = false;
+
+    // Rate limit
+    double              tokens              = 0;
+    qint64              lastRefill          = 0;
+
+    // The messages we compressed for it, before and after, since the wallet started
+    qint64              uncompressedBytes   = 0;
+    qint64              compressedBytes     = 0;
+};
+
 class AppDataServer {
 public:
     static AppDataServer* getInstance() {
@@ -97,46 +223,114 @@ public:
 
     void          connectAppDialog(MainWindow* parent);
     void          updateConnectedUI();
+    void          updateDeviceUI();
     void          updateUIWithNewQRCode(MainWindow* mainwindow);
 
     void          processSendTx(QJsonObject sendTx, MainWindow* mainwindow, std::shared_ptr<ClientWebSocket> pClient);
     void          processMessage(QString message, MainWindow* mainWindow, std::shared_ptr<ClientWebSocket> pClient, AppConnectionType connType);
-    void          processGetInfo(QJsonObject jobj, MainWindow* mainWindow, std::shared_ptr<ClientWebSocket> pClient);
+    void          processBinaryMessage(QByteArray message, MainWindow* mainWindow, std::shared_ptr<ClientWebSocket> pClient, AppConnectionType connType);
+    void          processEncryptedMessage(std::function<QString(const unsigned char*, unsigned char*)> decrypt,
+                                          MainWindow* mainWindow, std::shared_ptr<ClientWebSocket> pClient, AppConnectionType connType);
+    void          processGetInfo(QJsonObject jobj, std::shared_ptr<ClientWebSocket> pClient);
     void          processDecryptedMessage(QString message, MainWindow* mainWindow, std::shared_ptr<ClientWebSocket> pClient);
-    void          processGetTransactions(MainWindow* mainWindow, std::shared_ptr<ClientWebSocket> pClient);
+    void          processGetTransactions(std::shared_ptr<ClientWebSocket> pClient);
+    void          processSubscribe(QJsonObject jobj, std::shared_ptr<ClientWebSocket> pClient);
 
-    QString       decryptMessage(QJsonDocument msg, QString secretHex, QString lastRemoteNonceHex);
-    QString       encryptOutgoing(QString msg);
+    // Called by the RPC when the wallet changes, to update the snapshot and push the changes to subscribed apps
+    void          infoChanged(MainWindow* mainWindow);
+    void          transactionsChanged(const TxTableModel* model);
+    void          opChanged(RPC* rpc, QString opid, QString status, QString txid, QString err);
 
-    QString       getWormholeCode(QString secretHex);
-    QString       getSecretHex();
-    void          saveNewSecret(QString secretHex);
+    // The caller holds the device's lock
+    QString       encryptOutgoing(MobileDevice* d, QString msg);
+    QByteArray    encryptOutgoingBinary(MobileDevice* d, QString msg, int protocol);
 
-    void          registerNewTempSecret(QString tmpSecretHex, bool allowInternet, MainWindow* main);
+    // Encrypt the reply for the client's device, with the protocol the client used, and send it. It is done on the
+    // client's worker, after anything else it is doing, and can be called from any thread.
+    void          sendEncrypted(std::shared_ptr<ClientWebSocket> pClient, QString msg);
 
-    QString       getNonceHex(NonceType nt);
-    void          saveNonceHex(NonceType nt, QString noncehex);
+    static QString getWormholeCode(QString secretHex);
 
-    bool          getAllowInternetConnection();
-    void          setAllowInternetConnection(bool allow);
+    void          registerNewTempSecret(QString tmpSecretHex, bool allowInternet, MainWindow* main);
+
+    QList<std::shared_ptr<MobileDevice>> getDevices();
+    std::shared_ptr<MobileDevice>        findDevice(const QString& id);
+    void          removeDevice(const QString& id, MainWindow* mainwindow);
+    QStringList   getInternetDeviceCodes();
 
-    void          saveLastSeenTime();
-    QDateTime     getLastSeenTime();
+    // Write the remote nonces and last seen times, which are otherwise saved a few seconds after they change
+    void          saveSession();
 
-    void          setConnectedName(QString name);   
-    QString       getConnectedName();
     bool          isAppConnected();
 
     QString       connDesc(AppConnectionType t);
 
-    void               saveLastConnectedOver(AppConnectionType type);
-    AppConnectionType  getLastConnectionType();
+    // Finish the messages the workers are handling, when the wallet is closing
+    void          waitForWorkers() { workers.waitForDone(); }
 
 private:
-    AppDataServer() = default;
+    AppDataServer() { clock.start(); }
+
+    void                    loadDevices();
+    std::shared_ptr<MobileDevice> makeDevice(const QString& secretHex, const QString& localNonceHex, const QString& remoteNonceHex);
+    void                    saveDevices();
+    void                    reserveLocalNonces(MobileDevice* d);
+    const unsigned char*    nextLocalNonce(MobileDevice* d);
+    bool                    allowMessage(MobileDevice* d);
+    void                    scheduleSaveSession();
+
+    QJsonObject             walletInfo(MainWindow* mainWindow);
+    void                    pushEvent(const QJsonObject& event);
+
+    void                    recordTiming(qint64 receivedAt);
+    QString                 timingDesc();
+
+    std::shared_ptr<const WalletSnapshot> getSnapshot() { return std::atomic_load(&snapshot); }
+    void                    updateSnapshot(std::function<void(WalletSnapshot&)> change);
 
     static AppDataServer*   instance;
     Ui_MobileAppConnector*  ui;
+    MainWindow*             uiParent           = nullptr;   // The window the connect dialog is showing over
+
+    // Messages are decrypted, handled and replied to on the workers. devicesLock only guards the list of devices and
+    // the temp secret, and is never held for long. Each device has its own lock, held while its keys are used, so
+    // messages for different devices are encrypted and decrypted in parallel. A removed device is freed once the
+    // last worker using it is done. saveLock makes the devices get saved one at a time.
+    OrderedWorkers          workers            { std::max(2, QThread::idealThreadCount() / 2) };
+    QMutex                  devicesLock;
+    QMutex                  saveLock;
+
+    QList<std::shared_ptr<MobileDevice>> devices;
+    bool                    devicesLoaded      = false;
+    QTimer*                 saveTimer          = nullptr;
+
+    std::shared_ptr<const WalletSnapshot> snapshot = std::make_shared<const WalletSnapshot>();
+
+    // How long the last maxTimings messages took, from arriving to their first reply being encrypted and sent, to see
+    // how much load the server can take. The times are from clock.
+    struct MessageTiming {
+        qint64  doneAt;                     // msecs
+        qint64  took;                       // usecs
+    };
+    QElapsedTimer           clock;
+    QMutex                  timingsLock;
+    QVector<MessageTiming>  timings;
+    int                     nextTiming         = 0;
+    static const int        maxTimings         = 1000;
+
+    // Apps that sent "subscribe", and what they were last sent, so only the changes are pushed. Only used on the
+    // GUI thread.
+    QList<std::shared_ptr<ClientWebSocket>> subscribers;
+    QJsonObject             lastInfo;
+    QHash<QString, qint64>  txConfirmations;            // Row key -> confirmations, for the newest transactions
+    bool                    haveTransactions   = false;     // transactionsChanged() has run once, so txConfirmations is valid
+
+    static const int        localNonceReserve  = 1000;      // Messages we can send before saving the local nonce again
+    static const int        saveSessionDelay   = 5 * 1000;
+
+    // Each device can send rateLimitBurst messages at once, and then rateLimitPerSec every second
+    static const int        rateLimitBurst     = 20;
+    static const int        rateLimitPerSec    = 5;
 
     QString                 tempSecret;
     WormholeClient*         tempWormholeClient = nullptr;
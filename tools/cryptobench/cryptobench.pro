@@ -0,0 +1,25 @@
+# Measures how fast the mobile app messages are encrypted and decrypted, and how many allocations each one takes.
+# See main.cpp for how to run it.
+
+QT       += core gui widgets network websockets
+
+TARGET = cryptobench
+
+TEMPLATE = app
+
+CONFIG += console c++14
+CONFIG -= app_bundle
+
+DEFINES += \
+    QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += ../../src/
+
+SOURCES += \
+    main.cpp \
+    ../../src/mobilecrypto.cpp
+
+HEADERS += \
+    ../../src/mobilecrypto.h
+
+include(../libsodium.pri)
@@ -0,0 +1,369 @@
+/**
+ * Measures the mobile app message crypto: how many messages a second are encrypted and decrypted, and how many heap
+ * allocations (and bytes) each one takes. It runs the wallet's MobileCrypto, and, to compare against, the code it
+ * replaced ("before").
+ *
+ *   cryptobench [--iterations n]
+ *
+ * Allocations made with operator new are always counted. Qt allocates its strings and arrays with malloc, which is
+ * only counted with glibc, where the real one can be called as __libc_malloc.
+ */
+#include "mobilecrypto.h"
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+
+#include <functional>
+
+static bool     counting        = false;
+static qint64   allocations     = 0;
+static qint64   allocatedBytes  = 0;
+
+static void countAllocation(size_t size) {
+    if (counting) {
+        allocations++;
+        allocatedBytes += size;
+    }
+}
+
+#ifdef __GLIBC__
+static const bool countsMalloc = true;
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t size);
+
+// operator new goes through malloc, so it is counted here too
+void* malloc(size_t size) noexcept {
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) noexcept {
+    countAllocation(n * size);
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t size) noexcept {
+    countAllocation(size);
+    return __libc_realloc(p, size);
+}
+}
+#else
+static const bool countsMalloc = false;
+
+void* operator new(size_t size) {
+    countAllocation(size);
+    if (auto p = std::malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+#endif
+
+/**
+ * The protocol 1 code from before the message crypto was reworked. It read the secret and the nonces from the
+ * settings, and wrote the new nonce back, for every message. Those are strings here, so the numbers are only for the
+ * message handling, which flatters it a little.
+ */
+namespace Before {
+
+static QString getWormholeCode(QString secretHex) {
+    unsigned char secret[crypto_secretbox_KEYBYTES];
+    sodium_hex2bin(secret, crypto_secretbox_KEYBYTES, secretHex.toStdString().c_str(), crypto_secretbox_KEYBYTES*2,
+        NULL, NULL, NULL);
+
+    unsigned char out1[crypto_hash_sha256_BYTES];
+    crypto_hash_sha256(out1, secret, crypto_secretbox_KEYBYTES);
+
+    unsigned char out2[crypto_hash_sha256_BYTES];
+    crypto_hash_sha256(out2, out1, crypto_hash_sha256_BYTES);
+
+    char wmcode[crypto_hash_sha256_BYTES*2 + 1];
+    sodium_bin2hex(wmcode, crypto_hash_sha256_BYTES*2 + 1, out2, crypto_hash_sha256_BYTES);
+
+    sodium_memzero(secret, crypto_secretbox_KEYBYTES);
+
+    return QString(wmcode);
+}
+
+static QString encryptOutgoing(QString msg, QString& localNonceHex, const QString& secretHex) {
+    if (msg.length() % 256 > 0) {
+        msg = msg + QString(" ").repeated(256 - (msg.length() % 256));
+    }
+
+    unsigned char* noncebin = new unsigned char[crypto_secretbox_NONCEBYTES];
+    sodium_hex2bin(noncebin, crypto_secretbox_NONCEBYTES, localNonceHex.toStdString().c_str(), localNonceHex.length(),
+        NULL, NULL, NULL);
+
+    // Increment the nonce +2 and save
+    sodium_increment(noncebin, crypto_secretbox_NONCEBYTES);
+    sodium_increment(noncebin, crypto_secretbox_NONCEBYTES);
+
+    char* newLocalNonce = new char[crypto_secretbox_NONCEBYTES*2 + 1];
+    sodium_memzero(newLocalNonce, crypto_secretbox_NONCEBYTES*2 + 1);
+    sodium_bin2hex(newLocalNonce, crypto_secretbox_NONCEBYTES*2+1, noncebin, crypto_box_NONCEBYTES);
+
+    localNonceHex = QString(newLocalNonce);
+
+    unsigned char* secret = new unsigned char[crypto_secretbox_KEYBYTES];
+    sodium_hex2bin(secret, crypto_secretbox_KEYBYTES, secretHex.toStdString().c_str(), crypto_secretbox_KEYBYTES*2,
+        NULL, NULL, NULL);
+
+    int msgSize = strlen(msg.toStdString().c_str());
+    unsigned char* encrpyted = new unsigned char[ msgSize + crypto_secretbox_MACBYTES];
+
+    crypto_secretbox_easy(encrpyted, (const unsigned char *)msg.toStdString().c_str(), msgSize, noncebin, secret);
+
+    int encryptedHexSize = (msgSize + crypto_secretbox_MACBYTES) * 2 + 1;
+    char * encryptedHex = new char[encryptedHexSize];
+    sodium_memzero(encryptedHex, encryptedHexSize);
+    sodium_bin2hex(encryptedHex, encryptedHexSize, encrpyted, msgSize + crypto_secretbox_MACBYTES);
+
+    auto json =  QJsonDocument(QJsonObject{
+            {"nonce", QString(newLocalNonce)},
+            {"payload", QString(encryptedHex)},
+            {"to", getWormholeCode(secretHex)}
+        });
+
+    delete[] noncebin;
+    delete[] newLocalNonce;
+    delete[] secret;
+    delete[] encrpyted;
+    delete[] encryptedHex;
+
+    return json.toJson();
+}
+
+static QString decryptMessage(QJsonDocument msg, QString secretHex, QString lastRemoteNonceHex) {
+    // Decrypt and then process
+    QString noncehex = msg.object().value("nonce").toString();
+    QString encryptedhex = msg.object().value("payload").toString();
+
+    // Enforce limits on the size of the message
+    if (noncehex.length() > ((int)crypto_secretbox_NONCEBYTES * 2) ||
+        encryptedhex.length() > 2 * 50 * 1024 /*50kb*/) {
+        return "error";
+    }
+
+    // Check to make sure that the nonce is greater than the last known remote nonce
+    unsigned char* lastRemoteBin = new unsigned char[crypto_secretbox_NONCEBYTES];
+    sodium_hex2bin(lastRemoteBin, crypto_secretbox_NONCEBYTES, lastRemoteNonceHex.toStdString().c_str(), lastRemoteNonceHex.length(),
+        NULL, NULL, NULL);
+
+    unsigned char* noncebin = new unsigned char[crypto_secretbox_NONCEBYTES];
+    sodium_hex2bin(noncebin, crypto_secretbox_NONCEBYTES, noncehex.toStdString().c_str(), noncehex.length(),
+        NULL, NULL, NULL);
+
+    if (sodium_compare(lastRemoteBin, noncebin, crypto_secretbox_NONCEBYTES) != -1) {
+        // Refuse to accept a lower nonce, return an error
+        delete[] lastRemoteBin;
+        delete[] noncebin;
+        return "error";
+    }
+
+    unsigned char* secret = new unsigned char[crypto_secretbox_KEYBYTES];
+    sodium_hex2bin(secret, crypto_secretbox_KEYBYTES, secretHex.toStdString().c_str(), crypto_secretbox_KEYBYTES*2,
+        NULL, NULL, NULL);
+
+    unsigned char* encrypted = new unsigned char[encryptedhex.length() / 2];
+    sodium_hex2bin(encrypted, encryptedhex.length() / 2, encryptedhex.toStdString().c_str(), encryptedhex.length(),
+                    NULL, NULL, NULL);
+
+    int decryptedLen = encryptedhex.length() / 2 - crypto_secretbox_MACBYTES;
+    unsigned char* decrypted = new unsigned char[decryptedLen];
+    int result = crypto_secretbox_open_easy(decrypted, encrypted, encryptedhex.length() / 2, noncebin, secret);
+
+    QString payload;
+    if (result == -1) {
+        payload = "error";
+    } else {
+        char* decryptedStr = new char[decryptedLen + 1];
+        sodium_memzero(decryptedStr, decryptedLen + 1);
+        memcpy(decryptedStr, decrypted, decryptedLen);
+
+        payload = QString(decryptedStr);
+
+        delete[] decryptedStr;
+    }
+
+    delete[] secret;
+    delete[] lastRemoteBin;
+    delete[] noncebin;
+    delete[] encrypted;
+    delete[] decrypted;
+
+    return payload;
+}
+
+}
+
+// A getInfo reply, and a getTransactions reply with txCount transactions, like the wallet sends
+static QString getInfoReply() {
+    return QJsonDocument(QJsonObject{
+        {"version", 1.0},
+        {"command", "getInfo"},
+        {"saplingAddress", "zs1" + QString("q").repeated(75)},
+        {"tAddress", "t1" + QString("a").repeated(33)},
+        {"balance", 1234.5678},
+        {"maxspendable", 1234.5678},
+        {"maxzspendable", 1000.0},
+        {"tokenName", "ZER"},
+        {"zecprice", 0.05},
+        {"serverversion", "1.0.0"},
+        {"maxprotocol", 3}
+    }).toJson();
+}
+
+static QString getTransactionsReply(int txCount) {
+    QJsonArray txns;
+    for (int i = 0; i < txCount; i++) {
+        txns.append(QJsonObject{
+            {"type", i % 3 == 0 ? "send" : "receive"},
+            {"datetime", 1600000000 + i * 600},
+            {"address", "zs1" + QString::number(i).rightJustified(75, 'q')},
+            {"txid", QString::number(i).rightJustified(64, 'f')},
+            {"amount", i * 0.25},
+            {"memo", i % 4 == 0 ? "Thanks for the coffee" : ""},
+            {"confirmations", i}
+        });
+    }
+
+    return QJsonDocument(QJsonObject{
+        {"version", 1.0},
+        {"command", "getTransactions"},
+        {"transactions", txns}
+    }).toJson();
+}
+
+struct Result {
+    QString name;
+    double  perSec;
+    double  allocsPerMsg;
+    double  bytesPerMsg;
+};
+
+// Runs fn iterations times. It is run once first, so the scratch buffer has grown before anything is counted.
+static Result run(const QString& name, int iterations, std::function<void(void)> fn) {
+    fn();
+
+    allocations    = 0;
+    allocatedBytes = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+    counting = true;
+    for (int i = 0; i < iterations; i++)
+        fn();
+    counting = false;
+    auto elapsed = std::max((qint64)1, timer.nsecsElapsed());
+
+    return Result{ name, iterations * 1e9 / elapsed, (double)allocations / iterations, (double)allocatedBytes / iterations };
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures the mobile app message crypto.");
+    parser.addHelpOption();
+    QCommandLineOption iterationsOption("iterations", "How many times each message is encrypted or decrypted.", "n", "20000");
+    parser.addOption(iterationsOption);
+    parser.process(a);
+
+    int iterations = std::max(1, parser.value(iterationsOption).toInt());
+
+    if (sodium_init() < 0) {
+        qDebug() << "Couldn't initialize libsodium";
+        return 1;
+    }
+
+    unsigned char secret[crypto_secretbox_KEYBYTES];
+    randombytes_buf(secret, crypto_secretbox_KEYBYTES);
+    auto secretHex = QString::fromLatin1(QByteArray((const char*)secret, crypto_secretbox_KEYBYTES).toHex());
+    auto to        = Before::getWormholeCode(secretHex);
+
+    unsigned char nonce[crypto_secretbox_NONCEBYTES];
+    sodium_memzero(nonce, crypto_secretbox_NONCEBYTES);
+    nonce[0] = 2;
+    auto zeroNonceHex = QString("00").repeated(crypto_secretbox_NONCEBYTES);
+
+    QList<QPair<QString, QString>> messages = {
+        { "getInfo", getInfoReply() },
+        { "getTransactions", getTransactionsReply(100) }
+    };
+
+    QList<Result> results;
+    for (const auto& m : messages) {
+        const auto& msg = m.second;
+
+        qint64          uncompressedBytes = 0;
+        qint64          compressedBytes   = 0;
+        unsigned char   lastRemoteNonce[crypto_secretbox_NONCEBYTES];
+        QString         localNonceHex     = zeroNonceHex;
+
+        // What the app would send, for the decrypting
+        auto textMsg       = QJsonDocument::fromJson(MobileCrypto::encryptText(msg, nonce, secret, to).toUtf8());
+        auto binaryMsg     = MobileCrypto::encryptBinary(msg, 2, nonce, secret, &uncompressedBytes, &compressedBytes);
+        auto compressedMsg = MobileCrypto::encryptBinary(msg, 3, nonce, secret, &uncompressedBytes, &compressedBytes);
+
+        QString label = m.first % " (" % QString::number(msg.toUtf8().size()) % " bytes)";
+
+        results.append(run("before: encrypt protocol 1, " % label, iterations, [&] () {
+            Before::encryptOutgoing(msg, localNonceHex, secretHex);
+        }));
+        results.append(run("before: decrypt protocol 1, " % label, iterations, [&] () {
+            Before::decryptMessage(textMsg, secretHex, zeroNonceHex);
+        }));
+        results.append(run("encrypt protocol 1, " % label, iterations, [&] () {
+            MobileCrypto::encryptText(msg, nonce, secret, to);
+        }));
+        results.append(run("decrypt protocol 1, " % label, iterations, [&] () {
+            sodium_memzero(lastRemoteNonce, crypto_secretbox_NONCEBYTES);
+            MobileCrypto::decryptText(textMsg, secret, lastRemoteNonce);
+        }));
+        results.append(run("encrypt protocol 2, " % label, iterations, [&] () {
+            MobileCrypto::encryptBinary(msg, 2, nonce, secret, &uncompressedBytes, &compressedBytes);
+        }));
+        results.append(run("decrypt protocol 2, " % label, iterations, [&] () {
+            sodium_memzero(lastRemoteNonce, crypto_secretbox_NONCEBYTES);
+            MobileCrypto::decryptBinary(binaryMsg, secret, lastRemoteNonce);
+        }));
+        results.append(run("encrypt protocol 3, " % label, iterations, [&] () {
+            MobileCrypto::encryptBinary(msg, 3, nonce, secret, &uncompressedBytes, &compressedBytes);
+        }));
+        results.append(run("decrypt protocol 3, " % label, iterations, [&] () {
+            sodium_memzero(lastRemoteNonce, crypto_secretbox_NONCEBYTES);
+            MobileCrypto::decryptBinary(compressedMsg, secret, lastRemoteNonce);
+        }));
+    }
+
+    QTextStream out(stdout);
+    out << QString("%1 %2 %3 %4").arg("", -56).arg("msgs/s", 10).arg("allocs/msg", 11).arg("bytes/msg", 11) << endl;
+    for (const auto& r : results) {
+        out << QString("%1 %2 %3 %4")
+            .arg(r.name, -56)
+            .arg(r.perSec, 10, 'f', 0)
+            .arg(r.allocsPerMsg, 11, 'f', 1)
+            .arg(r.bytesPerMsg, 11, 'f', 0) << endl;
+    }
+
+    if (!countsMalloc)
+        out << endl << "Only operator new is counted here, so Qt's strings and arrays aren't." << endl;
+
+    sodium_memzero(secret, crypto_secretbox_KEYBYTES);
+    return 0;
+}
@@ -0,0 +1,12 @@
+# Link the tools against the same libsodium as the wallet. Run res/libsodium/buildlibsodium.sh (or build the wallet)
+# first, so it is there.
+
+ROOT = $$PWD/..
+
+INCLUDEPATH += $$ROOT/src/3rdparty/
+INCLUDEPATH += $$ROOT/res
+DEPENDPATH  += $$ROOT/res
+
+win32:CONFIG(release, debug|release): LIBS += -L$$ROOT/res/ -llibsodium
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$ROOT/res/ -llibsodiumd
+else:unix: LIBS += -L$$ROOT/res/ -lsodium
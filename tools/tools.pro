@@ -0,0 +1,8 @@
+# Developer tools that aren't part of the wallet. They are built on their own, with
+#   qmake tools/tools.pro && make
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    wsloadtest \
+    cryptobench
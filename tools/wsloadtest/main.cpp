@@ -0,0 +1,515 @@
+/**
+ * A headless client that load tests the wallet's mobile app server (WSServer and AppDataServer). It pairs with the
+ * wallet the same way the app does, using the connection string from the "Connect mobile app" dialog. It then sends
+ * a mix of getInfo, getTransactions and sendTx commands over the app protocol, and reports the throughput and how
+ * long the replies took.
+ *
+ *   wsloadtest "ws://192.168.1.5:8237,<secret>" --count 2000 --window 4 --mix getInfo=6,getTransactions=3,sendTx=1 --to <zaddr>
+ *
+ * sendTx is always sent as a dry run. The wallet checks it and picks a from address, but never sends it.
+ *
+ * The wallet rate limits each paired device (a burst of 20 messages, then 5 a second). To load the server harder,
+ * pair more devices and pass a connection string for each. Each one gets its own socket, and they all run at once.
+ */
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QWebSocket>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QDateTime>
+#include <QTextStream>
+#include <QTimer>
+#include <QtEndian>
+#include <QMap>
+#include <QVector>
+
+#include <algorithm>
+#include <functional>
+
+#include "sodium.h"
+
+// The same as MobileCrypto's
+static const quint32 compressedFlag = 0x80000000u;
+static const int     binaryHeaderSize = 1 + crypto_secretbox_NONCEBYTES;
+
+struct Options {
+    int                         count       = 1000;
+    int                         window      = 1;
+    int                         protocol    = 1;
+    int                         rate        = 0;
+    int                         timeout     = 30;
+    QVector<QPair<QString, int>> mix;
+    QString                     to;
+    QString                     amount;
+    QString                     name;
+};
+
+// What all the connections saw
+struct Stats {
+    QMap<QString, QVector<qint64>>  took;           // usecs, by command
+    QMap<QString, int>              errors;         // How many of each error message
+    qint64                          startedAt = -1; // msecs on clock, when the first connection was paired
+    qint64                          doneAt    = 0;
+    QElapsedTimer                   clock;
+};
+
+class LoadClient {
+public:
+    LoadClient(const QString& connStr, const Options& opts, Stats* stats, std::function<void(LoadClient*)> done);
+    ~LoadClient();
+
+    bool            isValid() { return valid; }
+    const QString&  getError() { return error; }
+    void            start();
+
+private:
+    struct Pending {
+        QString command;
+        qint64  sentAt;     // nsecs on the stats clock
+    };
+
+    void        fill();
+    void        send(const QString& command);
+    QString     pickCommand();
+
+    void        sendEncrypted(const QByteArray& utf8);
+    void        textReceived(const QString& message);
+    void        binaryReceived(const QByteArray& message);
+    void        replyReceived(const QJsonObject& reply);
+
+    void        finish(const QString& err = QString());
+
+    Options         opts;
+    Stats*          stats;
+    std::function<void(LoadClient*)> done;
+
+    QString         url;
+    unsigned char   secret[crypto_secretbox_KEYBYTES];
+    unsigned char   nonce[crypto_secretbox_NONCEBYTES];
+    bool            valid       = false;
+    QString         error;
+
+    QWebSocket      socket;
+    QTimer          pacer;
+    QTimer          watchdog;
+    bool            paired      = false;
+    bool            finished    = false;
+    int             sent        = 0;
+    QList<Pending>  pending;
+};
+
+LoadClient::LoadClient(const QString& connStr, const Options& opts, Stats* stats, std::function<void(LoadClient*)> done) :
+    opts(opts), stats(stats), done(done) {
+    auto parts = connStr.split(",");
+    url = parts[0];
+
+    auto secretHex = parts.size() >= 2 ? parts[1].toLatin1() : QByteArray();
+    if (!url.startsWith("ws://") || secretHex.size() != crypto_secretbox_KEYBYTES * 2 ||
+            sodium_hex2bin(secret, crypto_secretbox_KEYBYTES, secretHex.constData(), secretHex.size(), NULL, NULL, NULL) != 0) {
+        error = "Not a connection string: " + connStr;
+        return;
+    }
+
+    // The wallet only takes nonces higher than the last one it saw from this device, and the app's are even. Start
+    // from the time, so a device can be used for run after run.
+    sodium_memzero(nonce, crypto_secretbox_NONCEBYTES);
+    qToLittleEndian<quint64>((quint64)QDateTime::currentMSecsSinceEpoch() << 20, nonce);
+
+    valid = true;
+}
+
+LoadClient::~LoadClient() {
+    sodium_memzero(secret, crypto_secretbox_KEYBYTES);
+}
+
+void LoadClient::start() {
+    QObject::connect(&socket, &QWebSocket::connected, [=] () {
+        // The first message pairs the device, so the window is only filled once it has been answered
+        send("getInfo");
+    });
+    QObject::connect(&socket, &QWebSocket::disconnected, [=] () {
+        finish(socket.closeReason().isEmpty() ? socket.errorString() : socket.closeReason());
+    });
+    QObject::connect(&socket, QOverload<QAbstractSocket::SocketError>::of(&QWebSocket::error), [=] (QAbstractSocket::SocketError) {
+        finish(socket.errorString());
+    });
+    QObject::connect(&socket, &QWebSocket::textMessageReceived, [=] (const QString& m) { textReceived(m); });
+    QObject::connect(&socket, &QWebSocket::binaryMessageReceived, [=] (const QByteArray& m) { binaryReceived(m); });
+
+    if (opts.rate > 0) {
+        pacer.setInterval(std::max(1, 1000 / opts.rate));
+        QObject::connect(&pacer, &QTimer::timeout, [=] () {
+            if (paired && sent < opts.count && pending.size() < opts.window)
+                send(pickCommand());
+        });
+    }
+
+    watchdog.setSingleShot(true);
+    watchdog.setInterval(opts.timeout * 1000);
+    QObject::connect(&watchdog, &QTimer::timeout, [=] () {
+        finish(QString("No reply for %1 seconds").arg(opts.timeout));
+    });
+
+    socket.open(QUrl(url));
+    watchdog.start();
+}
+
+QString LoadClient::pickCommand() {
+    int total = 0;
+    for (const auto& m : opts.mix)
+        total += m.second;
+
+    int r = QRandomGenerator::global()->bounded(total);
+    for (const auto& m : opts.mix) {
+        if (r < m.second)
+            return m.first;
+        r -= m.second;
+    }
+    return opts.mix.last().first;
+}
+
+// Keep window messages in flight, unless they are paced
+void LoadClient::fill() {
+    if (opts.rate > 0)
+        return;
+
+    while (sent < opts.count && pending.size() < opts.window)
+        send(pickCommand());
+}
+
+void LoadClient::send(const QString& command) {
+    QJsonObject msg { {"command", command} };
+    if (command == "getInfo") {
+        msg["name"] = opts.name;
+    } else if (command == "sendTx") {
+        msg["tx"] = QJsonObject{
+            {"to",      opts.to},
+            {"amount",  opts.amount},
+            {"memo",    ""},
+            {"dryrun",  true}
+        };
+    }
+
+    // The pairing message isn't counted
+    if (paired)
+        sent++;
+
+    pending.append(Pending{ command, stats->clock.nsecsElapsed() });
+    sendEncrypted(QJsonDocument(msg).toJson(QJsonDocument::Compact));
+}
+
+void LoadClient::sendEncrypted(const QByteArray& utf8) {
+    sodium_increment(nonce, crypto_secretbox_NONCEBYTES);
+    sodium_increment(nonce, crypto_secretbox_NONCEBYTES);
+
+    if (opts.protocol == 1) {
+        QByteArray box(utf8.size() + crypto_secretbox_MACBYTES, 0);
+        crypto_secretbox_easy((unsigned char*)box.data(), (const unsigned char*)utf8.constData(), utf8.size(), nonce, secret);
+
+        auto msg = QJsonObject{
+            {"nonce",   QString(QByteArray((const char*)nonce, crypto_secretbox_NONCEBYTES).toHex())},
+            {"payload", QString(box.toHex())}
+        };
+        socket.sendTextMessage(QJsonDocument(msg).toJson(QJsonDocument::Compact));
+        return;
+    }
+
+    // Protocols 2 and 3: the protocol, the nonce, and then the message (with its length first) encrypted
+    int len = 4 + utf8.size();
+    QByteArray out(binaryHeaderSize + len + crypto_secretbox_MACBYTES, 0);
+    auto box = (unsigned char*)out.data() + binaryHeaderSize;
+    qToBigEndian<quint32>(utf8.size(), box);
+    memcpy(box + 4, utf8.constData(), utf8.size());
+
+    out[0] = (char)opts.protocol;
+    memcpy(out.data() + 1, nonce, crypto_secretbox_NONCEBYTES);
+    crypto_secretbox_easy(box, box, len, nonce, secret);
+
+    socket.sendBinaryMessage(out);
+}
+
+void LoadClient::textReceived(const QString& message) {
+    auto obj = QJsonDocument::fromJson(message.toUtf8()).object();
+
+    // Errors from before the message could be decrypted (and rate limiting) aren't encrypted
+    if (obj.contains("error")) {
+        replyReceived(obj);
+        return;
+    }
+
+    auto noncebin = QByteArray::fromHex(obj["nonce"].toString().toLatin1());
+    auto box      = QByteArray::fromHex(obj["payload"].toString().toLatin1());
+    if (noncebin.size() != crypto_secretbox_NONCEBYTES || box.size() < (int)crypto_secretbox_MACBYTES) {
+        finish("Couldn't read a reply");
+        return;
+    }
+
+    QByteArray plain(box.size() - crypto_secretbox_MACBYTES, 0);
+    if (crypto_secretbox_open_easy((unsigned char*)plain.data(), (const unsigned char*)box.constData(), box.size(),
+            (const unsigned char*)noncebin.constData(), secret) != 0) {
+        finish("Couldn't decrypt a reply");
+        return;
+    }
+
+    // Protocol 1 replies are padded with spaces
+    replyReceived(QJsonDocument::fromJson(plain.trimmed()).object());
+}
+
+void LoadClient::binaryReceived(const QByteArray& message) {
+    int encryptedLen = message.size() - binaryHeaderSize;
+    if (encryptedLen < (int)crypto_secretbox_MACBYTES + 4) {
+        finish("Couldn't read a reply");
+        return;
+    }
+
+    QByteArray plain(encryptedLen - crypto_secretbox_MACBYTES, 0);
+    auto buf = (unsigned char*)plain.data();
+    if (crypto_secretbox_open_easy(buf, (const unsigned char*)message.constData() + binaryHeaderSize, encryptedLen,
+            (const unsigned char*)message.constData() + 1, secret) != 0) {
+        finish("Couldn't decrypt a reply");
+        return;
+    }
+
+    quint32 header     = qFromBigEndian<quint32>(buf);
+    bool    compressed = message[0] == 3 && (header & compressedFlag);
+    quint32 len        = compressed ? header & ~compressedFlag : header;
+    if (len > (quint32)plain.size() - 4) {
+        finish("Couldn't read a reply");
+        return;
+    }
+
+    auto utf8 = compressed ? qUncompress(buf + 4, len) : plain.mid(4, len);
+    replyReceived(QJsonDocument::fromJson(utf8).object());
+}
+
+void LoadClient::replyReceived(const QJsonObject& reply) {
+    if (finished || pending.isEmpty())
+        return;
+
+    // Pushed events aren't replies to anything
+    if (reply.contains("event"))
+        return;
+
+    // Replies can come back out of order, since sendTx goes through the wallet's GUI thread. Errors don't say what
+    // they are a reply to, so they are put down to the oldest message, except for the sendTx ones.
+    auto command = reply["command"].toString();
+    auto err     = reply.contains("error") ? reply["error"].toString() : reply["errorMessage"].toString();
+    if (command.isEmpty() && err.startsWith("Couldn't send Tx"))
+        command = "sendTx";
+
+    int i = 0;
+    if (!command.isEmpty()) {
+        while (i < pending.size() && pending[i].command != command)
+            i++;
+        if (i == pending.size())
+            i = 0;
+    }
+
+    auto p = pending.takeAt(i);
+    watchdog.start();
+
+    if (!paired) {
+        if (!err.isEmpty()) {
+            finish("Couldn't pair: " + err);
+            return;
+        }
+
+        paired = true;
+        if (stats->startedAt < 0)
+            stats->startedAt = stats->clock.elapsed();
+
+        if (opts.rate > 0)
+            pacer.start();
+    } else {
+        stats->took[p.command].append((stats->clock.nsecsElapsed() - p.sentAt) / 1000);
+        if (!err.isEmpty())
+            stats->errors[err]++;
+        else if (command == "sendTx" && reply["result"].toString() != "dryrun")
+            stats->errors["sendTx wasn't a dry run. Is the wallet too old to know about them?"]++;
+    }
+
+    if (sent >= opts.count && pending.isEmpty()) {
+        finish();
+        return;
+    }
+
+    fill();
+}
+
+void LoadClient::finish(const QString& err) {
+    if (finished)
+        return;
+    finished = true;
+
+    if (!err.isEmpty()) {
+        error = err;
+        if (!pending.isEmpty())
+            stats->errors["No reply"] += paired ? pending.size() : pending.size() - 1;
+    }
+    pending.clear();
+    stats->doneAt = stats->clock.elapsed();
+
+    pacer.stop();
+    watchdog.stop();
+    socket.disconnect();
+    socket.close();
+
+    done(this);
+}
+
+static bool parseMix(const QString& spec, QVector<QPair<QString, int>>& mix) {
+    int total = 0;
+    for (const auto& part : spec.split(",", QString::SkipEmptyParts)) {
+        auto kv = part.split("=");
+        bool ok = false;
+        int weight = kv.size() == 2 ? kv[1].toInt(&ok) : 0;
+        if (!ok || weight < 0 || !QStringList({"getInfo", "getTransactions", "sendTx"}).contains(kv[0]))
+            return false;
+
+        if (weight > 0)
+            mix.append(qMakePair(kv[0], weight));
+        total += weight;
+    }
+
+    return total > 0;
+}
+
+static void report(QTextStream& out, const Stats& stats) {
+    int     total   = 0;
+    qint64  elapsed = std::max((qint64)1, stats.doneAt - stats.startedAt);
+
+    out << QString("%1 %2 %3 %4 %5 %6")
+        .arg("", -16).arg("replies", 8).arg("50th", 9).arg("95th", 9).arg("99th", 9).arg("max (ms)", 10) << endl;
+    for (auto it = stats.took.constBegin(); it != stats.took.constEnd(); it++) {
+        auto took = it.value();
+        std::sort(took.begin(), took.end());
+        total += took.size();
+
+        auto percentile = [&] (int p) {
+            return took[std::min(took.size() - 1, took.size() * p / 100)] / 1000.0;
+        };
+        out << QString("%1 %2 %3 %4 %5 %6")
+            .arg(it.key(), -16)
+            .arg(took.size(), 8)
+            .arg(percentile(50), 9, 'f', 2)
+            .arg(percentile(95), 9, 'f', 2)
+            .arg(percentile(99), 9, 'f', 2)
+            .arg(took.last() / 1000.0, 10, 'f', 2) << endl;
+    }
+
+    out << endl << QString("%1 replies in %2 s, %3 messages/s")
+        .arg(total)
+        .arg(elapsed / 1000.0, 0, 'f', 2)
+        .arg(total * 1000.0 / elapsed, 0, 'f', 1) << endl;
+
+    if (!stats.errors.isEmpty()) {
+        out << endl << "Errors:" << endl;
+        for (auto it = stats.errors.constBegin(); it != stats.errors.constEnd(); it++)
+            out << QString("%1  %2").arg(it.value(), 8).arg(it.key()) << endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("wsloadtest");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Load tests the zerowallet mobile app server. Pair it using the connection "
+        "string from the \"Connect mobile app\" dialog. sendTx is always sent as a dry run.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("connection", "A connection string (ws://host:port,secret). Give one for each "
+        "paired device to run them all at once.", "<connection>...");
+
+    QCommandLineOption countOption("count", "Messages to send on each connection.", "n", "1000");
+    QCommandLineOption windowOption("window", "Messages in flight on each connection.", "n", "1");
+    QCommandLineOption mixOption("mix", "The commands to send, and how often.", "mix", "getInfo=6,getTransactions=3,sendTx=1");
+    QCommandLineOption protocolOption("protocol", "1 (JSON), 2 (binary) or 3 (binary, compressed).", "n", "1");
+    QCommandLineOption rateOption("rate", "Messages a second on each connection. 0 sends the next one as soon as "
+        "there's room in the window.", "n", "0");
+    QCommandLineOption toOption("to", "The address to send the sendTx dry runs to.", "address");
+    QCommandLineOption amountOption("amount", "The amount of each sendTx dry run.", "amount", "0.0001");
+    QCommandLineOption nameOption("name", "The device name to send with getInfo.", "name", "wsloadtest");
+    QCommandLineOption timeoutOption("timeout", "Give up on a connection after this many seconds without a reply.", "secs", "30");
+    parser.addOptions({ countOption, windowOption, mixOption, protocolOption, rateOption, toOption, amountOption,
+                        nameOption, timeoutOption });
+    parser.process(a);
+
+    QTextStream err(stderr);
+    QTextStream out(stdout);
+
+    Options opts;
+    opts.count    = parser.value(countOption).toInt();
+    opts.window   = std::max(1, parser.value(windowOption).toInt());
+    opts.protocol = parser.value(protocolOption).toInt();
+    opts.rate     = std::max(0, parser.value(rateOption).toInt());
+    opts.timeout  = std::max(1, parser.value(timeoutOption).toInt());
+    opts.to       = parser.value(toOption);
+    opts.amount   = parser.value(amountOption);
+    opts.name     = parser.value(nameOption);
+
+    if (parser.positionalArguments().isEmpty())
+        parser.showHelp(1);
+
+    if (!parseMix(parser.value(mixOption), opts.mix)) {
+        err << "--mix should look like getInfo=6,getTransactions=3,sendTx=1" << endl;
+        return 1;
+    }
+
+    if (opts.protocol < 1 || opts.protocol > 3) {
+        err << "--protocol has to be 1, 2 or 3" << endl;
+        return 1;
+    }
+
+    for (const auto& m : opts.mix) {
+        if (m.first == "sendTx" && opts.to.isEmpty()) {
+            err << "--to is needed to send sendTx" << endl;
+            return 1;
+        }
+    }
+
+    if (sodium_init() < 0) {
+        err << "Couldn't initialize libsodium" << endl;
+        return 1;
+    }
+
+    Stats stats;
+    stats.clock.start();
+
+    QList<LoadClient*> clients;
+    int running = 0;
+    int failed  = 0;
+    for (const auto& connStr : parser.positionalArguments()) {
+        auto client = new LoadClient(connStr, opts, &stats, [&] (LoadClient* c) {
+            if (!c->getError().isEmpty()) {
+                err << c->getError() << endl;
+                failed++;
+            }
+
+            if (--running == 0)
+                QTimer::singleShot(0, &a, &QCoreApplication::quit);
+        });
+
+        if (!client->isValid()) {
+            err << client->getError() << endl;
+            qDeleteAll(clients);
+            delete client;
+            return 1;
+        }
+        clients.append(client);
+    }
+
+    running = clients.size();
+    for (auto c : clients)
+        c->start();
+
+    a.exec();
+
+    if (stats.startedAt >= 0)
+        report(out, stats);
+
+    qDeleteAll(clients);
+    return failed == 0 && stats.startedAt >= 0 ? 0 : 1;
+}
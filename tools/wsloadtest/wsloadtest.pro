@@ -0,0 +1,19 @@
+# A headless client that load tests the wallet's mobile app server. See main.cpp for how to run it.
+
+QT       += core websockets
+QT       -= gui
+
+TARGET = wsloadtest
+
+TEMPLATE = app
+
+CONFIG += console c++14
+CONFIG -= app_bundle
+
+DEFINES += \
+    QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+    main.cpp
+
+include(../libsodium.pri)
@@ -61,7 +61,15 @@ SOURCES += \
     src/recurring.cpp \
     src/requestdialog.cpp \
     src/memoedit.cpp \
-    src/viewalladdresses.cpp
+    src/viewalladdresses.cpp \
+    src/utxoindex.cpp \
+    src/amount.cpp \
+    src/addresslistmodel.cpp \
+    src/journaledstore.cpp \
+    src/bulkpayout.cpp \
+    src/prooftimes.cpp \
+    src/trace.cpp \
+    src/mobilecrypto.cpp
 
 HEADERS += \
     src/mainwindow.h \
@@ -89,7 +97,15 @@ HEADERS += \
     src/recurring.h \
     src/requestdialog.h \
     src/memoedit.h \
-    src/viewalladdresses.h
+    src/viewalladdresses.h \
+    src/utxoindex.h \
+    src/amount.h \
+    src/addresslistmodel.h \
+    src/journaledstore.h \
+    src/bulkpayout.h \
+    src/prooftimes.h \
+    src/trace.h \
+    src/mobilecrypto.h
 
 FORMS += \
     src/mainwindow.ui \
@@ -113,7 +129,8 @@ FORMS += \
     src/newrecurring.ui \
     src/requestdialog.ui \
     src/recurringmultiple.ui \
-    src/znsetup.ui
+    src/znsetup.ui \
+    src/bulkpayout.ui
 
 
 TRANSLATIONS = res/zero_qt_wallet_es.ts \